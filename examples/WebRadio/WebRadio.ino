@@ -250,7 +250,7 @@ const int preallocateBufferSize = 5*1024;
 const int preallocateCodecSize = 29192; // MP3 codec max mem needed
 #else
 const int preallocateBufferSize = 16*1024;
-const int preallocateCodecSize = 85332; // AAC+SBR codec max mem needed
+const int preallocateCodecSize = AudioGeneratorAAC::preAllocSize(); // AAC+SBR codec max mem needed
 #endif
 void *preallocateBuffer = NULL;
 void *preallocateCodec = NULL;
@@ -37,7 +37,14 @@ class AudioFileSource
     virtual bool isOpen() { return false; };
     virtual uint32_t getSize() { return 0; };
     virtual uint32_t getPos() { return 0; };
+    // Where the next read() comes from.  The same as getPos() but for sources which read ahead of
+    // the caller, like AudioFileSourceBuffer, whose getPos() is how far they've read their own input.
+    virtual uint32_t getReadPos() { return getPos(); };
     virtual bool loop() { return true; };
+    // Where the next len bytes already are in memory, moving past them as read() would.  NULL if they
+    // aren't all there to point at, with nothing moved.  On the ESP8266 it can be flash, which needs
+    // pgm_read_*() to read.
+    virtual const void *readMapped(uint32_t len) { (void)len; return NULL; };
 
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
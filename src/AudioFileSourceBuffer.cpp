@@ -64,6 +64,7 @@ bool AudioFileSourceBuffer::seek(int32_t pos, int dir)
     readPtr = 0;
     writePtr = 0;
     length = 0;
+    filled = false;
     return src->seek(pos, dir);
   }
 }
@@ -90,6 +91,11 @@ uint32_t AudioFileSourceBuffer::getPos()
   return src->getPos();
 }
 
+uint32_t AudioFileSourceBuffer::getReadPos()
+{
+  return src->getReadPos() - length; // Where the reader is, not how far ahead the buffer has gotten
+}
+
 uint32_t AudioFileSourceBuffer::getFillLevel()
 {
   return length;
@@ -37,6 +37,7 @@ class AudioFileSourceBuffer : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override;
+    virtual uint32_t getReadPos() override;
     virtual bool loop() override;
 
     virtual uint32_t getFillLevel();
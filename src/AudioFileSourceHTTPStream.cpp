@@ -27,35 +27,156 @@ AudioFileSourceHTTPStream::AudioFileSourceHTTPStream()
   pos = 0;
   reconnectTries = 0;
   saveURL[0] = 0;
+  chunked = false;
 }
 
 AudioFileSourceHTTPStream::AudioFileSourceHTTPStream(const char *url)
 {
   saveURL[0] = 0;
   reconnectTries = 0;
+  chunked = false;
   open(url);
 }
 
 bool AudioFileSourceHTTPStream::open(const char *url)
 {
+  static const char *hdr[] = { "Transfer-Encoding" };
   pos = 0;
   http.begin(client, url);
+  http.collectHeaders( hdr, 1 );
   http.setReuse(true);
 #ifndef ESP32
   http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
 #endif
   int code = http.GET();
   if (code != HTTP_CODE_OK) {
+    // The error page would be left in a kept-alive socket, and read as audio after a reconnect
     http.end();
+    client.stop();
     cb.st(STATUS_HTTPFAIL, PSTR("Can't open HTTP request"));
     return false;
   }
-  size = http.getSize();
+  beginBody();
   strncpy(saveURL, url, sizeof(saveURL));
   saveURL[sizeof(saveURL)-1] = 0;
   return true;
 }
 
+bool AudioFileSourceHTTPStream::openNext(const char *url)
+{
+  if (!canReuse(url)) {
+    // Different server or unread data in flight, so the socket can't carry the next request
+    http.end();
+    client.stop();
+  }
+  // HTTPClient::begin() keeps a connected, reusable socket and GET() skips the handshake
+  return open(url);
+}
+
+bool AudioFileSourceHTTPStream::canReuse(const char *url)
+{
+  if (!saveURL[0] || !http.connected()) return false;
+  // Only safe when the whole prior body was consumed, otherwise its tail would be read as the next response
+  if (!bodyDone()) return false;
+  return sameHost(saveURL, url);
+}
+
+// Compare the scheme://host:port portion of two URLs
+bool AudioFileSourceHTTPStream::sameHost(const char *a, const char *b)
+{
+  const char *sa = strstr(a, "://");
+  const char *sb = strstr(b, "://");
+  if (!sa || !sb) return false;
+  sa += 3;
+  sb += 3;
+  int la = sa - a;
+  if ((la != sb - b) || strncasecmp(a, b, la)) return false;
+  while (*sa && *sa != '/' && *sb && *sb != '/') {
+    if (tolower(*sa) != tolower(*sb)) return false;
+    sa++;
+    sb++;
+  }
+  return ((*sa == 0) || (*sa == '/')) && ((*sb == 0) || (*sb == '/'));
+}
+
+// Called once the response headers are in, sets up size and the chunk decoder
+void AudioFileSourceHTTPStream::beginBody()
+{
+  chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+  chunkState = CHUNK_SIZE;
+  chunkLeft = 0;
+  chunkLineLen = 0;
+  size = chunked ? -1 : http.getSize();
+}
+
+bool AudioFileSourceHTTPStream::bodyDone()
+{
+  if (chunked) return chunkState == CHUNK_DONE;
+  return (size > 0) && (pos >= size);
+}
+
+// Read up to len bytes of entity body.  For chunked responses the framing is consumed here
+// and payload bytes go straight from the socket into dest, so no extra copy is made.
+// Any state (even mid size-line) survives a short read and resumes on the next call.
+int AudioFileSourceHTTPStream::readBody(uint8_t *dest, int len)
+{
+  WiFiClient *stream = http.getStreamPtr();
+  if (!chunked) {
+    int ret = stream->read(dest, len);
+    return (ret < 0) ? 0 : ret;
+  }
+
+  int got = 0;
+  while ((got < len) && (chunkState != CHUNK_DONE)) {
+    if (chunkState == CHUNK_DATA) {
+      int toRead = std::min((uint32_t)(len - got), chunkLeft);
+      int ret = stream->read(dest + got, toRead);
+      if (ret <= 0) break;
+      got += ret;
+      chunkLeft -= ret;
+      if (!chunkLeft) chunkState = CHUNK_DATA_END;
+      continue;
+    }
+
+    int c = stream->read();
+    if (c < 0) break;
+    switch (chunkState) {
+      case CHUNK_SIZE:
+      case CHUNK_EXT:
+        if (c == '\n') {
+          chunkState = chunkLeft ? CHUNK_DATA : CHUNK_TRAILER;
+          chunkLineLen = 0;
+        } else if (chunkState == CHUNK_SIZE && isxdigit(c)) {
+          if (chunkLeft >> 27) {
+            cb.st(STATUS_CHUNKERR, PSTR("Invalid chunk size"));
+            chunkState = CHUNK_DONE;
+            break;
+          }
+          chunkLeft = (chunkLeft << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+        } else if (c != '\r') {
+          chunkState = CHUNK_EXT; // Chunk extension or whitespace, ignored
+        }
+        break;
+      case CHUNK_DATA_END:
+        if (c == '\n') {
+          chunkState = CHUNK_SIZE;
+          chunkLeft = 0;
+        }
+        break;
+      case CHUNK_TRAILER:
+        // Trailer headers end with an empty line
+        if (c == '\n') {
+          if (!chunkLineLen) chunkState = CHUNK_DONE;
+          chunkLineLen = 0;
+        } else if (c != '\r') {
+          chunkLineLen++;
+        }
+        break;
+    }
+  }
+  return got;
+}
+
 AudioFileSourceHTTPStream::~AudioFileSourceHTTPStream()
 {
   http.end();
@@ -100,12 +221,12 @@ retry:
       return 0;
     }
   }
-  if ((size > 0) && (pos >= size)) return 0;
+  if (bodyDone()) return 0;
 
   WiFiClient *stream = http.getStreamPtr();
 
   // Can't read past EOF...
-  if ( (size > 0) && (len > (uint32_t)(pos - size)) ) len = pos - size;
+  if ( (size > 0) && (len > (uint32_t)(size - pos)) ) len = size - pos;
 
   if (!nonBlock) {
     int start = millis();
@@ -121,8 +242,10 @@ retry:
   if (avail == 0) return 0;
   if (avail < len) len = avail;
 
-  int read = stream->read(reinterpret_cast<uint8_t*>(data), len);
+  int read = readPayload(reinterpret_cast<uint8_t*>(data), len);
   pos += read;
+  // Everything available may have been framing or metadata, so wait for real data
+  if (!nonBlock && !read && !bodyDone()) goto retry;
   return read;
 }
 
@@ -39,6 +39,9 @@ class AudioFileSourceHTTPStream : public AudioFileSource
     virtual ~AudioFileSourceHTTPStream() override;
     
     virtual bool open(const char *url) override;
+    // Open a new URL, reusing the live connection when it points to the same host:port
+    // and the previous response has been completely read.  Otherwise reconnects.
+    virtual bool openNext(const char *url);
     virtual uint32_t read(void *data, uint32_t len) override;
     virtual uint32_t readNonBlock(void *data, uint32_t len) override;
     virtual bool seek(int32_t pos, int dir) override;
@@ -49,10 +52,16 @@ class AudioFileSourceHTTPStream : public AudioFileSource
     bool SetReconnect(int tries, int delayms) { reconnectTries = tries; reconnectDelayMs = delayms; return true; }
     void useHTTP10 () { http.useHTTP10(true); }
 
-    enum { STATUS_HTTPFAIL=2, STATUS_DISCONNECTED, STATUS_RECONNECTING, STATUS_RECONNECTED, STATUS_NODATA };
+    enum { STATUS_HTTPFAIL=2, STATUS_DISCONNECTED, STATUS_RECONNECTING, STATUS_RECONNECTED, STATUS_NODATA, STATUS_CHUNKERR };
 
   private:
     virtual uint32_t readInternal(void *data, uint32_t len, bool nonBlock);
+    virtual int readPayload(uint8_t *dest, int len) { return readBody(dest, len); }
+    bool canReuse(const char *url);
+    static bool sameHost(const char *a, const char *b);
+    void beginBody();
+    bool bodyDone();
+    int readBody(uint8_t *dest, int len);
     WiFiClient client;
     HTTPClient http;
     int pos;
@@ -60,6 +69,13 @@ class AudioFileSourceHTTPStream : public AudioFileSource
     int reconnectTries;
     int reconnectDelayMs;
     char saveURL[128];
+
+    // Incremental Transfer-Encoding: chunked decoder state
+    enum { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_DATA_END, CHUNK_TRAILER, CHUNK_DONE };
+    bool chunked;
+    uint8_t chunkState;
+    uint32_t chunkLeft;
+    int chunkLineLen;
 };
 
 
@@ -20,11 +20,6 @@
 
 #if defined(ESP32) || defined(ESP8266)
 
-#ifdef _GNU_SOURCE
-#undef _GNU_SOURCE
-#endif
-#define _GNU_SOURCE
-
 #include "AudioFileSourceICYStream.h"
 #include <string.h>
 
@@ -44,16 +39,17 @@ AudioFileSourceICYStream::AudioFileSourceICYStream(const char *url)
 
 bool AudioFileSourceICYStream::open(const char *url)
 {
-  static const char *hdr[] = { "icy-metaint", "icy-name", "icy-genre", "icy-br" };
+  static const char *hdr[] = { "icy-metaint", "icy-name", "icy-genre", "icy-br", "Transfer-Encoding" };
   pos = 0;
   http.begin(client, url);
   http.addHeader("Icy-MetaData", "1");
-  http.collectHeaders( hdr, 4 );
+  http.collectHeaders( hdr, 5 );
   http.setReuse(true);
   http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
   int code = http.GET();
   if (code != HTTP_CODE_OK) {
     http.end();
+    client.stop();
     cb.st(STATUS_HTTPFAIL, PSTR("Can't open HTTP request"));
     return false;
   }
@@ -77,7 +73,8 @@ bool AudioFileSourceICYStream::open(const char *url)
   }
 
   icyByteCount = 0;
-  size = http.getSize();
+  icyState = ICY_AUDIO;
+  beginBody();
   strncpy(saveURL, url, sizeof(saveURL));
   saveURL[sizeof(saveURL)-1] = 0;
   return true;
@@ -88,139 +85,105 @@ AudioFileSourceICYStream::~AudioFileSourceICYStream()
   http.end();
 }
 
-uint32_t AudioFileSourceICYStream::readInternal(void *data, uint32_t len, bool nonBlock)
+// Split the incoming stream into audio and metadata.  Audio goes straight into dest, metadata
+// bytes are fed one at a time into the parser.  When the socket runs dry we simply return what
+// we have; the state machine resumes at the same byte on the next call.
+int AudioFileSourceICYStream::readPayload(uint8_t *dest, int len)
 {
-  // Ensure we can't possibly read 2 ICY headers in a single go #355
-  if (icyMetaInt > 1) {
-    len = std::min((int)(icyMetaInt >> 1), (int)len);
-  }
-retry:
-  if (!http.connected()) {
-    cb.st(STATUS_DISCONNECTED, PSTR("Stream disconnected"));
-    http.end();
-    for (int i = 0; i < reconnectTries; i++) {
-      char buff[64];
-      sprintf_P(buff, PSTR("Attempting to reconnect, try %d"), i);
-      cb.st(STATUS_RECONNECTING, buff);
-      delay(reconnectDelayMs);
-      if (open(saveURL)) {
-        cb.st(STATUS_RECONNECTED, PSTR("Stream reconnected"));
-        break;
+  if (icyMetaInt <= 0) return readBody(dest, len);
+
+  int got = 0;
+  while (got < len) {
+    if (icyState == ICY_AUDIO) {
+      int ret = readBody(dest + got, std::min(len - got, icyMetaInt - icyByteCount));
+      if (ret <= 0) break;
+      got += ret;
+      icyByteCount += ret;
+      if (icyByteCount == icyMetaInt) icyState = ICY_LENGTH;
+    } else if (icyState == ICY_LENGTH) {
+      uint8_t c;
+      if (readBody(&c, 1) != 1) break;
+      icyMetaLeft = c * 16;
+      icyByteCount = 0;
+      icyState = icyMetaLeft ? ICY_META : ICY_AUDIO;
+      mdState = MD_KEY;
+      mdKeyLen = 0;
+    } else {
+      uint8_t buff[32];
+      int ret = readBody(buff, std::min(icyMetaLeft, (int)sizeof(buff)));
+      if (ret <= 0) break;
+      for (int i = 0; i < ret; i++) parseMetaByte(buff[i]);
+      icyMetaLeft -= ret;
+      if (!icyMetaLeft) {
+        // Unterminated last value, report what we have
+        if ((mdState == MD_VALUE) || (mdState == MD_VALUE_QUOTE)) emitMeta();
+        icyState = ICY_AUDIO;
       }
     }
-    if (!http.connected()) {
-      cb.st(STATUS_DISCONNECTED, PSTR("Unable to reconnect"));
-      return 0;
-    }
-  }
-  if ((size > 0) && (pos >= size)) return 0;
-
-  WiFiClient *stream = http.getStreamPtr();
-
-  // Can't read past EOF...
-  if ( (size > 0) && (len > (uint32_t)(pos - size)) ) len = pos - size;
-
-  if (!nonBlock) {
-    int start = millis();
-    while ((stream->available() < (int)len) && (millis() - start < 500)) yield();
-  }
-
-  size_t avail = stream->available();
-  if (!nonBlock && !avail) {
-    cb.st(STATUS_NODATA, PSTR("No stream data available"));
-    http.end();
-    goto retry;
   }
-  if (avail == 0) return 0;
-  if (avail < len) len = avail;
-
-  int read = 0;
-  int ret = 0;
-  // If the read would hit an ICY block, split it up...
-  if (((int)(icyByteCount + len) > (int)icyMetaInt) && (icyMetaInt > 0)) {
-    int beforeIcy = icyMetaInt - icyByteCount;
-    if (beforeIcy > 0) {
-      ret = stream->read(reinterpret_cast<uint8_t*>(data), beforeIcy);
-      if (ret < 0) ret = 0;
-      read += ret;
-      pos += ret;
-      len -= ret;
-      data = (void *)(reinterpret_cast<char*>(data) + ret);
-      icyByteCount += ret;
-      if (ret != beforeIcy) return read; // Partial read
-    }
+  return got;
+}
 
-    // ICY MD handling
-    int mdSize;
-    uint8_t c;
-    int mdret = stream->read(&c, 1);
-    if (mdret==0) return read;
-    mdSize = c * 16;
-    if ((mdret == 1) && (mdSize > 0)) {
-      // This is going to get ugly fast.
-      char icyBuff[256 + 16 + 1];
-      char *readInto = icyBuff + 16;
-      memset(icyBuff, 0, 16); // Ensure no residual matches occur
-      while (mdSize) {
-        int toRead = mdSize > 256 ? 256 : mdSize;
-        int ret = stream->read((uint8_t*)readInto, toRead);
-        if (ret < 0) return read;
-        if (ret == 0) { delay(1); continue; }
-        mdSize -= ret;
-        // At this point we have 0...15 = last 15 chars read from prior read plus new data
-        int end = 16 + ret; // The last byte of valid data
-        char *header = (char *)memmem((void*)icyBuff, end, (void*)"StreamTitle=", 12);
-        if (!header) {
-          // No match, so move the last 16 bytes back to the start and continue
-          memmove(icyBuff, icyBuff+end-16, 16);
-          delay(1);
-	  continue;
-        }
-        // Found header, now move it to the front
-        int lastValidByte = end - (header -icyBuff) + 1;
-        memmove(icyBuff, header, lastValidByte);
-        // Now fill the buffer to the end with read data
-        while (mdSize && lastValidByte < 255) {
-          int toRead = mdSize > (256 - lastValidByte) ? (256 - lastValidByte) : mdSize;
-          ret = stream->read((uint8_t*)icyBuff + lastValidByte, toRead);
-          if (ret==-1) return read; // error
-          if (ret == 0) { delay(1); continue; }
-          mdSize -= ret;
-          lastValidByte += ret;
+// Metadata looks like StreamTitle='Artist - It's a title';StreamUrl='';  padded with NULs.
+// Quoted values end at quote+semicolon so embedded apostrophes survive.
+void AudioFileSourceICYStream::parseMetaByte(char c)
+{
+  switch (mdState) {
+    case MD_KEY:
+      if (c == '=') {
+        mdKey[std::min((int)mdKeyLen, (int)sizeof(mdKey) - 1)] = 0;
+        mdWanted = (mdKeyLen < sizeof(mdKey)) && (!strcmp(mdKey, "StreamTitle") || !strcmp(mdKey, "StreamUrl"));
+        mdValueLen = 0;
+        mdState = MD_VALUE_START;
+      } else if (c == 0) {
+        mdState = MD_END;
+      } else {
+        if (mdKeyLen < sizeof(mdKey) - 1) mdKey[mdKeyLen] = c;
+        if (mdKeyLen < sizeof(mdKey)) mdKeyLen++;
+      }
+      break;
+    case MD_VALUE_START:
+      mdState = MD_VALUE;
+      if ((c == '\'') || (c == '"')) {
+        mdQuote = c;
+        break;
+      }
+      mdQuote = 0;
+      parseMetaByte(c);
+      break;
+    case MD_VALUE:
+    case MD_VALUE_QUOTE:
+      if (c == 0) {
+        emitMeta();
+        mdState = MD_END;
+      } else if ((c == ';') && (!mdQuote || (mdState == MD_VALUE_QUOTE))) {
+        emitMeta();
+        mdKeyLen = 0;
+        mdState = MD_KEY;
+      } else {
+        // A quote not followed by ';' was part of the value
+        if (mdState == MD_VALUE_QUOTE) {
+          if (mdValueLen < (int)sizeof(mdValue) - 1) mdValue[mdValueLen++] = mdQuote;
         }
-        // Buffer now contains StreamTitle=....., parse it
-        char *p = icyBuff+12;
-        if (*p=='\'' || *p== '"' ) {
-          char closing[] = { *p, ';', '\0' };
-          char *psz = strstr( p+1, closing );
-          if( !psz ) psz = strchr( &icyBuff[13], ';' );
-          if( psz ) *psz = '\0';
-          p++;
+        if (mdQuote && (c == mdQuote)) {
+          mdState = MD_VALUE_QUOTE;
         } else {
-          char *psz = strchr( p, ';' );
-          if( psz ) *psz = '\0';
-        }
-        cb.md("StreamTitle", false, p);
-
-        // Now skip rest of MD block
-        while (mdSize) {
-          int toRead = mdSize > 256 ? 256 : mdSize;
-          ret = stream->read((uint8_t*)icyBuff, toRead);
-          if (ret < 0) return read;
-          if (ret == 0) { delay(1); continue; }
-          mdSize -= ret;
+          if (mdValueLen < (int)sizeof(mdValue) - 1) mdValue[mdValueLen++] = c;
+          mdState = MD_VALUE;
         }
       }
-    }
-    icyByteCount = 0;
+      break;
+    default:
+      break;
   }
+}
 
-  ret = stream->read(reinterpret_cast<uint8_t*>(data), len);
-  if (ret < 0) ret = 0;
-  read += ret;
-  pos += ret;
-  icyByteCount += ret;
-  return read;
+void AudioFileSourceICYStream::emitMeta()
+{
+  if (!mdWanted) return;
+  mdValue[mdValueLen] = 0;
+  cb.md(mdKey, false, mdValue);
+  mdWanted = false;
 }
 
 #endif
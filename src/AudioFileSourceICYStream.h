@@ -40,9 +40,26 @@ class AudioFileSourceICYStream : public AudioFileSourceHTTPStream
     virtual bool open(const char *url) override;
 
   private:
-    virtual uint32_t readInternal(void *data, uint32_t len, bool nonBlock) override;
+    virtual int readPayload(uint8_t *dest, int len) override;
+    void parseMetaByte(char c);
+    void emitMeta();
     int icyMetaInt;
     int icyByteCount;
+
+    // Position in the audio/metadata interleave, kept across reads so any read size works
+    enum { ICY_AUDIO, ICY_LENGTH, ICY_META };
+    uint8_t icyState;
+    int icyMetaLeft;
+
+    // Incremental key='value'; parser for the metadata block
+    enum { MD_KEY, MD_VALUE_START, MD_VALUE, MD_VALUE_QUOTE, MD_END };
+    uint8_t mdState;
+    char mdQuote;
+    char mdKey[12];
+    uint8_t mdKeyLen;
+    bool mdWanted;
+    char mdValue[256];
+    int mdValueLen;
 };
 
 #endif
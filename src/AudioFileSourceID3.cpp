@@ -24,26 +24,33 @@
 class AudioFileSourceUnsync : public AudioFileSource
 {
   public:
-    AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync);
+    AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync, uint32_t start, bool canSeek);
     virtual ~AudioFileSourceUnsync() override;
     virtual uint32_t read(void *data, uint32_t len) override;
 
     int getByte();
+    void skip(int len);
     bool eof();
 
   private:
     AudioFileSource *src;
+    int size;
     int remaining;
     bool unsync;
     int savedByte;
+    uint32_t start;
+    bool canSeek;
 };
 
-AudioFileSourceUnsync::AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync)
+AudioFileSourceUnsync::AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync, uint32_t start, bool canSeek)
 {
   this->src = src;
+  this->size = len;
   this->remaining = len;
   this->unsync = unsync;
   this->savedByte = -1;
+  this->start = start;
+  this->canSeek = canSeek;
 }
 
 AudioFileSourceUnsync::~AudioFileSourceUnsync()
@@ -109,6 +116,26 @@ int AudioFileSourceUnsync::getByte()
   }
 }
 
+// Throw away len bytes.  When the data isn't unsync'd the byte count is exact, so jump over
+// it with a single seek if possible, or large block reads if not.
+void AudioFileSourceUnsync::skip(int len)
+{
+  if (unsync) {
+    while ((len-- > 0) && !eof()) getByte();
+    return;
+  }
+  if (len > remaining) len = remaining;
+  if (len <= 0) return;
+  remaining -= len;
+  if (canSeek && src->seek(start + size - remaining, SEEK_SET)) return;
+  uint8_t buff[128];
+  while (len > 0) {
+    int ret = src->read(buff, (len < (int)sizeof(buff)) ? len : sizeof(buff));
+    if (ret <= 0) break;
+    len -= ret;
+  }
+}
+
 bool AudioFileSourceUnsync::eof()
 {
   if (remaining<=0) return true;
@@ -116,40 +143,134 @@ bool AudioFileSourceUnsync::eof()
 }
 
 
+// Map an ID3 frame ID to the name passed to the metadata CB, or NULL if we don't report it
+static const char *FrameName(const unsigned char *frameid, int rev)
+{
+  if ( (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && frameid[3] == 'B' ) ||
+       (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && rev==2) ) {
+    return "Album";
+  } else if ( (frameid[0]=='T' && frameid[1]=='I' && frameid[2]=='T' && frameid[3] == '2') ||
+              (frameid[0]=='T' && frameid[1]=='T' && frameid[2]=='2' && rev==2) ) {
+    return "Title";
+  } else if ( (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='E' && frameid[3] == '1') ||
+              (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='1' && rev==2) ) {
+    return "Performer";
+  } else if ( (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && frameid[3] == 'R') ||
+              (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && rev==2) ) {
+    return "Year";
+  } else if ( (frameid[0]=='T' && frameid[1]=='R' && frameid[2]=='C' && frameid[3] == 'K') ||
+              (frameid[0]=='T' && frameid[1]=='R' && frameid[2]=='K' && rev==2) ) {
+    return "track";
+  } else if ( (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='O' && frameid[3] == 'S') ||
+              (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='A' && rev==2) ) {
+    return "Set";
+  } else if ( (frameid[0]=='P' && frameid[1]=='O' && frameid[2]=='P' && frameid[3] == 'M') ||
+              (frameid[0]=='P' && frameid[1]=='O' && frameid[2]=='P' && rev==2) ) {
+    return "Popularimeter";
+  } else if ( (frameid[0]=='T' && frameid[1]=='C' && frameid[2]=='M' && frameid[3] == 'P') ) {
+    return "Compilation";
+  }
+  return NULL;
+}
+
+
+// Read a text frame's value and send it to the metadata callback, the rest of a long value is
+// skipped.  Kept out of AudioFileSourceID3::read() so its buffer isn't on that stack frame too.
+static void __attribute__((noinline)) ReadText(AudioFileSourceUnsync *id3, int framesize, bool unsync, AudioStatus *cb, const char *name)
+{
+  char value[64];
+  uint32_t i = 0;
+  bool isUnicode = (id3->getByte()==1) ? true : false;
+  framesize--;
+  int last = -1;
+  while ((framesize > 0) && (i < sizeof(value)-1)) {
+    int c = id3->getByte();
+    framesize--;
+    if (unsync && (last == 0xff) && (c == 0)) {
+      last = -1;
+      continue;
+    }
+    value[i++] = c;
+    last = c;
+  }
+  value[i] = 0; // Terminate the string...
+  id3->skip(framesize);
+  cb->md(name, isUnicode, value);
+}
 
 AudioFileSourceID3::AudioFileSourceID3(AudioFileSource *src)
 {
   this->src = src;
   this->checked = false;
+  this->canSeek = false;
+  this->readPos = 0;
+  this->audioEnd = 0;
 }
 
 AudioFileSourceID3::~AudioFileSourceID3()
 {
 }
 
+// Look for ID3v1 and APEv2 tags at the end of the file so reads can stop at the last audio
+// byte and decoders don't try to find frames in them.  Also tells us if seeking works at all.
+void AudioFileSourceID3::checkTail()
+{
+  readPos = src->getReadPos();
+  uint32_t size = src->getSize();
+  if ((size < 128 + 32) || (size == 0xffffffff)) return; // Stream or too small to bother
+  if (!src->seek(size - 128, SEEK_SET)) return;
+  canSeek = true;
+
+  uint32_t end = size;
+  uint8_t buff[128];
+  if ((src->read(buff, 128) == 128) && (buff[0]=='T') && (buff[1]=='A') && (buff[2]=='G')) {
+    end -= 128;
+  }
+  if (src->seek(end - 32, SEEK_SET) && (src->read(buff, 32) == 32) && !memcmp(buff, "APETAGEX", 8)) {
+    uint32_t apeSize = buff[12] | (buff[13] << 8) | (buff[14] << 16) | (buff[15] << 24); // Items + footer
+    if (buff[23] & 0x80) apeSize += 32; // Header present
+    if (apeSize < end) end -= apeSize;
+  }
+  if (end != size) audioEnd = end;
+  src->seek(readPos, SEEK_SET);
+}
+
+uint32_t AudioFileSourceID3::readAudio(void *data, uint32_t len)
+{
+  if (audioEnd) {
+    if (readPos >= audioEnd) return 0;
+    if (len > audioEnd - readPos) len = audioEnd - readPos;
+  }
+  uint32_t ret = src->read(data, len);
+  readPos += ret;
+  return ret;
+}
+
 uint32_t AudioFileSourceID3::read(void *data, uint32_t len)
 {
   int rev = 0;
 
   if (checked) {
-    return src->read(data, len);
+    return readAudio(data, len);
   }
   checked = true;
+  checkTail();
   // <10 bytes initial read, not enough space to check header
-  if (len<10) return src->read(data, len);
+  if (len<10) return readAudio(data, len);
 
   uint8_t *buff = reinterpret_cast<uint8_t*>(data);
-  int ret = src->read(data, 10);
+  int ret = readAudio(data, 10);
   if (ret<10) return ret;
 
   if ((buff[0]!='I') || (buff[1]!='D') || (buff[2]!='3') || (buff[3]>0x04) || (buff[3]<0x02) || (buff[4]!=0)) {
     cb.md("eof", false, "id3");
-    return 10 + src->read(buff+10, len-10);
+    return 10 + readAudio(buff+10, len-10);
   }
 
   rev = buff[3];
   bool unsync = false;
   bool exthdr = false;
+  bool footer = false;
 
   switch(rev) {
     case 2:
@@ -160,6 +281,7 @@ uint32_t AudioFileSourceID3::read(void *data, uint32_t len)
     case 4:
       unsync = (buff[5] & 0x80);
       exthdr = (buff[5] & 0x40);
+      footer = (rev == 4) && (buff[5] & 0x10);
       break;
   };
 
@@ -170,18 +292,35 @@ uint32_t AudioFileSourceID3::read(void *data, uint32_t len)
   id3Size |= buff[8];
   id3Size = id3Size << 7;
   id3Size |= buff[9];
+  if (footer) id3Size += 10;
+
+  // v2.4 unsyncs each frame (with frame sizes counting the raw bytes), earlier ones the whole tag
+  bool frameUnsync = unsync && (rev == 4);
+  // Nobody's listening, so the whole tag is jumped over as it is
+  bool skipTag = !cb.HasMetadataCB();
   // Every read from now may be unsync'd
-  AudioFileSourceUnsync id3(src, id3Size, unsync);
+  AudioFileSourceUnsync id3(src, id3Size, unsync && !frameUnsync && !skipTag, readPos, canSeek);
+
+  if (skipTag) {
+    id3.skip(id3Size);
+    readPos += id3Size;
+    return readAudio(data, len);
+  }
 
   if (exthdr) {
     int ehsz = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-    for (int j=0; j<ehsz-4; j++) id3.getByte(); // Throw it away
+    if (rev == 4) {
+      ehsz = ((ehsz >> 3) & 0x0fe00000) | ((ehsz >> 2) & 0x001fc000) | ((ehsz >> 1) & 0x00003f80) | (ehsz & 0x7f);
+      ehsz -= 4; // v2.4 size includes the size field itself
+    }
+    id3.skip(ehsz); // Throw it away
   }
 
   do {
     unsigned char frameid[4];
     int framesize;
-    bool compressed;
+    bool skipFrame = false;
+    bool thisUnsync = frameUnsync;
 
     frameid[0] = id3.getByte();
     frameid[1] = id3.getByte();
@@ -191,72 +330,58 @@ uint32_t AudioFileSourceID3::read(void *data, uint32_t len)
 
     if (frameid[0]==0 && frameid[1]==0 && frameid[2]==0 && frameid[3]==0) {
       // We're in padding
-      while (!id3.eof()) {
-        id3.getByte();
-      }
+      id3.skip(id3Size);
     } else {
       if (rev==2) {
         framesize = (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-        compressed = false;
       } else {
         framesize = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
+        if (rev == 4) { // Syncsafe integer
+          framesize = ((framesize >> 3) & 0x0fe00000) | ((framesize >> 2) & 0x001fc000) | ((framesize >> 1) & 0x00003f80) | (framesize & 0x7f);
+        }
         id3.getByte(); // skip 1st flag
-        compressed = id3.getByte()&0x80;
-      }
-      if (compressed) {
-        int decompsize = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-        // TODO - add libz decompression, for now ignore this one...
-        (void)decompsize;
-        for (int j=0; j<framesize; j++)
-          id3.getByte();
+        int flags = id3.getByte();
+        int extra = 0;
+        if (rev == 3) {
+          skipFrame = flags & 0xc0; // Compressed or encrypted, TODO - add libz decompression
+          if (flags & 0x20) extra++; // Grouping ID
+        } else {
+          skipFrame = flags & 0x0c; // Compressed or encrypted
+          if (flags & 0x40) extra++; // Grouping ID
+          if (flags & 0x01) extra += 4; // Data length indicator
+          thisUnsync = thisUnsync || (flags & 0x02);
+        }
+        if (!skipFrame) {
+          id3.skip(extra);
+          framesize -= extra;
+        }
       }
 
-      // Read the value and send to callback
-      char value[64];
-      uint32_t i;
-      bool isUnicode = (id3.getByte()==1) ? true : false;
-      for (i=0; i<(uint32_t)framesize-1; i++) {
-        if (i<sizeof(value)-1) value[i] = id3.getByte();
-        else (void)id3.getByte();
-      }
-      value[i<sizeof(value)-1?i:sizeof(value)-1] = 0; // Terminate the string...
-      if ( (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && frameid[3] == 'B' ) ||
-           (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && rev==2) ) {
-        cb.md("Album", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='I' && frameid[2]=='T' && frameid[3] == '2') ||
-                  (frameid[0]=='T' && frameid[1]=='T' && frameid[2]=='2' && rev==2) ) {
-        cb.md("Title", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='E' && frameid[3] == '1') ||
-                  (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='1' && rev==2) ) {
-        cb.md("Performer", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && frameid[3] == 'R') ||
-                  (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && rev==2) ) {
-        cb.md("Year", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='R' && frameid[2]=='C' && frameid[3] == 'K') ||
-                  (frameid[0]=='T' && frameid[1]=='R' && frameid[2]=='K' && rev==2) ) {
-        cb.md("track", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='O' && frameid[3] == 'S') ||
-                  (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='A' && rev==2) ) {
-        cb.md("Set", isUnicode, value);
-      } else if ( (frameid[0]=='P' && frameid[1]=='O' && frameid[2]=='P' && frameid[3] == 'M') ||
-                  (frameid[0]=='P' && frameid[1]=='O' && frameid[2]=='P' && rev==2) ) {
-        cb.md("Popularimeter", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='C' && frameid[2]=='M' && frameid[3] == 'P') ) {
-        cb.md("Compilation", isUnicode, value);
+      const char *name = FrameName(frameid, rev);
+      if (!name || skipFrame || (framesize < 1)) {
+        // Cover art and friends, don't even look at them
+        id3.skip(framesize);
+      } else {
+        ReadText(&id3, framesize, thisUnsync, &cb, name);
       }
     }
   } while (!id3.eof());
+  readPos += id3Size;
 
   // use callback function to signal end of tags and beginning of content.
   cb.md("eof", false, "id3");
 
   // All ID3 processing done, return to main caller
-  return src->read(data, len);
+  return readAudio(data, len);
 }
 
 bool AudioFileSourceID3::seek(int32_t pos, int dir)
 {
-  return src->seek(pos, dir);
+  if (!src->seek(pos, dir)) return false;
+  if (dir == SEEK_SET) readPos = pos;
+  else if (dir == SEEK_CUR) readPos += pos;
+  else readPos = src->getReadPos();
+  return true;
 }
 
 bool AudioFileSourceID3::close()
@@ -271,10 +396,18 @@ bool AudioFileSourceID3::isOpen()
 
 uint32_t AudioFileSourceID3::getSize()
 {
+  if (audioEnd) return audioEnd;
   return src->getSize();
 }
 
 uint32_t AudioFileSourceID3::getPos()
 {
-  return src->getPos();
+  if (!checked) return src->getPos();
+  return readPos;
+}
+
+uint32_t AudioFileSourceID3::getReadPos()
+{
+  if (!checked) return src->getReadPos();
+  return readPos;
 }
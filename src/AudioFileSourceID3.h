@@ -37,10 +37,18 @@ class AudioFileSourceID3 : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override;
+    virtual uint32_t getReadPos() override;
+
+  private:
+    void checkTail();
+    uint32_t readAudio(void *data, uint32_t len);
 
   private:
     AudioFileSource *src;
     bool checked;
+    bool canSeek;       // Underlying source accepted an absolute seek
+    uint32_t readPos;   // Our own idea of the position, buffered sources report read-ahead
+    uint32_t audioEnd;  // Start of any trailing ID3v1/APEv2 tag, 0 if unknown
 };
 
 
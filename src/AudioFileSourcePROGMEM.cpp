@@ -96,4 +96,13 @@ uint32_t AudioFileSourcePROGMEM::read(void *data, uint32_t len)
   return toRead;
 }
 
+const void *AudioFileSourcePROGMEM::readMapped(uint32_t len)
+{
+  if (!opened) return NULL;
+  if ((filePointer > progmemLen) || (len > progmemLen - filePointer)) return NULL;
+  const void *p = reinterpret_cast<const uint8_t*>(progmemData) + filePointer;
+  filePointer += len;
+  return p;
+}
+
 
@@ -22,7 +22,19 @@
 
 #include "AudioGeneratorAAC.h"
 
-AudioGeneratorAAC::AudioGeneratorAAC()
+// Length of the ADTS frame whose header is at hdr, 0 if it is no valid header
+static int ADTSFrameBytes(const uint8_t *hdr)
+{
+  if ((hdr[0] != 0xff) || ((hdr[1] & 0xf6) != 0xf0)) return 0; // Sync, layer 0
+  if (((hdr[2] >> 2) & 0x0f) >= 12) return 0; // Sample rate index
+  int len = ((hdr[3] & 0x03) << 11) | (hdr[4] << 3) | (hdr[5] >> 5);
+  return (len >= ((hdr[1] & 1) ? 7 : 9)) ? len : 0;
+}
+
+// ID, protection, profile, sample rate and channel configuration stay put for the whole stream
+static const uint8_t adtsFixedMask[7] = { 0xff, 0xff, 0xfd, 0xc0, 0x00, 0x00, 0x00 };
+
+AudioGeneratorAAC::AudioGeneratorAAC() : reader(ringLen, maxFrameLen, 7, adtsFixedMask, ADTSFrameBytes)
 {
   preallocateSpace = NULL;
   preallocateSize = 0;
@@ -31,8 +43,8 @@ AudioGeneratorAAC::AudioGeneratorAAC()
   file = NULL;
   output = NULL;
 
-  buff = (uint8_t*)malloc(buffLen);
-  outSample = (int16_t*)malloc(1024 * 2 * sizeof(uint16_t));
+  buff = (uint8_t*)malloc(reader.BufferSize());
+  outSample = (int16_t*)malloc(outSampleLen * sizeof(int16_t));
   if (!buff || !outSample) {
     audioLogger->printf_P(PSTR("ERROR: Out of memory in AAC\n"));
     Serial.flush();
@@ -44,15 +56,19 @@ AudioGeneratorAAC::AudioGeneratorAAC()
     Serial.flush();
   }
 
-  buffValid = 0;
-  lastFrameEnd = 0;
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  isMP4 = false;
+  sbrMode = SBR_ON;
+  sbrThreshold = 25;
+  sbrBypassed = false;
+  sbrStream = false;
+  sbrRoom = true;
 }
 
-AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz)
+AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz) : reader(ringLen, maxFrameLen, 7, adtsFixedMask, ADTSFrameBytes)
 {
   preallocateSpace = preallocateData;
   preallocateSize = preallocateSz;
@@ -63,9 +79,10 @@ AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz)
 
   uint8_t *p = (uint8_t*)preallocateSpace;
   buff = (uint8_t*) p;
-  p += (buffLen + 7) & ~7;
+  p += preAllocBuffSize();
   outSample = (int16_t*) p;
-  p += (1024 * 2 * sizeof(int16_t) + 7) & ~7;
+  sbrRoom = (preallocateSize >= preAllocSize(true));
+  p += preAllocOutSize(sbrRoom);
   int used = p - (uint8_t*)preallocateSpace;
   int availSpace = preallocateSize - used;
   if (availSpace < 0 ) {
@@ -77,12 +94,15 @@ AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz)
     audioLogger->printf_P(PSTR("Out of memory error! hAACDecoder==NULL\n"));
     Serial.flush();
   }
-  buffValid = 0;
-  lastFrameEnd = 0;
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  isMP4 = false;
+  sbrMode = SBR_ON;
+  sbrThreshold = 25;
+  sbrBypassed = false;
+  sbrStream = false;
 }
 
 
@@ -99,6 +119,7 @@ AudioGeneratorAAC::~AudioGeneratorAAC()
 bool AudioGeneratorAAC::stop()
 {
   running = false;
+  mp4.End();
   output->stop();
   return file->close();
 }
@@ -108,36 +129,67 @@ bool AudioGeneratorAAC::isRunning()
   return running;
 }
 
-bool AudioGeneratorAAC::FillBufferWithValidFrame()
+bool AudioGeneratorAAC::SetSBRMode(int mode, int thresholdPercent)
 {
-  buff[0] = 0; // Destroy any existing sync word @ 0
-  int nextSync;
-  do {
-    nextSync = AACFindSyncWord(buff + lastFrameEnd, buffValid - lastFrameEnd);
-    if (nextSync >= 0) nextSync += lastFrameEnd;
-    lastFrameEnd = 0;
-    if (nextSync == -1) {
-      if (buffValid && buff[buffValid-1]==0xff) { // Could be 1st half of syncword, preserve it...
-        buff[0] = 0xff;
-        buffValid = file->read(buff+1, buffLen-1);
-        if (buffValid==0) return false; // No data available, EOF
-      } else { // Try a whole new buffer
-        buffValid = file->read(buff, buffLen-1);
-        if (buffValid==0) return false; // No data available, EOF
-      }
-    }
-  } while (nextSync == -1);
+  if ((mode < SBR_ON) || (mode > SBR_AUTO) || (thresholdPercent < 0) || (thresholdPercent > 100)) return false;
+  if (!sbrRoom && (mode != SBR_OFF)) return false; // Preallocated too little to ever run SBR
+  sbrMode = mode;
+  sbrThreshold = thresholdPercent;
+  return true;
+}
 
-  // Move the frame to start at offset 0 in the buffer
-  buffValid -= nextSync; // Throw out prior to nextSync
-  memmove(buff, buff+nextSync, buffValid);
+uint32_t AudioGeneratorAAC::GetDurationMs()
+{
+  return isMP4 ? mp4.DurationMs() : 0;
+}
 
-  // We have a sync word at 0 now, try and fill remainder of buffer
-  buffValid += file->read(buff + buffValid, buffLen - buffValid);
+uint32_t AudioGeneratorAAC::GetPositionMs()
+{
+  return isMP4 ? mp4.PositionMs() : 0;
+}
 
+bool AudioGeneratorAAC::SeekMs(uint32_t ms)
+{
+  if (!running || !isMP4 || !mp4.SeekMs(ms)) return false;
+  validSamples = 0;
+  curSample = 0;
+  AACFlushCodec(hAACDecoder);
   return true;
 }
 
+// Pick SBR or not for the coming frame
+void AudioGeneratorAAC::UpdateSBRBypass()
+{
+  bool bypass;
+  if (sbrMode == SBR_AUTO) {
+    int fill = output->FillPercent();
+    if (fill < 0) return; // Can't tell, leave things be
+    // Only bring SBR back once the output has recovered well past the threshold, or it would flap
+    bypass = sbrBypassed ? (fill < (sbrThreshold + 100) / 2) : (fill < sbrThreshold);
+  } else {
+    bypass = (sbrMode == SBR_OFF) || !sbrRoom;
+  }
+  if (bypass != sbrBypassed) {
+    sbrBypassed = bypass;
+    AACSetSBRBypass(hAACDecoder, bypass);
+  }
+}
+
+// Double the core-rate samples in outSample in place, interpolating the new ones
+void AudioGeneratorAAC::Upsample(int samples, int ch)
+{
+  for (int c = 0; c < ch; c++) {
+    // Back to front, so nothing is overwritten before it has been read
+    int16_t next = outSample[(samples - 1) * ch + c];
+    for (int i = samples - 1; i >= 0; i--) {
+      int16_t cur = outSample[i * ch + c];
+      outSample[(2 * i) * ch + c] = cur;
+      outSample[(2 * i + 1) * ch + c] = (cur + next) >> 1;
+      next = cur;
+    }
+  }
+}
+
 bool AudioGeneratorAAC::loop()
 {
   if (!running) goto done; // Nothing to do here!
@@ -157,30 +209,50 @@ bool AudioGeneratorAAC::loop()
   }
 
   // No samples available, need to decode a new frame
-  if (FillBufferWithValidFrame()) {
-    // buff[0] start of frame, decode it...
-    unsigned char *inBuff = reinterpret_cast<unsigned char *>(buff);
-    int bytesLeft = buffValid;
+  uint8_t *frame;
+  int frameLen;
+  if (isMP4 ? mp4.NextSample(buff, AAC_MAINBUF_SIZE, &frameLen) : reader.NextFrame(&frame, &frameLen)) {
+    if (isMP4) {
+      if (!frameLen) goto done; // Oversized access unit, can't be valid
+      frame = buff;
+    }
+    UpdateSBRBypass();
+
+    // frame is the whole frame, in place, decode it...
+    unsigned char *inBuff = frame;
+    int bytesLeft = frameLen;
     int ret = AACDecode(hAACDecoder, &inBuff, &bytesLeft, outSample);
+    if (!isMP4) {
+      int used = frameLen - bytesLeft;
+      reader.Consume(used ? used : 1); // On errors at least step off this sync so the next one is found
+    }
     if (ret) {
       // Error, skip the frame...
       char buff[48];
       sprintf_P(buff, PSTR("AAC decode error %d"), ret);
       cb.st(ret, buff);
     } else {
-      lastFrameEnd = buffValid - bytesLeft;
       AACFrameInfo fi;
       AACGetLastFrameInfo(hAACDecoder, &fi);
-      if ((int)fi.sampRateOut != (int)lastRate) {
-        output->SetRate(fi.sampRateOut);
-        lastRate = fi.sampRateOut;
+      if (fi.sampRateOut != fi.sampRateCore) sbrStream = true;
+      int rate = fi.sampRateOut;
+      int samples = fi.outputSamps / fi.nChans;
+      if (sbrBypassed && sbrStream && (sbrMode == SBR_AUTO)) {
+        // Keep playing at the SBR rate, a rate change would also replay whatever the output buffered
+        rate = fi.sampRateCore * 2;
+        Upsample(samples, fi.nChans);
+        samples *= 2;
+      }
+      if (rate != (int)lastRate) {
+        output->SetRate(rate);
+        lastRate = rate;
       }
       if (fi.nChans != lastChannels) {
         output->SetChannels(fi.nChans);
         lastChannels = fi.nChans;
       }
       curSample = 0;
-      validSamples = fi.outputSamps / lastChannels;
+      validSamples = samples;
     }
   } else {
     running = false; // No more data, we're done here...
@@ -207,8 +279,38 @@ bool AudioGeneratorAAC::begin(AudioFileSource *source, AudioOutput *output)
   output->SetBitsPerSample(16);
  
 
-  memset(buff, 0, buffLen);
-  memset(outSample, 0, 1024*2*sizeof(int16_t));
+  memset(buff, 0, reader.BufferSize());
+
+  // An MP4 file starts with its ftyp box, anything else is taken for ADTS
+  uint8_t head[8];
+  int headLen = 0;
+  while (headLen < (int)sizeof(head)) {
+    uint32_t got = file->read(head + headLen, sizeof(head) - headLen);
+    if (!got) break;
+    headLen += got;
+  }
+  isMP4 = (headLen == (int)sizeof(head)) && MP4Demuxer::IsMP4(head);
+  if (isMP4) {
+    if (!mp4.Begin(file, buff + AAC_MAINBUF_SIZE, reader.BufferSize() - AAC_MAINBUF_SIZE, head)) {
+      audioLogger->printf_P(PSTR("ERROR: No playable AAC track in MP4\n"));
+      return false;
+    }
+    AACFrameInfo fi;
+    memset(&fi, 0, sizeof(fi));
+    fi.nChans = mp4.Channels();
+    fi.sampRateCore = mp4.SampleRate();
+    fi.profile = mp4.Profile();
+    if (AACSetRawBlockParams(hAACDecoder, 0, &fi)) {
+      audioLogger->printf_P(PSTR("ERROR: Unsupported MP4 audio, only AAC-LC and HE-AAC can be played\n"));
+      return false;
+    }
+  } else {
+    reader.Begin(file, buff, head, headLen);
+  }
+  memset(outSample, 0, (sbrRoom ? outSampleLen : coreSampleLen) * sizeof(int16_t));
+  sbrBypassed = !sbrRoom;
+  sbrStream = false;
+  AACSetSBRBypass(hAACDecoder, sbrBypassed);
 
  
   running = true;
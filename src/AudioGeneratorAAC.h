@@ -23,6 +23,8 @@
 
 #include "AudioGenerator.h"
 #include "libhelix-aac/aacdec.h"
+#include "FrameReader.h"
+#include "MP4Demuxer.h"
 
 class AudioGeneratorAAC : public AudioGenerator
 {
@@ -35,6 +37,24 @@ class AudioGeneratorAAC : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // HE-AAC streams can skip the SBR stage and play just their AAC-LC core, at half the sample rate
+    // and bandwidth for about half the CPU.  SBR_AUTO does so only while the output's FillPercent()
+    // is below thresholdPercent, doubling the core samples to keep the output rate unchanged.
+    enum { SBR_ON = 0, SBR_OFF, SBR_AUTO };
+    bool SetSBRMode(int mode, int thresholdPercent = 25);
+
+    // MP4/M4A files only, ADTS streams carry no index
+    uint32_t GetDurationMs();
+    uint32_t GetPositionMs();
+    bool SeekMs(uint32_t ms);
+
+    // Bytes the preallocating constructor needs.  Given less, but at least preAllocSize(false), there is no
+    // room for SBR output and HE-AAC streams always play only their AAC-LC core, as with SBR_OFF.
+    // The Helix decoder's own share is only known at runtime, so unlike the MP3 one this isn't constexpr.
+    static int preAllocSize (bool sbr = true) { return preAllocBuffSize() + preAllocOutSize(sbr) + AACGetPreAllocSize(); }
+    static constexpr int preAllocBuffSize () { return (ringLen + maxFrameLen + 7) & ~7; }
+    static constexpr int preAllocOutSize (bool sbr = true) { return ((sbr ? outSampleLen : coreSampleLen) * sizeof(int16_t) + 7) & ~7; }
+
   protected:
     void *preallocateSpace;
     int preallocateSize;
@@ -42,15 +62,24 @@ class AudioGeneratorAAC : public AudioGenerator
     // Helix AAC decoder
     HAACDecoder hAACDecoder;
 
-    // Input buffering
-    const int buffLen = 1600;
-    uint8_t *buff; //[1600]; // File buffer required to store at least a whole compressed frame
-    int16_t buffValid;
-    int16_t lastFrameEnd;
-    bool FillBufferWithValidFrame(); // Read until we get a valid syncword and min(feof, 2048) butes in the buffer
+    // Input buffering, a ring of 1600 bytes plus room to unwrap the largest ADTS frame
+    static constexpr int ringLen = 1600;
+    static constexpr int maxFrameLen = AAC_MAINBUF_SIZE + 9;
+    FrameReader reader;
+    uint8_t *buff; //[reader.BufferSize()];
+
+    // MP4 files instead put one access unit at the start of buff, the rest holds the demuxer's tables
+    MP4Demuxer mp4;
+    bool isMP4;
 
-    // Output buffering
-    int16_t *outSample; //[1024 * 2]; // Interleaved L/R
+    // Output buffering, one frame of interleaved samples, twice as many with SBR (which the decoder leaves out on the ESP8266)
+    static constexpr int coreSampleLen = 1024 * 2;
+#ifdef ESP8266
+    static constexpr int outSampleLen = coreSampleLen;
+#else
+    static constexpr int outSampleLen = coreSampleLen * 2;
+#endif
+    int16_t *outSample; //[outSampleLen]; // Interleaved L/R
     int16_t validSamples;
     int16_t curSample;
 
@@ -58,6 +87,16 @@ class AudioGeneratorAAC : public AudioGenerator
     unsigned int lastRate;
     int lastChannels;
 
+    // SBR bypass
+    int sbrMode;
+    int sbrThreshold;
+    bool sbrBypassed;
+    bool sbrStream; // SBR has been seen in this stream
+    bool sbrRoom; // outSample can hold SBR output, else SBR stays bypassed
+
+    void UpdateSBRBypass();
+    void Upsample(int samples, int ch);
+
 };
 
 #endif
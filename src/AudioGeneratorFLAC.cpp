@@ -23,6 +23,8 @@
 AudioGeneratorFLAC::AudioGeneratorFLAC()
 {
   flac = NULL;
+  par = NULL;
+  decodeThreads = 1;
   channels = 0;
   sampleRate = 0;
   bitsPerSample = 0;
@@ -30,6 +32,13 @@ AudioGeneratorFLAC::AudioGeneratorFLAC()
   buff[1] = NULL;
   buffPtr = 0;
   buffLen = 0;
+  infoRate = 0;
+  totalSamples = 0;
+  fixedBlocksize = 0;
+  frameSample = 0;
+  skipTo = 0;
+  seekPointCount = 0;
+  seekInterval = 44100;
   running = false;
 }
 
@@ -38,6 +47,16 @@ AudioGeneratorFLAC::~AudioGeneratorFLAC()
   if (flac)
     FLAC__stream_decoder_delete(flac);
   flac = NULL;
+  delete par;
+  par = NULL;
+}
+
+bool AudioGeneratorFLAC::SetDecodeThreads(int threads)
+{
+  if (running || (threads < 1) || (threads > FLACParallelDecoder::MAX_THREADS)) return false;
+  if ((threads > 1) && !FLACParallelDecoder::Available()) return false;
+  decodeThreads = threads;
+  return true;
 }
 
 bool AudioGeneratorFLAC::begin(AudioFileSource *source, AudioOutput *output)
@@ -48,16 +67,34 @@ bool AudioGeneratorFLAC::begin(AudioFileSource *source, AudioOutput *output)
   this->output = output;
   if (!file->isOpen()) return false; // Error
 
-  flac = FLAC__stream_decoder_new();
-  if (!flac) return false;
-  
-  (void)FLAC__stream_decoder_set_md5_checking(flac, false);
+  if (decodeThreads > 1) {
+    // Frames are found by scanning ahead, so seeking and falling back to one core both need to go
+    // back.  A stream that can't seek, found by seeking to where it already is, is decoded on this
+    // core only.
+    uint32_t start = file->getReadPos();
+    if (file->seek(start, SEEK_SET)) {
+      par = new FLACParallelDecoder();
+      if (!par->Begin(file, decodeThreads)) {
+        // Most likely short of memory, decode on this core only
+        delete par;
+        par = NULL;
+        if (!file->seek(start, SEEK_SET)) return false;
+      }
+    }
+  }
+
+  if (!par) {
+    flac = FLAC__stream_decoder_new();
+    if (!flac) return false;
 
-  FLAC__StreamDecoderInitStatus ret = FLAC__stream_decoder_init_stream(flac, _read_cb, _seek_cb, _tell_cb, _length_cb, _eof_cb, _write_cb, _metadata_cb, _error_cb, reinterpret_cast<void*>(this) );
-  if (ret != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
-    FLAC__stream_decoder_delete(flac);
-    flac = NULL;
-    return false;
+    (void)FLAC__stream_decoder_set_md5_checking(flac, false);
+
+    FLAC__StreamDecoderInitStatus ret = FLAC__stream_decoder_init_stream(flac, _read_cb, _seek_cb, _tell_cb, _length_cb, _eof_cb, _write_cb, _metadata_cb, _error_cb, reinterpret_cast<void*>(this) );
+    if (ret != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      FLAC__stream_decoder_delete(flac);
+      flac = NULL;
+      return false;
+    }
   }
 
   output->begin();
@@ -65,57 +102,116 @@ bool AudioGeneratorFLAC::begin(AudioFileSource *source, AudioOutput *output)
   lastSample[0] = 0;
   lastSample[1] = 0;
   channels = 0;
+  buffPtr = 0;
+  buffLen = 0;
+  infoRate = 0;
+  totalSamples = 0;
+  fixedBlocksize = 0;
+  frameSample = 0;
+  skipTo = 0;
+  seekPointCount = 0;
+  seekInterval = 44100;
+  if (par) {
+    // No metadata callback, the STREAMINFO has already been read
+    infoRate = par->SampleRate();
+    totalSamples = par->TotalSamples();
+    fixedBlocksize = par->FixedBlocksize();
+    seekInterval = infoRate;
+    AddSeekPoint(0, par->FirstFrame());
+    // The SEEKTABLE's points go in the same index, so a seek past what's been played scans from close by
+    uint32_t sample, offset;
+    for (int i = 0; par->SeekTablePoint(i, &sample, &offset); i++) AddSeekPoint(sample, offset);
+  }
   return true;
 }
 
-bool AudioGeneratorFLAC::loop()
+// Decode the next frame into buff, false if that gave no samples (at the end, running is cleared)
+bool AudioGeneratorFLAC::DecodeFrame()
+{
+  if (par) {
+    // False while the frame is still being decoded on another core, try again next loop()
+    FLACParallelDecoder::Frame f;
+    int got = par->NextFrame(&f);
+    if (got < 0) running = false;
+    if (got <= 0) return false;
+    AddSeekPoint(f.sample, f.offset);
+    UseFrame(f.sample, f.len, (const int *)f.pcm[0], (const int *)f.pcm[1]);
+  } else {
+    if (!FLAC__stream_decoder_process_single(flac)) {
+      running = false;
+      return false;
+    }
+    // We might be done...
+    if (FLAC__stream_decoder_get_state(flac)==FLAC__STREAM_DECODER_END_OF_STREAM) {
+      running = false;
+      return false;
+    }
+  }
+  UpdateFormat();
+  // Check for some weird case where above didn't give any data.  At some point the flac better error.
+  return buffPtr < buffLen;
+}
+
+// Tell the output about the frame just decoded, if it's different from the last
+void AudioGeneratorFLAC::UpdateFormat()
 {
-  FLAC__bool ret;
+  unsigned newsr, newch, newbps;
+  if (par) {
+    newsr = par->SampleRate();
+    newch = par->Channels();
+    newbps = par->BitsPerSample();
+  } else {
+    newsr = FLAC__stream_decoder_get_sample_rate(flac);
+    newch = FLAC__stream_decoder_get_channels(flac);
+    newbps = FLAC__stream_decoder_get_bits_per_sample(flac);
+  }
+  if (newsr != sampleRate) output->SetRate(sampleRate = newsr);
+  if (newch != channels) output->SetChannels(channels = newch);
+  if (newbps != bitsPerSample) {
+    // Outputs that can't take this many bits get 16, wider samples being dithered down by
+    // ConsumeSamples32()
+    bitsPerSample = newbps;
+    if (!output->SetBitsPerSample(bitsPerSample)) output->SetBitsPerSample(16);
+  }
+}
 
+bool AudioGeneratorFLAC::loop()
+{
   if (!running) goto done;
 
-  if (channels && !output->ConsumeSample(lastSample)) goto done; // Try and send last buffered sample
-
-  do {
-    if (buffPtr == buffLen) {
-      ret = FLAC__stream_decoder_process_single(flac);
-      if (!ret) {
-        running = false;
-        goto done;
-      } else {
-        // We might be done...
-        if (FLAC__stream_decoder_get_state(flac)==FLAC__STREAM_DECODER_END_OF_STREAM) {
-          running = false;
-          goto done;
-        }
-        unsigned newsr = FLAC__stream_decoder_get_sample_rate(flac);
-        unsigned newch = FLAC__stream_decoder_get_channels(flac);
-        unsigned newbps = FLAC__stream_decoder_get_bits_per_sample(flac);
-        if (newsr != sampleRate) output->SetRate(sampleRate = newsr);
-        if (newch != channels) output->SetChannels(channels = newch);
-        if (newbps != bitsPerSample) output->SetBitsPerSample( bitsPerSample = newbps);
+  if (bitsPerSample > 16) {
+    // Hand the decoder's samples over a block at a time in 32-bit containers, MSB-aligned.  Outputs
+    // that can't play them dither them down to 16 bits.
+    int shift = 32 - bitsPerSample;
+    while (running && ((buffPtr < buffLen) || DecodeFrame())) {
+      uint16_t n = buffLen - buffPtr;
+      if (n > BLOCK) n = BLOCK;
+      const int *l = buff[0] + buffPtr;
+      const int *r = buff[1] + buffPtr;
+      for (uint16_t i = 0; i < n; i++) {
+        block[i * 2] = (int32_t)((uint32_t)l[i] << shift);
+        block[i * 2 + 1] = (int32_t)((uint32_t)r[i] << shift);
       }
+      uint16_t used = output->ConsumeSamples32(block, n);
+      buffPtr += used;
+      if (used < n) break; // Output's full
     }
+    goto done;
+  }
 
-    // Check for some weird case where above didn't give any data
-    if (buffPtr == buffLen) {
-      goto done; // At some point the flac better error and we'll return 
-    }
-    if (bitsPerSample <= 16) {
-      lastSample[AudioOutput::LEFTCHANNEL] = buff[0][buffPtr] & 0xffff; 
-      if (channels==2) lastSample[AudioOutput::RIGHTCHANNEL] = buff[1][buffPtr] & 0xffff; 
-      else lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
-    } else if (bitsPerSample <= 24) {
-      lastSample[AudioOutput::LEFTCHANNEL] = (buff[0][buffPtr]>>8) & 0xffff; 
-      if (channels==2) lastSample[AudioOutput::RIGHTCHANNEL] = (buff[1][buffPtr]>>8) & 0xffff; 
-      else lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
-    } else {
-      lastSample[AudioOutput::LEFTCHANNEL] = (buff[0][buffPtr]>>16) & 0xffff; 
-      if (channels==2) lastSample[AudioOutput::RIGHTCHANNEL] = (buff[1][buffPtr]>>16) & 0xffff; 
-      else lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
-    }
+  while (running) {
+    // With several decode threads the next frame may not be ready yet, so this can come back empty
+    // handed without being at the end
+    if ((buffPtr == buffLen) && !DecodeFrame()) break;
+    if (bitsPerSample > 16) break; // First frame of a hi-res file, the next loop() plays it
+
+    // A sample the output turns down stays in buff, and is read from there again next time
+    lastSample[AudioOutput::LEFTCHANNEL] = buff[0][buffPtr] & 0xffff;
+    if (channels==2) lastSample[AudioOutput::RIGHTCHANNEL] = buff[1][buffPtr] & 0xffff;
+    else lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
+    if (!output->ConsumeSample(lastSample)) break;
     buffPtr++;
-  } while (running && output->ConsumeSample(lastSample));
+  }
 
 done:
   file->loop();
@@ -129,6 +225,8 @@ bool AudioGeneratorFLAC::stop()
   if (flac)
     FLAC__stream_decoder_delete(flac);
   flac = NULL;
+  delete par;
+  par = NULL;
   running = false;
   output->stop();
   return true;
@@ -139,6 +237,129 @@ bool AudioGeneratorFLAC::isRunning()
   return running;
 }
 
+uint32_t AudioGeneratorFLAC::GetDurationMs()
+{
+  return infoRate ? (uint32_t)((totalSamples * 1000) / infoRate) : 0;
+}
+
+uint32_t AudioGeneratorFLAC::GetPositionMs()
+{
+  return infoRate ? (uint32_t)(((frameSample + buffPtr) * 1000) / infoRate) : 0;
+}
+
+bool AudioGeneratorFLAC::SeekMs(uint32_t ms)
+{
+  if (!running || (!flac && !par)) return false;
+  // Before the first loop() the STREAMINFO hasn't been read yet
+  if (!infoRate && flac && !FLAC__stream_decoder_process_until_end_of_metadata(flac)) return false;
+  if (!infoRate) return false;
+  return SeekSample(((uint64_t)ms * infoRate) / 1000);
+}
+
+bool AudioGeneratorFLAC::SeekSample(uint64_t sample)
+{
+  if (!running || (!flac && !par)) return false;
+  if (totalSamples && (sample >= totalSamples)) return false;
+  if (par) {
+    // From the closest frame start known, there's always the first one.  The frames up to the
+    // target are only scanned through, not decoded.
+    int i = SeekPointBefore(sample);
+    if ((i < 0) || !par->Restart(seekPoints[i].offset, sample)) return false;
+    skipTo = sample;
+    frameSample = sample;
+    buffPtr = 0;
+    buffLen = 0;
+    return true;
+  }
+  // Either way the frame with the target in it has been decoded already, and may be the first one
+  // the output gets
+  if (SeekIndexed(sample)) {
+    UpdateFormat();
+    return true;
+  }
+
+  // libflac narrows things down with the SEEKTABLE if there is one, then bisects the file.  The
+  // frame holding the target comes to write_cb() already cut down to start there.
+  skipTo = 0;
+  buffPtr = 0;
+  buffLen = 0;
+  if (FLAC__stream_decoder_seek_absolute(flac, sample)) {
+    UpdateFormat();
+    return true;
+  }
+  FLAC__stream_decoder_flush(flac); // Out of the seek error state, carry on from wherever we are
+  return false;
+}
+
+// Remember that the frame starting at sample begins at byte offset, if it's far enough from the points
+// either side.  Seeks land anywhere, so it may go in between ones already there.
+void AudioGeneratorFLAC::AddSeekPoint(uint64_t sample, uint64_t offset)
+{
+  if ((sample > 0xffffffff) || (offset > 0xffffffff)) return;
+  if (!SeekPointWanted(sample)) return;
+  if (seekPointCount == SEEK_POINTS) {
+    // Full, keep every other point
+    for (int i = 0; i < SEEK_POINTS / 2; i++) seekPoints[i] = seekPoints[i * 2];
+    seekPointCount = SEEK_POINTS / 2;
+    seekInterval *= 2;
+    if (!SeekPointWanted(sample)) return;
+  }
+  int i = SeekPointBefore(sample) + 1;
+  memmove(&seekPoints[i + 1], &seekPoints[i], (seekPointCount - i) * sizeof(SeekPoint));
+  seekPoints[i].sample = sample;
+  seekPoints[i].offset = offset;
+  seekPointCount++;
+}
+
+// Whether sample is at least seekInterval away from the seek points before and after it
+bool AudioGeneratorFLAC::SeekPointWanted(uint64_t sample)
+{
+  int i = SeekPointBefore(sample);
+  if ((i >= 0) && (sample < (uint64_t)seekPoints[i].sample + seekInterval)) return false;
+  if ((i + 1 < seekPointCount) && (seekPoints[i + 1].sample < sample + seekInterval)) return false;
+  return true;
+}
+
+// Index of the last seek point at or before sample, -1 if there's none
+int AudioGeneratorFLAC::SeekPointBefore(uint64_t sample)
+{
+  int lo = 0, hi = seekPointCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (seekPoints[mid].sample <= sample) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo - 1;
+}
+
+// Seek from the nearest point already played through, false if there's none close enough
+bool AudioGeneratorFLAC::SeekIndexed(uint64_t sample)
+{
+  int i = SeekPointBefore(sample);
+  if (i < 0) return false;
+  const SeekPoint &p = seekPoints[i];
+  if (sample - p.sample > 2 * (uint64_t)seekInterval) return false; // Never played the part in between
+
+  if (!file->seek(p.offset, SEEK_SET) || !FLAC__stream_decoder_flush(flac)) return false;
+  uint64_t at = p.sample;
+  if (fixedBlocksize) {
+    // Frames wholly before the target only need to be stepped over, not decoded
+    while (at + fixedBlocksize <= sample) {
+      if (!FLAC__stream_decoder_skip_single_frame(flac)) return false;
+      at += fixedBlocksize;
+    }
+  }
+  skipTo = sample;
+  buffPtr = 0;
+  buffLen = 0;
+  while (!buffLen) {
+    if (!FLAC__stream_decoder_process_single(flac)) return false;
+    FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(flac);
+    if ((state == FLAC__STREAM_DECODER_END_OF_STREAM) || (state == FLAC__STREAM_DECODER_ABORTED)) return false;
+  }
+  return true;
+}
+
 
 
 FLAC__StreamDecoderReadStatus AudioGeneratorFLAC::read_cb(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes)
@@ -152,13 +373,14 @@ FLAC__StreamDecoderReadStatus AudioGeneratorFLAC::read_cb(const FLAC__StreamDeco
 FLAC__StreamDecoderSeekStatus AudioGeneratorFLAC::seek_cb(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset)
 {
   (void) decoder;
-  if (!file->seek((int32_t)absolute_byte_offset, 0)) return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+  if (absolute_byte_offset > 0x7fffffff) return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR; // Past what AudioFileSource::seek() takes
+  if (!file->seek((int32_t)absolute_byte_offset, SEEK_SET)) return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
   return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
 }
 FLAC__StreamDecoderTellStatus AudioGeneratorFLAC::tell_cb(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset)
 {
   (void) decoder;
-  *absolute_byte_offset = file->getPos();
+  *absolute_byte_offset = file->getReadPos();
   return FLAC__STREAM_DECODER_TELL_STATUS_OK;
 }
 
@@ -166,31 +388,57 @@ FLAC__StreamDecoderLengthStatus AudioGeneratorFLAC::length_cb(const FLAC__Stream
 {
   (void) decoder;
   *stream_length = file->getSize();
+  if (!*stream_length) return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED; // A stream, can't bisect it
   return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
 }
 FLAC__bool AudioGeneratorFLAC::eof_cb(const FLAC__StreamDecoder *decoder)
 {
   (void) decoder;
-  if (file->getPos() >= file->getSize()) return true;
+  if (file->getReadPos() >= file->getSize()) return true;
   return false;
 }
 FLAC__StreamDecoderWriteStatus AudioGeneratorFLAC::write_cb(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[])
 {
   (void) decoder;
+  uint64_t start = frame->header.number.sample_number;
+  uint32_t len = frame->header.blocksize;
+  // Also where a seek landed, which is the target sample on, so the end is still a frame boundary
+  if (SeekPointWanted(start + len)) {
+    FLAC__uint64 next;
+    if (FLAC__stream_decoder_get_decode_position(decoder, &next)) AddSeekPoint(start + len, next);
+  }
+
   // Hackish warning here.  FLAC sends the buffer but doesn't free it until the next call to decode_frame, so we stash
   // the pointers here and use it in our loop() instead of memcpy()'ing into yet another buffer.
-  buffLen = frame->header.blocksize;
-  buff[0] = (const int *)buffer[0];
-  if (frame->header.channels>1) buff[1] = (const int *)buffer[1];
-  else buff[1] = (const int *)buffer[0];
-  buffPtr = 0;
+  UseFrame(start, len, (const int *)buffer[0], (const int *)buffer[(frame->header.channels > 1) ? 1 : 0]);
   return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
+
+// Play a decoded frame starting at stream sample start, from skipTo on if that's inside it
+void AudioGeneratorFLAC::UseFrame(uint64_t start, uint32_t len, const int *left, const int *right)
+{
+  if (start + len <= skipTo) {
+    buffPtr = 0;
+    buffLen = 0;
+    return; // Still short of where we're seeking to
+  }
+  buffLen = len;
+  buff[0] = left;
+  buff[1] = right;
+  buffPtr = (skipTo > start) ? (uint16_t)(skipTo - start) : 0;
+  frameSample = start;
+  skipTo = 0;
+}
 void AudioGeneratorFLAC::metadata_cb(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata)
 {
   (void) decoder;
-  (void) metadata;
-  audioLogger->printf_P(PSTR("Metadata\n"));
+  if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+    const FLAC__StreamMetadata_StreamInfo *si = &metadata->data.stream_info;
+    infoRate = si->sample_rate;
+    totalSamples = si->total_samples;
+    fixedBlocksize = (si->min_blocksize == si->max_blocksize) ? si->max_blocksize : 0;
+    if (infoRate) seekInterval = infoRate; // A point every second or so to start with
+  }
 }
 char AudioGeneratorFLAC::error_cb_str[64];
 void AudioGeneratorFLAC::error_cb(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status)
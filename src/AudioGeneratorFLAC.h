@@ -22,6 +22,7 @@
 #define _AUDIOGENERATORFLAC_H
 
 #include <AudioGenerator.h>
+#include "FLACParallelDecoder.h"
 extern "C" {
     #include "libflac/FLAC/stream_decoder.h"
 };
@@ -36,6 +37,19 @@ class AudioGeneratorFLAC : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // Seeking needs a seekable source.  Uses the places already played through when it can, the
+    // SEEKTABLE or a bisection of the file otherwise.
+    uint32_t GetDurationMs();
+    uint32_t GetPositionMs();
+    bool SeekMs(uint32_t ms);
+    bool SeekSample(uint64_t sample);
+
+    // Decode frames on up to this many cores at once (ESP32 and host builds, call before begin()).
+    // Costs a decoder and a frame buffer per thread.  Seeking then uses the SEEKTABLE and the places
+    // already played through, anywhere else is reached by skipping frames from the nearest one before
+    // it.  Sources that can't seek, like HTTP streams, are still decoded on one core.
+    bool SetDecodeThreads(int threads);
+
   protected:
     // FLAC info
     uint16_t channels;
@@ -47,6 +61,40 @@ class AudioGeneratorFLAC : public AudioGenerator
     uint16_t buffPtr;
     uint16_t buffLen;
     FLAC__StreamDecoder *flac;
+    FLACParallelDecoder *par; // Instead of flac when decoding on several cores
+    int decodeThreads;
+
+    // More than 16 bits go to the output a block at a time, MSB-aligned in 32 bits
+    enum { BLOCK = 32 };
+    int32_t block[2 * BLOCK];
+
+    // From STREAMINFO
+    uint32_t infoRate;
+    uint64_t totalSamples;   // 0 if unknown
+    uint32_t fixedBlocksize; // 0 if the block size varies
+
+    uint64_t frameSample;    // Stream sample number of buff[][0]
+    uint64_t skipTo;         // Decoded frames ending before this are dropped
+
+    // Sparse index of frame starts passed while playing or landed on by a seek, so going back to
+    // somewhere already been (loop points, scrubbing) is a direct jump plus at most a couple of frames
+    // of decoding
+    enum { SEEK_POINTS = 64 };
+    struct SeekPoint {
+      uint32_t sample;
+      uint32_t offset;
+    };
+    SeekPoint seekPoints[SEEK_POINTS];
+    int seekPointCount;
+    uint32_t seekInterval;   // Samples between seek points, doubled whenever the index fills up
+
+    bool DecodeFrame();
+    void UpdateFormat();
+    void UseFrame(uint64_t start, uint32_t len, const int *left, const int *right);
+    void AddSeekPoint(uint64_t sample, uint64_t offset);
+    bool SeekPointWanted(uint64_t sample);
+    int SeekPointBefore(uint64_t sample);
+    bool SeekIndexed(uint64_t sample);
 
     // FLAC callbacks, need static functions to bounce into c++ from c
     static FLAC__StreamDecoderReadStatus _read_cb(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data) {
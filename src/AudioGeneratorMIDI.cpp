@@ -302,10 +302,12 @@ note_off:
         case 0xb:
           controller = buffer_byte (t->trkptr++);
           velocity = buffer_byte (t->trkptr++);
+          if (controller == 0)
+            midi_chan_bank[chan] = velocity;          // bank select MSB, for the next program change
           break;
         case 0xc:
           instrument = buffer_byte (t->trkptr++);
-          midi_chan_instrument[chan] = instrument;    // record new instrument for this channel
+          midi_chan_instrument[chan] = preset_index (chan, instrument);    // record new instrument for this channel
           break;
         case 0xd:
           pressure = buffer_byte (t->trkptr++);
@@ -335,7 +337,64 @@ note_off:
 }
 
 
-// Open file, parse headers, get ready to process MIDI
+/* the SoundFont preset for a program on a channel, going by its last bank select.  Channel 10 plays
+   the drum kits, which SoundFonts keep in bank 128. */
+
+int AudioGeneratorMIDI::preset_index (int chan, int program) {
+  int idx = -1;
+  if (chan == 9) {
+    idx = tsf_get_presetindex (g_tsf, 128, program);
+    if (idx < 0)
+      idx = tsf_get_presetindex (g_tsf, 128, 0);
+  }
+  if (idx < 0)
+    idx = tsf_get_presetindex (g_tsf, midi_chan_bank[chan], program);
+  if (idx < 0)
+    idx = tsf_get_presetindex (g_tsf, 0, program);
+  if (idx < 0)
+    idx = (program < tsf_get_presetcount (g_tsf)) ? program : 0;
+  return idx;
+}
+
+// MIDI variable-length number, 7 bits to a byte with the top bit set on all but the last
+static int PutVarlen(uint8_t *p, uint32_t val)
+{
+  int groups = 1, len = 0;
+  while ((groups < 5) && (val >> (7 * groups))) groups++;
+  for (int i = groups - 1; i >= 0; i--) p[len++] = ((val >> (7 * i)) & 0x7f) | (i ? 0x80 : 0);
+  return len;
+}
+
+// Append an event to the score: the samples since the last one, the key with the top bit set for
+// a note on, the preset (variable-length too), and for a note on the velocity.  The first note of
+// a preset loads its regions, so playback never has to.
+void AudioGeneratorMIDI::AddEvent(uint32_t time, int key, int preset, int velocity)
+{
+  uint8_t ev[16];
+  int len = PutVarlen(ev, time - scoreEnd);
+  ev[len++] = key | (velocity ? 0x80 : 0);
+  len += PutVarlen(ev + len, preset);
+  if (velocity) {
+    ev[len++] = velocity;
+    tsf_preload_preset(g_tsf, preset);
+  }
+
+  if (scoreLen + len > scoreSize) {
+    int newSize = scoreSize ? scoreSize * 2 : 1024;
+    uint8_t *newScore = (uint8_t *)realloc(score, newSize);
+    if (!newScore) {
+      midi_error ("Out of memory for the score", hdrptr);
+      return;
+    }
+    score = newScore;
+    scoreSize = newSize;
+  }
+  memcpy(score + scoreLen, ev, len);
+  scoreLen += len;
+  scoreEnd = time;
+}
+
+// Open file, parse headers, and merge the tracks into the score
 void AudioGeneratorMIDI::PrepareMIDI(AudioFileSource *src)
 {
   MakeStreamFromAFS(src, &afsMIDI);
@@ -352,33 +411,51 @@ void AudioGeneratorMIDI::PrepareMIDI(AudioFileSource *src)
 
   /* initialize processing of all the tracks */
 
-  for (tracknum = 0; tracknum < num_tracks; ++tracknum) {
+  memset(midi_chan_bank, 0, sizeof(midi_chan_bank));
+  for (int chan = 0; chan < 16; chan++)
+    midi_chan_instrument[chan] = preset_index (chan, 0);
+
+  tracks_done = 0;
+  for (tracknum = 0; tracknum < num_tracks && running; ++tracknum) {
     start_track (tracknum);   /* process the track header */
     find_note (tracknum);     /* position to the first note on/off */
   }
 
   notes_skipped = 0;
+  num_tonegens_used = 0;
   tracknum = 0;
   earliest_tracknum = 0;
   earliest_time = 0;
+  timenow = 0;
+  tempo = 500000;             /* 120 bpm until told otherwise */
+
+  scoreLen = 0;
+  scoreEnd = 0;
+  if (running) CompileMIDI();
+
+  scorePtr = 0;
+  scoreNow = 0;
+  scoreNext = 0;
+  NextEvent();
 }
 
-// Parses the note on/offs until we are ready to render some more samples.  Then return the
-// total number of samples to render before we need to be called again
-int AudioGeneratorMIDI::PlayMIDI()
+// Merges the tracks' note ons and offs into the score, with the times in samples.  Tone generators
+// are handed out here too, so the notes there wouldn't be one for never make it in.
+void AudioGeneratorMIDI::CompileMIDI()
 {
-  /* Continue processing all tracks, in an order based on the simulated time.
+  /* Process all tracks, in an order based on the simulated time.
     This is not unlike multiway merging used for tape sorting algorithms in the 50's! */
 
-  do {                         /* while there are still track notes to process */
-    static struct track_status *trk;
-    static struct tonegen_status *tg;
-    static int tgnum;
-    static int count_tracks;
-    static unsigned long delta_time, delta_msec;
+  uint64_t usecTicks = 0;   /* time so far in usec * ticks_per_beat, exact across tempo changes */
+  uint32_t now = 0;         /* and in samples */
+
+  while (running && tracks_done < num_tracks) {
+    struct track_status *trk;
+    struct tonegen_status *tg;
+    int tgnum;
+    int count_tracks;
 
-    /* Find the track with the earliest event time,
-       and output a delay command if time has advanced.
+    /* Find the track with the earliest event time.
 
        A potential improvement: If there are multiple tracks with the same time,
        first do the ones with STOPNOTE as the next command, if any.  That would
@@ -407,27 +484,21 @@ int AudioGeneratorMIDI::PlayMIDI()
 
     tracknum = earliest_tracknum;     /* the track we picked */
     trk = &track[tracknum];
-    if (earliest_time < timenow)
+    if (earliest_time < timenow) {
       midi_error ("INTERNAL: time went backwards", trk->trkptr);
+      break;
+    }
+
+    /* If time has advanced, convert ticks to samples based on the current tempo */
 
-    /* If time has advanced, output a "delay" command */
-
-    delta_time = earliest_time - timenow;
-    if (delta_time) {
-      /* Convert ticks to milliseconds based on the current tempo */
-      unsigned long long temp;
-      temp = ((unsigned long long) delta_time * tempo) / ticks_per_beat;
-      delta_msec = temp / 1000;      // get around LCC compiler bug
-      if (delta_msec > 0x7fff)
-        midi_error ("INTERNAL: time delta too big", trk->trkptr);
-      int samples = (((int) delta_msec) * freq) / 1000;
+    if (earliest_time != timenow) {
+      usecTicks += (uint64_t) (earliest_time - timenow) * tempo;
+      now = (uint32_t) ((usecTicks * freq) / ((uint64_t) ticks_per_beat * 1000000));
       timenow = earliest_time;
-      return samples;
     }
-    timenow = earliest_time;
 
     /*  If this track event is "set tempo", just change the global tempo.
-       That affects how we generate "delay" commands. */
+       That affects how later ticks convert to samples. */
 
     if (trk->cmd == CMD_TEMPO) {
       tempo = trk->tempo;
@@ -443,28 +514,28 @@ int AudioGeneratorMIDI::PlayMIDI()
         for (tgnum = 0; tgnum < num_tonegens; ++tgnum) {    /* find which generator is playing it */
           tg = &tonegen[tgnum];
           if (tg->playing && tg->track == tracknum && tg->note == trk->note) {
-            tsf_note_off (g_tsf, tg->instrument, tg->note);
+            AddEvent (now, tg->note, tg->instrument, 0);
             tg->playing = false;
             trk->tonegens[tgnum] = false;
           }
         }
         find_note (tracknum);       // use up the note
-      } while (trk->cmd == CMD_STOPNOTE && trk->time == timenow);
+      } while (running && trk->cmd == CMD_STOPNOTE && trk->time == timenow);
 
     /*  If this track event is "start note", process only it.
        Don't do more than one, so we allow other tracks their chance at grabbing tone generators. */
 
     else if (trk->cmd == CMD_PLAYNOTE) {
       bool foundgen = false;
-      /* if not, then try for any free tone generator */
-      if (!foundgen)
-        for (tgnum = 0; tgnum < num_tonegens; ++tgnum) {
-          tg = &tonegen[tgnum];
-          if (!tg->playing) {
-            foundgen = true;
-            break;
-          }
+      tg = NULL;
+      /* try for any free tone generator */
+      for (tgnum = 0; tgnum < num_tonegens; ++tgnum) {
+        tg = &tonegen[tgnum];
+        if (!tg->playing) {
+          foundgen = true;
+          break;
         }
+      }
       if (foundgen) {
         if (tgnum + 1 > num_tonegens_used)
           num_tonegens_used = tgnum + 1;
@@ -476,28 +547,125 @@ int AudioGeneratorMIDI::PlayMIDI()
         if (tg->instrument != midi_chan_instrument[trk->chan]) {    /* new instrument for this generator */
           tg->instrument = midi_chan_instrument[trk->chan];
         }
-        tsf_note_on (g_tsf, tg->instrument, tg->note, trk->velocity / 127.0); // velocity = 0...127
+        AddEvent (now, tg->note, tg->instrument, trk->velocity); // velocity = 1...127
       } else {
         ++notes_skipped;
       }
       find_note (tracknum);     // use up the note
     }
   }
-  while (tracks_done < num_tracks);
+}
+
+uint32_t AudioGeneratorMIDI::GetVarlen()
+{
+  uint8_t c;
+  uint32_t val = 0;
+  do {
+    c = score[scorePtr++];
+    val = (val << 7) | (c & 0x7f);
+  } while (c & 0x80);
+  return val;
+}
+
+// Decode the time of the event at scorePtr, moving past it
+void AudioGeneratorMIDI::NextEvent()
+{
+  if (scorePtr < scoreLen) scoreNext += GetVarlen();
+}
+
+// Plays the events due now.  Then return the total number of samples to render before we need to
+// be called again, -1 at the end of the score.
+int AudioGeneratorMIDI::PlayMIDI()
+{
+  while (scorePtr < scoreLen) {
+    if (scoreNext > scoreNow) {
+      int samples = scoreNext - scoreNow;
+      scoreNow = scoreNext;
+      return samples;
+    }
+    uint8_t key = score[scorePtr++];
+    int preset = GetVarlen();
+    if (key & 0x80) tsf_note_on (g_tsf, preset, key & 0x7f, score[scorePtr++] / 127.0);
+    else tsf_note_off (g_tsf, preset, key);
+    NextEvent();
+  }
   return -1; // EOF
 }
 
+uint32_t AudioGeneratorMIDI::GetDurationMs()
+{
+  return running ? (uint32_t) (((uint64_t) scoreEnd * 1000) / freq) : 0;
+}
+
+uint32_t AudioGeneratorMIDI::GetPositionMs()
+{
+  if (!running) return 0;
+  if (sawEOF) return GetDurationMs();
+  // Where the score has got to, less what's still to be rendered or sent
+  int64_t pos = (int64_t) scoreNow - samplesToPlay - (numSamplesRendered - sentSamplesRendered);
+  if (pos < 0) pos = 0;
+  return (uint32_t) ((pos * 1000) / freq);
+}
+
+// Walks the score from the start, so notes still held at ms can be struck again there
+bool AudioGeneratorMIDI::SeekMs(uint32_t ms)
+{
+  struct { uint8_t key, velocity; uint16_t preset; } held[MAX_TONEGENS];
+  int numHeld = 0;
+  uint32_t target = (uint32_t) (((uint64_t) ms * freq) / 1000);
+
+  if (!running) return false;
+  scorePtr = 0;
+  scoreNext = 0;
+  NextEvent();
+  while ((scorePtr < scoreLen) && (scoreNext < target)) {
+    uint8_t key = score[scorePtr++];
+    int preset = GetVarlen();
+    if (key & 0x80) {
+      uint8_t velocity = score[scorePtr++];
+      if (numHeld < MAX_TONEGENS) {
+        held[numHeld].key = key & 0x7f;
+        held[numHeld].preset = preset;
+        held[numHeld++].velocity = velocity;
+      }
+    } else {
+      for (int i = 0; i < numHeld; ) {
+        if ((held[i].key == key) && (held[i].preset == preset)) held[i] = held[--numHeld];
+        else i++;
+      }
+    }
+    NextEvent();
+  }
+
+  tsf_reset (g_tsf);
+  for (int i = 0; i < numHeld; i++)
+    tsf_note_on (g_tsf, held[i].preset, held[i].key, held[i].velocity / 127.0);
+  scoreNow = target;
+  samplesToPlay = 0;
+  numSamplesRendered = 0;
+  sentSamplesRendered = 0;
+  sawEOF = false;
+  return true;
+}
+
 
 void AudioGeneratorMIDI::StopMIDI()
 {
+  int voicesStolen = tsf_stolen_voice_count(g_tsf);
 
   buffer.close(buffer.data);
   tsf_close(g_tsf);
+  free(score);
+  score = NULL;
+  scoreSize = 0;
+  scoreLen = 0;
   printf ("  %s %d tone generators were used.\n",
           num_tonegens_used < num_tonegens ? "Only" : "All", num_tonegens_used);
   if (notes_skipped)
     printf
     ("  %d notes were skipped because there weren't enough tone generators.\n", notes_skipped);
+  if (voicesStolen)
+    printf ("  %d voices were stolen.\n", voicesStolen);
 
   printf ("  Done.\n");
 }
@@ -512,11 +680,16 @@ bool AudioGeneratorMIDI::begin(AudioFileSource *src, AudioOutput *out)
 
   g_tsf = tsf_load(&afsSF2);
   if (!g_tsf) return false;
-  tsf_set_output (g_tsf, TSF_MONO, freq, -10 /* dB gain -10 */ );
+  // Stereo unless nobody will hear it, the mono render being duplicated to both channels then
+  mono = out->WantsMono();
+  tsf_set_output (g_tsf, mono ? TSF_MONO : TSF_STEREO_INTERLEAVED, freq, -10 /* dB gain -10 */ );
+  tsf_set_max_voices (g_tsf, maxVoices);
+  voiceCost = 0;
+  voicesStolenReported = 0;
 
   if (!out->SetRate( freq )) return false;
   if (!out->SetBitsPerSample( 16 )) return false;
-  if (!out->SetChannels( 1 )) return false;
+  if (!out->SetChannels( mono ? 1 : 2 )) return false;
   if (!out->begin()) return false;
 
   output = out;
@@ -525,6 +698,11 @@ bool AudioGeneratorMIDI::begin(AudioFileSource *src, AudioOutput *out)
   running = true;
 
   PrepareMIDI(src);
+  if (running && notes_skipped) {
+    char buff[64];
+    sprintf_P(buff, PSTR("%d notes skipped, no free tone generator"), notes_skipped);
+    cb.st(STATUS_NOTESSKIPPED, buff);
+  }
 
   samplesToPlay = 0;
   numSamplesRendered = 0;
@@ -537,31 +715,28 @@ bool AudioGeneratorMIDI::begin(AudioFileSource *src, AudioOutput *out)
 
 bool AudioGeneratorMIDI::loop()
 {
-  static int c = 0;
-
   if (!running) goto done; // Nothing to do here!
 
-  // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
-
-  // Try and stuff the buffer one sample at a time
+  // Hand the output whole rendered blocks, stopping when it won't take any more
   do {
-    c++;
-    if (c%44100 == 0) yield();
-
-play:
-
     if (sentSamplesRendered < numSamplesRendered) {
-      lastSample[AudioOutput::LEFTCHANNEL] = samplesRendered[sentSamplesRendered];
-      lastSample[AudioOutput::RIGHTCHANNEL] = samplesRendered[sentSamplesRendered];
-      sentSamplesRendered++;
+      sentSamplesRendered += output->ConsumeSamples(samplesRendered + 2 * sentSamplesRendered, numSamplesRendered - sentSamplesRendered);
+      if (sentSamplesRendered < numSamplesRendered) break; // Output's full, try again later
     } else if (samplesToPlay) {
-      numSamplesRendered = sizeof(samplesRendered)/sizeof(samplesRendered[0]);
-      if ((int)samplesToPlay < (int)(sizeof(samplesRendered)/sizeof(samplesRendered[0]))) numSamplesRendered = samplesToPlay;
-      tsf_render_short_fast(g_tsf, samplesRendered, numSamplesRendered, 0);
-      lastSample[AudioOutput::LEFTCHANNEL] = samplesRendered[0];
-      lastSample[AudioOutput::RIGHTCHANNEL] = samplesRendered[0];
-      sentSamplesRendered = 1;
+      numSamplesRendered = RENDER_SAMPLES;
+      if (samplesToPlay < RENDER_SAMPLES) numSamplesRendered = samplesToPlay;
+      if (cpuBudget) {
+        int voices = tsf_active_voice_count(g_tsf);
+        uint32_t start = micros();
+        tsf_render_short_mix(g_tsf, samplesRendered, numSamplesRendered, 0, fixedPoint);
+        Budget(micros() - start, voices, numSamplesRendered);
+      } else {
+        tsf_render_short_mix(g_tsf, samplesRendered, numSamplesRendered, 0, fixedPoint);
+      }
+      if (mono) {
+        for (int i = numSamplesRendered - 1; i >= 0; i--) samplesRendered[2 * i] = samplesRendered[2 * i + 1] = samplesRendered[i];
+      }
+      sentSamplesRendered = 0;
       samplesToPlay -= numSamplesRendered;
     } else {
       numSamplesRendered = 0;
@@ -570,14 +745,19 @@ play:
         running = false;
       } else {
         samplesToPlay = PlayMIDI();
+        if (tsf_stolen_voice_count(g_tsf) != voicesStolenReported) {
+          char buff[64];
+          voicesStolenReported = tsf_stolen_voice_count(g_tsf);
+          sprintf_P(buff, PSTR("%d voices stolen"), voicesStolenReported);
+          cb.st(STATUS_VOICESSTOLEN, buff);
+        }
         if (samplesToPlay == -1) {
             sawEOF = true;
             samplesToPlay = freq / 2;
         }
-        goto play;
       }
     }
-  } while (running && output->ConsumeSample(lastSample));
+  } while (running);
 
 done:
   file->loop();
@@ -586,6 +766,22 @@ done:
   return running;
 }
  
+// Lower the voice limit to what the CPU budget leaves room for, at the render time per voice-sample
+// seen so far.  Voices over it are faded out now rather than when the next note needs one.
+void AudioGeneratorMIDI::Budget(uint32_t us, int voices, int samples)
+{
+  if (voices) {
+    uint32_t cost = (uint32_t) (((uint64_t) us << 16) / ((uint32_t) voices * samples));
+    voiceCost = voiceCost ? voiceCost - (voiceCost >> 3) + (cost >> 3) : cost;
+  }
+  if (!voiceCost) return;
+  uint64_t budget = ((uint64_t) 1000000 << 16) * cpuBudget / 100 / freq; // Per sample, in 1/65536 us
+  uint64_t fit = budget / voiceCost;
+  int limit = (fit < 1) ? 1 : (fit > 0x7fff) ? 0x7fff : (int) fit;
+  if (maxVoices && (maxVoices < limit)) limit = maxVoices;
+  tsf_set_max_voices(g_tsf, limit);
+}
+
 bool AudioGeneratorMIDI::stop()
 {
   StopMIDI();
@@ -603,7 +799,7 @@ int AudioGeneratorMIDI::afs_read(void *data, void *ptr, unsigned int size)
 int AudioGeneratorMIDI::afs_tell(void *data)
 {
   AudioFileSource *s = reinterpret_cast<AudioFileSource *>(data);
-  return s->getPos();
+  return s->getReadPos();
 }
 
 int AudioGeneratorMIDI::afs_skip(void *data, unsigned int count)
@@ -33,8 +33,8 @@
 class AudioGeneratorMIDI : public AudioGenerator
 {
   public:
-    AudioGeneratorMIDI() { freq=44100; running = false; };
-    virtual ~AudioGeneratorMIDI() override {};
+    AudioGeneratorMIDI() { freq=44100; fixedPoint = false; maxVoices = 0; cpuBudget = 0; mono = false; running = false; score = NULL; scoreSize = 0; scoreLen = 0; };
+    virtual ~AudioGeneratorMIDI() override { free(score); };
     bool SetSoundfont(AudioFileSource *newsf2) {
       if (isRunning()) return false;
       sf2 = newsf2;
@@ -46,13 +46,49 @@ class AudioGeneratorMIDI : public AudioGenerator
       freq = newfreq;
       return true;
     }
+    // Run the envelopes, LFOs, gain, pitch and low-pass filter in fixed point instead of (emulated on
+    // the ESP8266 and, for double, the ESP32) floating point.  Close to, but not the same output as
+    // the default renderer, which skips the low-pass filter.
+    bool SetFixedPoint(bool fixed) {
+      if (isRunning()) return false;
+      fixedPoint = fixed;
+      return true;
+    }
+    // Most voices to sound at once, 0 (the default) for as many as the notes need.  Past it the
+    // quietest voice, releasing ones first, is faded out quickly to make room for a new one.
+    bool SetMaxVoices(int voices) {
+      maxVoices = (voices > 0) ? voices : 0;
+      if (isRunning()) tsf_set_max_voices(g_tsf, maxVoices);
+      return true;
+    }
+    // Percent of the real time a block plays for that rendering it may take, 0 (the default) for no
+    // limit.  The time per voice is measured as it plays, and the voice limit lowered to fit.
+    bool SetCpuBudget(int percent) {
+      cpuBudget = (percent > 0) ? percent : 0;
+      voiceCost = 0;
+      if (isRunning() && !cpuBudget) tsf_set_max_voices(g_tsf, maxVoices);
+      return true;
+    }
     virtual bool begin(AudioFileSource *mid, AudioOutput *output) override;
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override { return running; };
 
+    // The tracks are merged into a score at begin(), so the length is known and seeking just walks
+    // through it.  Notes still held at the seek point are struck again.
+    uint32_t GetDurationMs();
+    uint32_t GetPositionMs();
+    bool SeekMs(uint32_t ms);
+
+    enum { STATUS_NOTESSKIPPED=2, STATUS_VOICESSTOLEN };
+
   private:
     int freq;
+    bool fixedPoint;
+    int maxVoices;
+    int cpuBudget;
+    uint32_t voiceCost;             // Smoothed render time of a voice-sample, in 1/65536 us
+    int voicesStolenReported;
     tsf *g_tsf;
     struct tsf_stream buffer;
     struct tsf_stream afsMIDI;
@@ -87,7 +123,7 @@ class AudioGeneratorMIDI : public AudioGenerator
     unsigned int ticks_per_beat = 240;
     unsigned long timenow = 0;
     unsigned long tempo;            /* current tempo in usec/qnote */
-    // State needed for PlayMID()
+    // State needed for CompileMIDI()
     int notes_skipped = 0;
     int tracknum = 0;
     int earliest_tracknum = 0;
@@ -97,7 +133,7 @@ class AudioGeneratorMIDI : public AudioGenerator
       bool playing;                /* is it playing? */
       char track;                   /* if so, which track is the note from? */
       char note;                    /* what note is playing? */
-      char instrument;              /* what instrument? */
+      short instrument;             /* what instrument (preset index)? */
     } tonegen[MAX_TONEGENS];
 
     struct track_status {           /* current processing point of a MIDI track */
@@ -115,6 +151,17 @@ class AudioGeneratorMIDI : public AudioGenerator
     } track[MAX_TRACKS];
 
     int midi_chan_instrument[16];   /* which instrument is currently being played on each channel */
+    int midi_chan_bank[16];         /* and which bank its next program change picks from */
+
+    /* the score: for each event the samples since the one before (variable-length), the key with
+       0x80 set for a note on, the preset (variable-length), and for note ons the velocity */
+    uint8_t *score;
+    int scoreSize;
+    int scoreLen;
+    int scorePtr;                   /* past the time of the next event to play */
+    uint32_t scoreNow;              /* samples into the score PlayMIDI() has got to */
+    uint32_t scoreNext;             /* when the event at scorePtr is */
+    uint32_t scoreEnd;              /* when the last one is */
 
     /* output bytestream commands, which are also stored in track_status.cmd */
     enum { CMD_PLAYNOTE   = 0x90,    /* play a note: low nibble is generator #, note is next byte */
@@ -160,9 +207,15 @@ class AudioGeneratorMIDI : public AudioGenerator
 
     unsigned long get_varlen (int *ptr);
     void find_note (int tracknum);
+    int preset_index (int chan, int program);
     void PrepareMIDI(AudioFileSource *src);
+    void CompileMIDI();
+    void AddEvent(uint32_t time, int key, int preset, int velocity);
+    uint32_t GetVarlen();
+    void NextEvent();
     int PlayMIDI();
     void StopMIDI();
+    void Budget(uint32_t us, int voices, int samples);
 
     // tsf_stream <-> AudioFileSource
     static int afs_read(void *data, void *ptr, unsigned int size);
@@ -175,9 +228,11 @@ class AudioGeneratorMIDI : public AudioGenerator
 
     int samplesToPlay;
     bool sawEOF;
+    enum { RENDER_SAMPLES = 256 };
+    bool mono;
     int numSamplesRendered;
-    int sentSamplesRendered ;
-    short samplesRendered[256];
+    int sentSamplesRendered;
+    short samplesRendered[2 * RENDER_SAMPLES]; // Interleaved stereo
 };
 
 #endif //__GNUC__ == 8
@@ -47,7 +47,12 @@ AudioGeneratorMOD::AudioGeneratorMOD()
   fatBufferSize = 6 * 1024;
   stereoSeparation = 32;
   mixerTick = 0;
+  blockLen = 0;
+  blockPos = 0;
   usePAL = false;
+  preload = true;
+  bank = NULL;
+  for (int i = 0; i < CHANNELS; i++) FatBuffer.channels[i] = NULL;
   UpdateAmiga();
   running = false;
   file = NULL;
@@ -58,8 +63,10 @@ AudioGeneratorMOD::~AudioGeneratorMOD()
 {
   // Free any remaining buffers
   for (int i = 0; i < CHANNELS; i++) {
+    free(FatBuffer.channels[i]);
     FatBuffer.channels[i] = NULL;
   }
+  free(bank);
 }
 
 bool AudioGeneratorMOD::stop()
@@ -69,6 +76,8 @@ bool AudioGeneratorMOD::stop()
     free(FatBuffer.channels[i]);
     FatBuffer.channels[i] = NULL;
   }
+  free(bank);
+  bank = NULL;
 
   if(running || ((file != NULL) && (file->isOpen() == true))) {
 	output->flush();  //flush I2S output buffer, if the player was actually running before.
@@ -84,28 +93,33 @@ bool AudioGeneratorMOD::loop()
 {
   if (!running) goto done; // Easy-peasy
 
-  // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // FIFO full, wait...
-
-  // Now advance enough times to fill the i2s buffer
+  // Hand the output whole mixed blocks, stopping when it won't take any more
   do {
-    if (mixerTick == 0) {
-      running = RunPlayer();
-      if (!running) {
-        stop();
-        goto done;
+    if (blockPos < blockLen) {
+      blockPos += output->ConsumeSamples(block + 2 * blockPos, blockLen - blockPos);
+      if (blockPos < blockLen) break; // FIFO full, wait...
+    } else {
+      if (mixerTick == 0) {
+        running = RunPlayer();
+        if (!running) {
+          stop();
+          goto done;
+        }
+        mixerTick = Player.samplesPerTick;
       }
-      mixerTick = Player.samplesPerTick;
+      int count = min(mixerTick, (int)MIXBLOCK);
+      if (!MixBlock(count)) goto done;
+      mixerTick -= count;
+      blockPos = 0;
+      blockLen = count;
     }
-    GetSample( lastSample );
-    mixerTick--;
-  } while (output->ConsumeSample(lastSample));
+  } while (running);
 
 done:
   file->loop();
   output->loop();
 
-  // We'll be left with one sample still in our buffer because it couldn't fit in the FIFO
+  // We may be left with part of a block because it couldn't fit in the FIFO
   return running;
 }
 
@@ -127,18 +141,27 @@ bool AudioGeneratorMOD::begin(AudioFileSource *source, AudioOutput *out)
   if (!output->begin()) return false;
 
   UpdateAmiga();
+  mixerTick = 0;
+  blockLen = 0;
+  blockPos = 0;
 
-  for (int i = 0; i < CHANNELS; i++) {
-    FatBuffer.channels[i] = reinterpret_cast<uint8_t*>(calloc(fatBufferSize, 1));
-    if (!FatBuffer.channels[i]) {
-      stop();
-      return false;
-    }
-  }
   if (!LoadMOD()) {
     stop();
     return false;
   }
+  if (preload) LoadBank();
+  if (bank) {
+    cb.st(STATUS_PRELOADED, PSTR("Samples preloaded to RAM"));
+  } else {
+    for (int i = 0; i < CHANNELS; i++) {
+      FatBuffer.channels[i] = reinterpret_cast<uint8_t*>(calloc(fatBufferSize, 1));
+      if (!FatBuffer.channels[i]) {
+        stop();
+        return false;
+      }
+    }
+    cb.st(STATUS_STREAMING, PSTR("Samples streamed from file"));
+  }
   running = true;
   return true;
 }
@@ -272,6 +295,55 @@ void AudioGeneratorMOD::LoadSamples()
 
 }
 
+// Allocate the bank for all the sample data: from PSRAM when there is some, else from the heap when
+// that leaves enough of it for everything else
+static uint8_t *AllocBank(uint32_t size)
+{
+#ifdef ESP32
+  if (psramFound()) {
+    uint8_t *p = reinterpret_cast<uint8_t*>(ps_malloc(size));
+    if (p) return p;
+  }
+#endif
+  uint8_t *p = reinterpret_cast<uint8_t*>(malloc(size));
+#if defined(ESP8266) || defined(ESP32)
+  if (p && (ESP.getFreeHeap() < BANK_HEAP_RESERVE)) {
+    free(p);
+    p = NULL;
+  }
+#endif
+  return p;
+}
+
+// Read everything from the first sample on into memory, so mixing never has to go back to the file.
+// Leaves bank NULL, to stream the samples through the per-channel windows, if it doesn't fit.
+void AudioGeneratorMOD::LoadBank()
+{
+  uint32_t size = file->getSize();
+  int first = 0;
+  while ((first < SAMPLES) && !Mod.samples[first].length) first++;
+  if (first == SAMPLES) return;
+  bankOffset = Mixer.sampleBegin[first];
+  if (size <= bankOffset) return;
+  bankLen = size - bankOffset;
+  bank = AllocBank(bankLen + 1); // And a zero past the end for interpolating the last sample
+  if (!bank) return;
+  uint32_t got = 0;
+  if (file->seek(bankOffset, SEEK_SET)) {
+    while (got < bankLen) {
+      uint32_t len = file->read(bank + got, bankLen - got);
+      if (!len) break;
+      got += len;
+    }
+  }
+  if (got < bankLen) {
+    free(bank);
+    bank = NULL;
+    return;
+  }
+  bank[bankLen] = 0;
+}
+
 bool AudioGeneratorMOD::LoadPattern(uint8_t pattern)
 {
   uint8_t row;
@@ -743,120 +815,135 @@ bool AudioGeneratorMOD::RunPlayer()
   return true;
 }
 
-void AudioGeneratorMOD::GetSample(int16_t sample[2])
+// Move channel's window of the sample data in the file to start at samplePointer
+bool AudioGeneratorMOD::FillWindow(uint8_t channel, uint32_t samplePointer)
 {
-  int32_t sumL;
-  int32_t sumR;
-  uint8_t channel;
-  uint32_t samplePointer;
-  int8_t current;
-  int8_t next;
-  int16_t out;
-  int32_t out32;
+  uint32_t toRead = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]] - samplePointer + 1;
+  if (toRead > (uint32_t)fatBufferSize) toRead  = fatBufferSize;
 
-  if (!running) return;
+  if (!file->seek(samplePointer, SEEK_SET)) return false;
+  if (toRead != file->read(FatBuffer.channels[channel], toRead)) return false;
 
-  sumL = 0;
-  sumR = 0;
-  for (channel = 0; channel < Mod.numberOfChannels; channel++) {
-
-    if (!Mixer.channelFrequency[channel] ||
-        !Mod.samples[Mixer.channelSampleNumber[channel]].length) continue;
-
-    Mixer.channelSampleOffset[channel] += Mixer.channelFrequency[channel];
-
-    if (!Mixer.channelVolume[channel]) continue;
+  FatBuffer.samplePointer[channel] = samplePointer;
+  FatBuffer.channelSampleNumber[channel] = Mixer.channelSampleNumber[channel];
+  return true;
+}
 
-    samplePointer = Mixer.sampleBegin[Mixer.channelSampleNumber[channel]] +
-                    (Mixer.channelSampleOffset[channel] >> FIXED_DIVIDER);
+// Mix the next count samples of the tick into block.  Only the player changes the channels' frequency,
+// volume and panning, so each channel's span is mixed in a tight loop, stepping one sample at a time
+// only where it loops, ends, or runs out of its window of the file.
+bool AudioGeneratorMOD::MixBlock(int count)
+{
+  if (!running) return false;
 
-    if (Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]]) {
+  memset(mix, 0, 2 * count * sizeof(mix[0]));
+  for (uint8_t channel = 0; channel < Mod.numberOfChannels; channel++) {
+    uint8_t sampleNumber = Mixer.channelSampleNumber[channel];
+    uint32_t frequency = Mixer.channelFrequency[channel];
+    uint32_t offset = Mixer.channelSampleOffset[channel];
+    int32_t volume = Mixer.channelVolume[channel];
+
+    if (!frequency || !Mod.samples[sampleNumber].length) continue;
+    if (!volume) {
+      Mixer.channelSampleOffset[channel] = offset + frequency * count;
+      continue;
+    }
 
-      if (samplePointer >= Mixer.sampleLoopEnd[Mixer.channelSampleNumber[channel]]) {
-        Mixer.channelSampleOffset[channel] -= Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]] << FIXED_DIVIDER;
-        samplePointer -= Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]];
+    uint32_t sampleBegin = Mixer.sampleBegin[sampleNumber];
+    uint32_t sampleEnd = Mixer.sampleLoopLength[sampleNumber] ? Mixer.sampleLoopEnd[sampleNumber] : Mixer.sampleEnd[sampleNumber];
+    uint32_t loopLength = Mixer.sampleLoopLength[sampleNumber];
+    int32_t panL = min(128 - Mixer.channelPanning[channel], 64);
+    int32_t panR = min(Mixer.channelPanning[channel], 64);
+    int32_t *bus = mix;
+    int32_t *busEnd = mix + 2 * count;
+
+    while (bus < busEnd) {
+      // One sample the careful way, looping or ending the sample and moving the window as needed
+      offset += frequency;
+      uint32_t samplePointer = sampleBegin + (offset >> FIXED_DIVIDER);
+      if (samplePointer >= sampleEnd) {
+        if (loopLength) {
+          offset -= loopLength << FIXED_DIVIDER;
+          samplePointer -= loopLength;
+        } else {
+          frequency = 0;
+          samplePointer = sampleEnd;
+        }
       }
-
-    } else {
-
-      if (samplePointer >= Mixer.sampleEnd[Mixer.channelSampleNumber[channel]]) {
-        Mixer.channelFrequency[channel] = 0;
-        samplePointer = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]];
+      const int8_t *window;
+      uint32_t windowStart, windowLast;
+      if (bank) {
+        if (samplePointer - bankOffset >= bankLen) { // Only a corrupt file gets past the end
+          stop();
+          return false;
+        }
+        window = reinterpret_cast<const int8_t*>(bank);
+        windowStart = bankOffset;
+        windowLast = bankOffset + bankLen;
+      } else {
+        if (samplePointer < FatBuffer.samplePointer[channel] ||
+            samplePointer >= FatBuffer.samplePointer[channel] + fatBufferSize - 1 ||
+            sampleNumber != FatBuffer.channelSampleNumber[channel]) {
+          if (!FillWindow(channel, samplePointer)) {
+            stop();
+            return false;
+          }
+        }
+        window = reinterpret_cast<const int8_t*>(FatBuffer.channels[channel]);
+        windowStart = FatBuffer.samplePointer[channel];
+        windowLast = windowStart + fatBufferSize - 1;
       }
 
-    }
-
-    if (samplePointer < FatBuffer.samplePointer[channel] ||
-        samplePointer >= FatBuffer.samplePointer[channel] + fatBufferSize - 1 ||
-        Mixer.channelSampleNumber[channel] != FatBuffer.channelSampleNumber[channel]) {
-
-      uint32_t toRead = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]] - samplePointer + 1;
-      if (toRead > (uint32_t)fatBufferSize) toRead  = fatBufferSize;
-
-      if (!file->seek(samplePointer, SEEK_SET)) {
-        stop();
-        return;
+      // Then as far as possible without either: while the position stays below the end of the
+      // sample or loop and of the window, which it can't be before the start of
+      uint32_t windowBegin = windowStart - sampleBegin;
+      uint32_t limit = min(sampleEnd, windowLast) - sampleBegin;
+      int32_t *spanEnd = bus + 2;
+      if (frequency && ((limit << FIXED_DIVIDER) > offset + frequency)) {
+        uint32_t steps = ((limit << FIXED_DIVIDER) - 1 - offset) / frequency;
+        if (steps > (uint32_t)(busEnd - spanEnd) / 2) steps = (busEnd - spanEnd) / 2;
+        spanEnd += 2 * steps;
       }
-      if (toRead != file->read(FatBuffer.channels[channel], toRead)) {
-        stop();
-        return;
+      uint32_t i = samplePointer - windowStart;
+      while (true) {
+        // preserve a few more bits from sample interpolation, by upscaling input values.
+        // This does (slightly) reduce quantization noise in higher frequencies, typically above 8kHz.
+        int16_t current16 = (int16_t) window[i] << 2;
+        int16_t next16    = (int16_t) window[i + 1] << 2;
+        // Integer linear interpolation - only works correctly in 16bit
+        int16_t out = current16 + ((next16 - current16) * (offset & ((1 << FIXED_DIVIDER) - 1)) >> FIXED_DIVIDER);
+        // Upscale to BITDEPTH, considering the we already gained two bits in the previous step
+        int32_t out32 = (int32_t)out << (BITDEPTH - 10);
+        out32 = out32 * volume >> 6;
+        bus[0] += out32 * panL >> 6;
+        bus[1] += out32 * panR >> 6;
+        bus += 2;
+        if (bus >= spanEnd) break;
+        offset += frequency;
+        i = (offset >> FIXED_DIVIDER) - windowBegin;
       }
-
-      FatBuffer.samplePointer[channel] = samplePointer;
-      FatBuffer.channelSampleNumber[channel] = Mixer.channelSampleNumber[channel];
+      if (!frequency) break;
     }
-
-    current = FatBuffer.channels[channel][(samplePointer - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
-    next = FatBuffer.channels[channel][(samplePointer + 1 - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
-	
-	// preserve a few more bits from sample interpolation, by upscaling input values.
-	// This does (slightly) reduce quantization noise in higher frequencies, typically above 8kHz.
-	// Actually we could could even gain more bits, I was just not sure if more bits would cause overflows in other conputations.
-    int16_t current16 = (int16_t) current << 2;
-    int16_t next16    = (int16_t) next << 2;	  
-	  
-    out = current16;
-
-    // Integer linear interpolation - only works correctly in 16bit
-    out += (next16 - current16) * (Mixer.channelSampleOffset[channel] & ((1 << FIXED_DIVIDER) - 1)) >> FIXED_DIVIDER;
-
-    // Upscale to BITDEPTH, considering the we already gained two bits in the previous step
-    out32 = (int32_t)out << (BITDEPTH - 10);
-
-    // Channel volume
-    out32 = out32 * Mixer.channelVolume[channel] >> 6;
-
-    // Channel panning
-    sumL += out32 * min(128 - Mixer.channelPanning[channel], 64) >> 6;
-    sumR += out32 * min(Mixer.channelPanning[channel], 64) >> 6;
+    Mixer.channelSampleOffset[channel] = offset;
+    Mixer.channelFrequency[channel] = frequency;
   }
 
-  // Downscale to BITDEPTH - a bit faster because the compiler can replaced division by constants with proper "right shift" + correct handling of sign bit
-  if (Mod.numberOfChannels <= 4) {
-      // up to 4 channels
-      sumL /= 4;
-      sumR /= 4;
-  } else {
-    if (Mod.numberOfChannels <= 6) {
-      // 5 or 6 channels - pre-multiply be 1.5, then divide by 8 -> same as division by 6
-      sumL = (sumL + (sumL/2)) / 8;
-      sumR = (sumR + (sumR/2)) / 8;      
+  for (int i = 0; i < 2 * count; i++) {
+    int32_t sum = mix[i];
+    // Downscale to BITDEPTH - a bit faster because the compiler can replaced division by constants with proper "right shift" + correct handling of sign bit
+    if (Mod.numberOfChannels <= 4) {
+      sum /= 4; // up to 4 channels
+    } else if (Mod.numberOfChannels <= 6) {
+      sum = (sum + (sum/2)) / 8; // 5 or 6 channels - pre-multiply be 1.5, then divide by 8 -> same as division by 6
     } else {
-      // 7,8, or more channels
-      sumL /= 8;
-      sumR /= 8;
+      sum /= 8; // 7,8, or more channels
     }
+    // clip samples to 16bit (with saturation in case of overflow)
+    if (sum <= INT16_MIN) sum = INT16_MIN;
+    else if (sum >= INT16_MAX) sum = INT16_MAX;
+    block[i] = sum;
   }
-
-  // clip samples to 16bit (with saturation in case of overflow)
-  if(sumL <= INT16_MIN) sumL = INT16_MIN;
-    else if (sumL >= INT16_MAX) sumL = INT16_MAX;
-  if(sumR <= INT16_MIN) sumR = INT16_MIN;
-    else if (sumR >= INT16_MAX) sumR = INT16_MAX;
-  
-  // Fill the sound buffer with signed values
-  sample[AudioOutput::LEFTCHANNEL] = sumL;
-  sample[AudioOutput::RIGHTCHANNEL] = sumR;
+  return true;
 }
 
 bool AudioGeneratorMOD::LoadMOD()
@@ -36,13 +36,21 @@ class AudioGeneratorMOD : public AudioGenerator
     bool SetBufferSize(int sz) { if (running || (sz < 1) ) return false; fatBufferSize = sz; return true; }
     bool SetStereoSeparation(int sep) { if (running || (sep<0) || (sep>64)) return false; stereoSeparation = sep; return true; }
     bool SetPAL(bool use) { if (running) return false; usePAL = use; return true; }
+    // Read all the sample data into (PS)RAM at begin() when it fits, instead of streaming it from the
+    // file through a window per channel.  On by default, SamplesPreloaded() tells which it got.
+    bool SetPreload(bool use) { if (running) return false; preload = use; return true; }
+    bool SamplesPreloaded() { return bank != NULL; }
+
+    enum { STATUS_PRELOADED=2, STATUS_STREAMING };
 
   protected:
     bool LoadMOD();
     bool LoadHeader();
-    void GetSample(int16_t sample[2]);
+    bool MixBlock(int count);
+    bool FillWindow(uint8_t channel, uint32_t samplePointer);
     bool RunPlayer();
     void LoadSamples();
+    void LoadBank();
     bool LoadPattern(uint8_t pattern);
     bool ProcessTick();
     bool ProcessRow();
@@ -53,12 +61,23 @@ class AudioGeneratorMOD : public AudioGenerator
 
   protected:
     int mixerTick;
+    // Ticks are mixed a block at a time, each channel's whole span in one go, into a 32-bit stereo bus
+    enum {MIXBLOCK = 128};
+    int32_t mix[2 * MIXBLOCK];
+    int16_t block[2 * MIXBLOCK];
+    int blockLen;
+    int blockPos;
     enum {BITDEPTH = 16};
     int sampleRate; 
     int fatBufferSize; //(6*1024) // File system buffers per-CHANNEL (i.e. total mem required is 4 * FATBUFFERSIZE)
     enum {FIXED_DIVIDER = 10};             // Fixed-point mantissa used for integer arithmetic
     int stereoSeparation; //STEREOSEPARATION = 32;    // 0 (max) to 64 (mono)
     bool usePAL;
+    bool preload;
+    uint8_t *bank;      // All the sample data, from file offset bankOffset on, when preloaded
+    uint32_t bankOffset;
+    uint32_t bankLen;
+    enum {BANK_HEAP_RESERVE = 16 * 1024}; // Heap to leave free when preloading into it
     
     // Hz = 7093789 / (amigaPeriod * 2) for PAL
     // Hz = 7159091 / (amigaPeriod * 2) for NTSC
@@ -29,6 +29,7 @@ AudioGeneratorMP3::AudioGeneratorMP3()
   buff = NULL;
   nsCountMax = 1152/32;
   madInitted = false;
+  pcmFrame = NULL;
 }
 
 AudioGeneratorMP3::AudioGeneratorMP3(void *space, int size): preallocateSpace(space), preallocateSize(size)
@@ -39,6 +40,7 @@ AudioGeneratorMP3::AudioGeneratorMP3(void *space, int size): preallocateSpace(sp
   buff = NULL;
   nsCountMax = 1152/32;
   madInitted = false;
+  pcmFrame = NULL;
 }
 
 AudioGeneratorMP3::AudioGeneratorMP3(void *buff, int buffSize, void *stream, int streamSize, void *frame, int frameSize, void *synth, int synthSize):
@@ -53,6 +55,7 @@ AudioGeneratorMP3::AudioGeneratorMP3(void *buff, int buffSize, void *stream, int
   buff = NULL;
   nsCountMax = 1152/32;
   madInitted = false;
+  pcmFrame = NULL;
 }
 
 AudioGeneratorMP3::~AudioGeneratorMP3()
@@ -62,6 +65,7 @@ AudioGeneratorMP3::~AudioGeneratorMP3()
     free(synth);
     free(frame);
     free(stream);
+    free(pcmFrame);
   } 
 }
 
@@ -80,18 +84,89 @@ bool AudioGeneratorMP3::stop()
     free(synth);
     free(frame);
     free(stream);
+    free(pcmFrame);
   }
 
   buff = NULL;
   synth = NULL;
   frame = NULL;
   stream = NULL;
+  pcmFrame = NULL;
 
   running = false;
   output->stop();
   return file->close();
 }
 
+bool AudioGeneratorMP3::SetChannelMode(int mode)
+{
+  if ((mode < CHANNELS_AUTO) || (mode > CHANNELS_MONO)) return false;
+  channelMode = mode;
+  ApplyOptions();
+  return true;
+}
+
+bool AudioGeneratorMP3::SetHalfRate(bool half)
+{
+  halfRate = half;
+  ApplyOptions();
+  return true;
+}
+
+// libmad picks the options up from the stream on every frame, so this works mid-song too
+void AudioGeneratorMP3::ApplyOptions()
+{
+  if (!madInitted) return;
+
+  int mode = channelMode;
+  if (mode == CHANNELS_AUTO) {
+    mode = output->WantsMono() ? CHANNELS_MONO : CHANNELS_STEREO;
+  }
+
+  int options = 0;
+  switch (mode) {
+    case CHANNELS_LEFT: options = MAD_OPTION_LEFTCHANNEL; break;
+    case CHANNELS_RIGHT: options = MAD_OPTION_RIGHTCHANNEL; break;
+    case CHANNELS_MONO: options = MAD_OPTION_SINGLECHANNEL; break;
+    default: break;
+  }
+  if (halfRate) options |= MAD_OPTION_HALFSAMPLERATE;
+  mad_stream_options(stream, options);
+}
+
+uint32_t AudioGeneratorMP3::GetDurationMs()
+{
+  return file ? info.DurationMs(file->getSize()) : 0;
+}
+
+uint32_t AudioGeneratorMP3::GetPositionMs()
+{
+  return info.IsValid() ? info.MsForSample(sampleIndex << (halfRate ? 1 : 0)) : 0;
+}
+
+bool AudioGeneratorMP3::SeekMs(uint32_t ms)
+{
+  if (!running || !info.IsValid()) return false;
+  if (!file->seek(info.OffsetForMs(ms, file->getSize()), SEEK_SET)) return false;
+
+  // Drop everything buffered and decoded, libmad finds the next frame on its own
+  stream->next_frame = NULL;
+  stream->this_frame = NULL;
+  stream->sync = 0;
+  stream->md_len = 0;
+  lastBuffLen = 0;
+  guarded = false;
+  mad_frame_mute(frame);
+  mad_synth_mute(synth);
+  synth->pcm.length = 0;
+  samplePtr = 9999;
+  nsCount = 9999;
+  pcmLen = 0;
+  sampleIndex = info.SampleForMs(ms) >> (halfRate ? 1 : 0);
+  resync = true;
+  return true;
+}
+
 bool AudioGeneratorMP3::isRunning()
 {
   return running;
@@ -104,6 +179,8 @@ enum mad_flow AudioGeneratorMP3::ErrorToFlow()
 
   // Special case - eat "lost sync @ byte 0" as it always occurs and is not really correct....it never had sync!
   if ((lastReadPos==0) && (stream->error==MAD_ERROR_LOSTSYNC)) return MAD_FLOW_CONTINUE;
+  // Same when landing in the middle of a frame after a seek, and its bit reservoir is gone, too
+  if (resync && ((stream->error==MAD_ERROR_LOSTSYNC) || (stream->error==MAD_ERROR_BADDATAPTR))) return MAD_FLOW_CONTINUE;
 
   strcpy_P(err, mad_stream_errorstr(stream));
   snprintf_P(errLine, sizeof(errLine), PSTR("Decoding error '%s' at byte offset %d"),
@@ -133,9 +210,16 @@ enum mad_flow AudioGeneratorMP3::Input()
     unused = 0;
   }
 
-  lastReadPos = file->getPos() - unused;
+  lastReadPos = file->getReadPos() - unused;
   int len = buffLen - unused;
   len = file->read(buff + unused, len);
+  if ((len == 0) && unused && !guarded && (unused + MAD_BUFFER_GUARD <= buffLen)) {
+    // libmad won't decode a frame without MAD_BUFFER_GUARD bytes after it, so the last one
+    // would be lost along with its share of the gapless trim
+    memset(buff + unused, 0, MAD_BUFFER_GUARD);
+    len = MAD_BUFFER_GUARD;
+    guarded = true;
+  }
   if ((len == 0)  && (unused == 0)) {
     // Can't read any from the file, and we don't have anything left.  It's done....
     return MAD_FLOW_STOP;
@@ -172,7 +256,42 @@ bool AudioGeneratorMP3::DecodeNextFrame()
   return true;
 }
 
-bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
+// Read and decode the next good frame, false when the stream is done
+bool AudioGeneratorMP3::ReadNextFrame()
+{
+retry:
+  if (Input() == MAD_FLOW_STOP) {
+    return false;
+  }
+
+  if (!DecodeNextFrame()) {
+    if (stream->error == MAD_ERROR_BUFLEN) {
+      // randomly seeking can lead to endless
+      // and unrecoverable "MAD_ERROR_BUFLEN" loop
+      audioLogger->printf_P(PSTR("MP3:ERROR_BUFLEN %d\n"), unrecoverable);
+      if (++unrecoverable >= 3) {
+        unrecoverable = 0;
+        stop();
+        return false;
+      }
+    } else {
+      unrecoverable = 0;
+    }
+    goto retry;
+  }
+  resync = false;
+
+  if (!infoChecked) {
+    // The first frame may be a Xing/VBRI tag with no audio in it
+    infoChecked = true;
+    if (info.Parse(stream->this_frame, stream->next_frame - stream->this_frame, lastReadPos + (stream->this_frame - buff))) {
+      goto retry;
+    }
+  }
+  return true;
+}
+
+void AudioGeneratorMP3::UpdateFormat()
 {
   if (synth->pcm.samplerate != lastRate) {
     output->SetRate(synth->pcm.samplerate);
@@ -182,11 +301,14 @@ bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
     output->SetChannels(synth->pcm.channels);
     lastChannels = synth->pcm.channels;
   }
-    
+}
+
+bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
+{
   // If we're here, we have one decoded frame and sent 0 or more samples out
   if (samplePtr < synth->pcm.length) {
     sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
+    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[(synth->pcm.channels == 2) ? 1 : 0][samplePtr];
     samplePtr++;
   } else {
     samplePtr = 0;
@@ -198,19 +320,89 @@ bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
         default:
           break; // Do nothing
     }
+    UpdateFormat();
     // for IGNORE and CONTINUE, just play what we have now
     sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
+    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[(synth->pcm.channels == 2) ? 1 : 0][samplePtr];
     samplePtr++;
   }
   return true;
 }
 
+// libmad hands us each 32-sample slot of the frame, interleave it into pcmFrame
+enum mad_flow AudioGeneratorMP3::PCMOut(void *data, struct mad_header const *header, struct mad_pcm *pcm)
+{
+  (void) header;
+  AudioGeneratorMP3 *p = static_cast<AudioGeneratorMP3*>(data);
+  if (p->pcmLen + pcm->length > maxFrameSamples) return MAD_FLOW_BREAK;
+  int16_t *dest = p->pcmFrame + p->pcmLen * 2;
+  const int16_t *l = pcm->samples[0];
+  const int16_t *r = pcm->samples[(pcm->channels == 2) ? 1 : 0];
+  for (int i = 0; i < pcm->length; i++) {
+    *(dest++) = l[i];
+    *(dest++) = r[i];
+  }
+  p->pcmLen += pcm->length;
+  return MAD_FLOW_CONTINUE;
+}
+
+bool AudioGeneratorMP3::SynthFrame()
+{
+  pcmLen = 0;
+  samplePtr = 0;
+  enum mad_flow ret = mad_synth_frame(synth, frame, PCMOut, this);
+  if ((ret == MAD_FLOW_STOP) || (ret == MAD_FLOW_BREAK)) {
+    audioLogger->printf_P(PSTR("msf failed\n"));
+    return false;
+  }
+  UpdateFormat();
+
+  // Gapless, only play what lies between the encoder delay and padding
+  int first, end;
+  if (!info.Clip(sampleIndex, pcmLen, halfRate ? 1 : 0, &first, &end)) {
+    return false;
+  }
+  sampleIndex += pcmLen;
+  samplePtr = first;
+  pcmLen = end;
+  return true;
+}
+
+// Per-slot mode's gapless trimming, true if the sample just decoded is to be thrown away
+bool AudioGeneratorMP3::DropSample()
+{
+  int first, end;
+  if (!info.Clip(sampleIndex++, 1, halfRate ? 1 : 0, &first, &end)) {
+    running = false;
+  }
+  return first == end;
+}
+
+// Full-frame mode, no per-sample work at all: decode, synth and push the block
+bool AudioGeneratorMP3::LoopFullFrame()
+{
+  do {
+    if (samplePtr >= pcmLen) {
+      if (!ReadNextFrame()) return false;
+      if (!SynthFrame()) {
+        running = false;
+        return false;
+      }
+    }
+    samplePtr += output->ConsumeSamples(pcmFrame + samplePtr * 2, pcmLen - samplePtr);
+  } while (running && (samplePtr >= pcmLen));
+  return true;
+}
 
 bool AudioGeneratorMP3::loop()
 {
   if (!running) goto done; // Nothing to do here!
 
+  if (pcmFrame) {
+    if (!LoopFullFrame()) return false;
+    goto done;
+  }
+
   // First, try and push in the stored sample.  If we can't, then punt and try later
   if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
 
@@ -219,26 +411,9 @@ bool AudioGeneratorMP3::loop()
   {
     // Decode next frame if we're beyond the existing generated data
     if ( (samplePtr >= synth->pcm.length) && (nsCount >= nsCountMax) ) {
-retry:
-      if (Input() == MAD_FLOW_STOP) {
+      if (!ReadNextFrame()) {
         return false;
       }
-
-      if (!DecodeNextFrame()) {
-        if (stream->error == MAD_ERROR_BUFLEN) {
-          // randomly seeking can lead to endless
-          // and unrecoverable "MAD_ERROR_BUFLEN" loop
-          audioLogger->printf_P(PSTR("MP3:ERROR_BUFLEN %d\n"), unrecoverable);
-          if (++unrecoverable >= 3) {
-            unrecoverable = 0;
-            stop();
-            return running;
-          }
-        } else {
-          unrecoverable = 0;
-        }
-        goto retry;
-      }
       samplePtr = 9999;
       nsCount = 0;
     }
@@ -248,7 +423,7 @@ retry:
       running = false;
       goto done;
     }
-  } while (running && output->ConsumeSample(lastSample));
+  } while (running && (DropSample() ? running : output->ConsumeSample(lastSample)));
 
 done:
   file->loop();
@@ -285,6 +460,13 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
   lastChannels = 0;
   lastReadPos = 0;
   lastBuffLen = 0;
+  guarded = false;
+  pcmFrame = NULL;
+  pcmLen = 0;
+  info.Reset();
+  infoChecked = false;
+  sampleIndex = 0;
+  resync = false;
 
   // Allocate all large memory chunks
   if (preallocateStreamSize + preallocateFrameSize + preallocateSynthSize) {
@@ -296,6 +478,9 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
       stream = reinterpret_cast<struct mad_stream *>(preallocateStreamSpace);
       frame = reinterpret_cast<struct mad_frame *>(preallocateFrameSpace);
       synth = reinterpret_cast<struct mad_synth *>(preallocateSynthSpace);
+      if (fullFrameSynth && (preallocateSynthSize >= preAllocSynthSize(true))) {
+        pcmFrame = reinterpret_cast<int16_t *>(reinterpret_cast<uint8_t *>(preallocateSynthSpace) + preAllocSynthSize());
+      }
     }
     else {
       audioLogger->printf_P("OOM error in MP3:  Want %d/%d/%d/%d bytes, have %d/%d/%d/%d bytes preallocated.\n",
@@ -318,6 +503,9 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
       audioLogger->printf_P("OOM error in MP3:  Want %d bytes, have %d bytes preallocated.\n", neededBytes, preallocateSize);
       return false;
     }
+    if (fullFrameSynth && (neededBytes + preAllocPCMSize() <= preallocateSize)) {
+      pcmFrame = reinterpret_cast<int16_t *>(p);
+    }
   } else {
     buff = reinterpret_cast<unsigned char *>(malloc(buffLen));
     stream = reinterpret_cast<struct mad_stream *>(malloc(sizeof(struct mad_stream)));
@@ -334,14 +522,17 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
       synth = NULL;
       return false;
     }
+    if (fullFrameSynth) {
+      pcmFrame = reinterpret_cast<int16_t *>(malloc(preAllocPCMSize())); // Per-slot synthesis if this fails
+    }
   }
  
   mad_stream_init(stream);
   mad_frame_init(frame);
   mad_synth_init(synth);
   synth->pcm.length = 0;
-  mad_stream_options(stream, 0); // TODO - add options support
   madInitted = true;
+  ApplyOptions();
  
   running = true;
   return true;
@@ -24,6 +24,7 @@
 #include "AudioGenerator.h"
 #include "libmad/config.h"
 #include "libmad/mad.h"
+#include "MP3StreamInfo.h"
 
 class AudioGeneratorMP3 : public AudioGenerator
 {
@@ -38,11 +39,33 @@ class AudioGeneratorMP3 : public AudioGenerator
     virtual bool isRunning() override;
     virtual void desync () override;
 
-    static constexpr int preAllocSize () { return preAllocBuffSize() + preAllocStreamSize() + preAllocFrameSize() + preAllocSynthSize(); }
+    // Full-frame synthesis needs an extra preAllocPCMSize() bytes, included when fullFrame is set.
+    // If the preallocated space is too small for it the decoder quietly uses per-slot synthesis.
+    static constexpr int preAllocSize (bool fullFrame = false) { return preAllocBuffSize() + preAllocStreamSize() + preAllocFrameSize() + preAllocSynthSize(fullFrame); }
     static constexpr int preAllocBuffSize () { return ((buffLen + 7) & ~7); }
     static constexpr int preAllocStreamSize () { return ((sizeof(struct mad_stream) + 7) & ~7); }
     static constexpr int preAllocFrameSize () { return (sizeof(struct mad_frame) + 7) & ~7; }
-    static constexpr int preAllocSynthSize () { return (sizeof(struct mad_synth) + 7) & ~7; }
+    static constexpr int preAllocSynthSize (bool fullFrame = false) { return ((sizeof(struct mad_synth) + 7) & ~7) + (fullFrame ? preAllocPCMSize() : 0); }
+    static constexpr int preAllocPCMSize () { return (maxFrameSamples * 2 * sizeof(int16_t) + 7) & ~7; }
+
+    // Synthesize whole 1152-sample frames at once and send them to the output as a block (default
+    // except on ESP8266), or one 32-sample subband slot at a time to save ~4.5KB of RAM.
+    // Takes effect on the next begin().
+    bool SetFullFrameSynth(bool full) { fullFrameSynth = full; return true; }
+
+    // Cheaper decoding of stereo streams for single-speaker setups: LEFT/RIGHT decode just that
+    // channel, MONO mixes both ahead of the IMDCT and synthesis.  AUTO (default) picks MONO when
+    // the output says WantsMono(), STEREO otherwise.
+    enum { CHANNELS_AUTO = 0, CHANNELS_STEREO, CHANNELS_LEFT, CHANNELS_RIGHT, CHANNELS_MONO };
+    bool SetChannelMode(int mode);
+    // Synthesize only the lower half of the spectrum, at half the sample rate
+    bool SetHalfRate(bool half);
+
+    // Length and position of the playable audio, 0 if unknown.  VBR files need a Xing or VBRI tag.
+    uint32_t GetDurationMs();
+    uint32_t GetPositionMs();
+    // Jump to a time with a single source seek (via the Xing/VBRI table of contents when present)
+    bool SeekMs(uint32_t ms);
 
   protected:   
     void *preallocateSpace = nullptr;
@@ -55,9 +78,11 @@ class AudioGeneratorMP3 : public AudioGenerator
     int preallocateSynthSize = 0;
 
     static constexpr int buffLen = 0x600; // Slightly larger than largest MP3 frame
+    static constexpr int maxFrameSamples = 1152;
     unsigned char *buff;
     int lastReadPos;
     int lastBuffLen;
+    bool guarded; // The zeros libmad needs after the last frame have been added
     unsigned int lastRate;
     int lastChannels;
     
@@ -69,12 +94,34 @@ class AudioGeneratorMP3 : public AudioGenerator
     int samplePtr;
     int nsCount;
     int nsCountMax;
+#ifdef ESP8266
+    bool fullFrameSynth = false;
+#else
+    bool fullFrameSynth = true;
+#endif
+    int16_t *pcmFrame; // Interleaved L/R for a whole frame, NULL in per-slot mode
+    int pcmLen;
+    int channelMode = CHANNELS_AUTO;
+    bool halfRate = false;
+
+    // First-frame tag info, for duration/seek and gapless trimming
+    MP3StreamInfo info;
+    bool infoChecked;
+    uint32_t sampleIndex; // Decoded samples since the start of the stream
+    bool resync; // Just seeked, sync/reservoir errors are expected
 
     // The internal helpers
     enum mad_flow ErrorToFlow();
     enum mad_flow Input();
     bool DecodeNextFrame();
+    bool ReadNextFrame();
+    void UpdateFormat();
     bool GetOneSample(int16_t sample[2]);
+    bool SynthFrame();
+    bool LoopFullFrame();
+    void ApplyOptions();
+    bool DropSample();
+    static enum mad_flow PCMOut(void *data, struct mad_header const *header, struct mad_pcm *pcm);
 
   private:
     int unrecoverable = 0;
@@ -22,8 +22,10 @@
 
 #include "AudioGeneratorMP3a.h"
 
+// Version, layer, protection and sample rate stay put for the whole stream
+static const uint8_t mp3FixedMask[4] = { 0xff, 0xff, 0x0c, 0x00 };
 
-AudioGeneratorMP3a::AudioGeneratorMP3a()
+AudioGeneratorMP3a::AudioGeneratorMP3a() : reader(1600, 1441, 4, mp3FixedMask, MP3StreamInfo::FrameBytes)
 {
   running = false;
   file = NULL;
@@ -36,12 +38,14 @@ AudioGeneratorMP3a::AudioGeneratorMP3a()
   // For sanity's sake...
   memset(buff, 0, sizeof(buff));
   memset(outSample, 0, sizeof(outSample));
-  buffValid = 0;
-  lastFrameEnd = 0;
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  channelMode = CHANNELS_AUTO;
+  infoChecked = false;
+  sampleIndex = 0;
+  resync = false;
 }
 
 AudioGeneratorMP3a::~AudioGeneratorMP3a()
@@ -62,33 +66,51 @@ bool AudioGeneratorMP3a::isRunning()
   return running;
 }
 
-bool AudioGeneratorMP3a::FillBufferWithValidFrame()
+bool AudioGeneratorMP3a::SetChannelMode(int mode)
 {
-  buff[0] = 0; // Destroy any existing sync word @ 0
-  int nextSync;
-  do {
-    nextSync = MP3FindSyncWord(buff + lastFrameEnd, buffValid - lastFrameEnd);
-    if (nextSync >= 0) nextSync += lastFrameEnd;
-    lastFrameEnd = 0;
-    if (nextSync == -1) {
-      if (buff[buffValid-1]==0xff) { // Could be 1st half of syncword, preserve it...
-        buff[0] = 0xff;
-        buffValid = file->read(buff+1, sizeof(buff)-1);
-        if (buffValid==0) return false; // No data available, EOF
-      } else { // Try a whole new buffer
-        buffValid = file->read(buff, sizeof(buff));
-        if (buffValid==0) return false; // No data available, EOF
-      }
-    }
-  } while (nextSync == -1);
+  if ((mode < CHANNELS_AUTO) || (mode > CHANNELS_MONO)) return false;
+  channelMode = mode;
+  if (output) ApplyOptions();
+  return true;
+}
 
-  // Move the frame to start at offset 0 in the buffer
-  buffValid -= nextSync; // Throw out prior to nextSync
-  memmove(buff, buff+nextSync, buffValid);
+void AudioGeneratorMP3a::ApplyOptions()
+{
+  int mode = channelMode;
+  if (mode == CHANNELS_AUTO) {
+    mode = output->WantsMono() ? CHANNELS_MONO : CHANNELS_STEREO;
+  }
 
-  // We have a sync word at 0 now, try and fill remainder of buffer
-  buffValid += file->read(buff + buffValid, sizeof(buff) - buffValid);
+  switch (mode) {
+    case CHANNELS_LEFT: MP3SetChannelMode(hMP3Decoder, MP3_CHANNELS_LEFT); break;
+    case CHANNELS_RIGHT: MP3SetChannelMode(hMP3Decoder, MP3_CHANNELS_RIGHT); break;
+    case CHANNELS_MONO: MP3SetChannelMode(hMP3Decoder, MP3_CHANNELS_MIX); break;
+    default: MP3SetChannelMode(hMP3Decoder, MP3_CHANNELS_STEREO); break;
+  }
+}
+
+uint32_t AudioGeneratorMP3a::GetDurationMs()
+{
+  return file ? info.DurationMs(file->getSize()) : 0;
+}
 
+uint32_t AudioGeneratorMP3a::GetPositionMs()
+{
+  return info.IsValid() ? info.MsForSample(sampleIndex) : 0;
+}
+
+bool AudioGeneratorMP3a::SeekMs(uint32_t ms)
+{
+  if (!running || !info.IsValid()) return false;
+  if (!file->seek(info.OffsetForMs(ms, file->getSize()), SEEK_SET)) return false;
+
+  // Drop everything buffered and decoded, and the decoder's history
+  reader.Flush();
+  validSamples = 0;
+  curSample = 0;
+  MP3FlushCodec(hMP3Decoder);
+  sampleIndex = info.SampleForMs(ms);
+  resync = true;
   return true;
 }
 
@@ -98,26 +120,46 @@ bool AudioGeneratorMP3a::loop()
 
   // If we've got data, try and pump it out...
   while (validSamples) {
-    lastSample[0] = outSample[curSample*2];
-    lastSample[1] = outSample[curSample*2 + 1];
+    if (lastChannels == 1) {
+      lastSample[0] = outSample[curSample];
+      lastSample[1] = outSample[curSample];
+    } else {
+      lastSample[0] = outSample[curSample*2];
+      lastSample[1] = outSample[curSample*2 + 1];
+    }
     if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
     validSamples--;
     curSample++;
   }
 
   // No samples available, need to decode a new frame
-  if (FillBufferWithValidFrame()) {
-    // buff[0] start of frame, decode it...
-    unsigned char *inBuff = reinterpret_cast<unsigned char *>(buff);
-    int bytesLeft = buffValid;
+  uint8_t *frame;
+  int frameLen;
+  if (reader.NextFrame(&frame, &frameLen)) {
+    if (!infoChecked) {
+      // The first frame may be a Xing/VBRI tag with no audio in it, step over it
+      infoChecked = true;
+      if (info.Parse(frame, frameLen, reader.GetPos())) {
+        reader.Consume(frameLen);
+        goto done;
+      }
+    }
+
+    // frame is the whole frame, in place, decode it...
+    unsigned char *inBuff = frame;
+    int bytesLeft = frameLen;
     int ret = MP3Decode(hMP3Decoder, &inBuff, &bytesLeft, outSample, 0);
-   if (ret) {
+    int used = frameLen - bytesLeft;
+    reader.Consume(used ? used : 1); // On errors at least step off this sync so the next one is found
+    if (resync && (ret == ERR_MP3_MAINDATA_UNDERFLOW)) {
+      // Frames referring back to data from before the seek, skip quietly
+    } else if (ret) {
       // Error, skip the frame...
       char buff[48];
       sprintf(buff, "MP3 decode error %d", ret);
       cb.st(ret, buff);
     } else {
-      lastFrameEnd = buffValid - bytesLeft;
+      resync = false;
       MP3FrameInfo fi;
       MP3GetLastFrameInfo(hMP3Decoder, &fi);
       if ((int)fi.samprate!= (int)lastRate) {
@@ -128,8 +170,14 @@ bool AudioGeneratorMP3a::loop()
         output->SetChannels(fi.nChans);
         lastChannels = fi.nChans;
       }
-      curSample = 0;
-      validSamples = fi.outputSamps / lastChannels;
+      // Gapless, only play what lies between the encoder delay and padding
+      int first, end;
+      if (!info.Clip(sampleIndex, fi.outputSamps / lastChannels, 0, &first, &end)) {
+        running = false;
+      }
+      sampleIndex += fi.outputSamps / lastChannels;
+      curSample = first;
+      validSamples = end - first;
     }
   } else {
     running = false; // No more data, we're done here...
@@ -151,6 +199,13 @@ bool AudioGeneratorMP3a::begin(AudioFileSource *source, AudioOutput *output)
   if (!file->isOpen()) return false; // Error
 
   output->begin();
+  ApplyOptions();
+  reader.Begin(file, buff);
+
+  info.Reset();
+  infoChecked = false;
+  sampleIndex = 0;
+  resync = false;
   
   // AAC always comes out at 16 bits
   output->SetBitsPerSample(16);
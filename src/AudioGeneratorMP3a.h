@@ -23,6 +23,8 @@
 
 #include "AudioGenerator.h"
 #include "libhelix-mp3/mp3dec.h"
+#include "MP3StreamInfo.h"
+#include "FrameReader.h"
 
 class AudioGeneratorMP3a : public AudioGenerator
 {
@@ -34,15 +36,25 @@ class AudioGeneratorMP3a : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // Cheaper decoding of stereo streams for single-speaker setups: LEFT/RIGHT decode just that
+    // channel, MONO mixes both ahead of the subband synthesis.  AUTO (default) picks MONO when
+    // the output says WantsMono(), STEREO otherwise.
+    enum { CHANNELS_AUTO = 0, CHANNELS_STEREO, CHANNELS_LEFT, CHANNELS_RIGHT, CHANNELS_MONO };
+    bool SetChannelMode(int mode);
+
+    // Length and position of the playable audio, 0 if unknown.  VBR files need a Xing or VBRI tag.
+    uint32_t GetDurationMs();
+    uint32_t GetPositionMs();
+    // Jump to a time with a single source seek (via the Xing/VBRI table of contents when present)
+    bool SeekMs(uint32_t ms);
+
   protected:
     // Helix MP3 decoder
     HMP3Decoder hMP3Decoder;
 
-    // Input buffering
-    uint8_t buff[1600]; // File buffer required to store at least a whole compressed frame
-    int16_t buffValid;
-    int16_t lastFrameEnd;
-    bool FillBufferWithValidFrame(); // Read until we get a valid syncword and min(feof, 2048) butes in the buffer
+    // Input buffering, a ring of 1600 bytes plus room to unwrap the largest frame (320kbit/s @ 32KHz)
+    uint8_t buff[1600 + 1441];
+    FrameReader reader;
 
     // Output buffering
     int16_t outSample[1152 * 2]; // Interleaved L/R
@@ -52,6 +64,15 @@ class AudioGeneratorMP3a : public AudioGenerator
     // Each frame may change this if they're very strange, I guess
     unsigned int lastRate;
     int lastChannels;
+    int channelMode;
+
+    // First-frame tag info, for duration/seek and gapless trimming
+    MP3StreamInfo info;
+    bool infoChecked;
+    uint32_t sampleIndex; // Decoded samples since the start of the stream
+    bool resync; // Just seeked, bit reservoir underflows are expected
+
+    void ApplyOptions();
 };
 
 #endif
@@ -26,6 +26,9 @@ AudioGeneratorOpus::AudioGeneratorOpus()
   buff = nullptr;
   buffPtr = 0;
   buffLen = 0;
+  decodeRate = 48000;
+  decodeChannels = 2;
+  channels = 2;
   running = false;
 }
 
@@ -39,6 +42,15 @@ AudioGeneratorOpus::~AudioGeneratorOpus()
 
 #define OPUS_BUFF 1024
 
+bool AudioGeneratorOpus::SetDecodeFormat(int rate, int channels)
+{
+  if (running || (channels < 0) || (channels > 2)) return false;
+  if ((rate != 0) && (rate != 8000) && (rate != 12000) && (rate != 16000) && (rate != 24000) && (rate != 48000)) return false;
+  decodeRate = rate;
+  decodeChannels = channels;
+  return true;
+}
+
 bool AudioGeneratorOpus::begin(AudioFileSource *source, AudioOutput *output)
 {
   buff = (int16_t*)malloc(OPUS_BUFF * sizeof(int16_t));
@@ -62,10 +74,29 @@ bool AudioGeneratorOpus::begin(AudioFileSource *source, AudioOutput *output)
 
   output->begin();
 
-  // These are fixed by Opus
-  output->SetRate(48000);
+  // Opus always decodes to 16 bits, the rate and channels are up to the decoder setup
+  const OpusHead *head = op_head(of, -1);
+  int rate = decodeRate;
+  if (!rate) {
+    static const int rates[] = { 8000, 12000, 16000, 24000 };
+    rate = 48000;
+    for (int i = 0; head->input_sample_rate && (i < 4); i++) {
+      if (head->input_sample_rate <= (opus_uint32)rates[i]) {
+        rate = rates[i];
+        break;
+      }
+    }
+  }
+  channels = decodeChannels ? decodeChannels : (head->channel_count == 1) ? 1 : 2;
+  if (op_set_decode_format(of, rate, channels == 1) < 0) {
+    op_free(of);
+    of = nullptr;
+    return false;
+  }
+
+  output->SetRate(rate);
   output->SetBitsPerSample(16);
-  output->SetChannels(2);
+  output->SetChannels(channels);
 
   running = true;
   return true;
@@ -80,6 +111,9 @@ bool AudioGeneratorOpus::loop()
 
   do {
     if (buffPtr == buffLen) {
+      // libopus only decodes a single (coupled) stream to mono, which op_read_stereo then hands back
+      // as identical pairs.  Any link with more streams, even a later one in a chain, comes back as
+      // a stereo downmix to be mixed down here.
       int ret = op_read_stereo(of, (opus_int16 *)buff, OPUS_BUFF);
       if (ret == OP_HOLE) {
         // fprintf(stderr,"\nHole detected! Corrupt file segment?\n");
@@ -92,8 +126,13 @@ bool AudioGeneratorOpus::loop()
      buffLen = ret * 2;
     }
 
-    lastSample[AudioOutput::LEFTCHANNEL] = buff[buffPtr] & 0xffff; 
-    lastSample[AudioOutput::RIGHTCHANNEL] = buff[buffPtr+1] & 0xffff; 
+    if (channels == 1) {
+      lastSample[AudioOutput::LEFTCHANNEL] = (buff[buffPtr] + buff[buffPtr + 1]) >> 1;
+      lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
+    } else {
+      lastSample[AudioOutput::LEFTCHANNEL] = buff[buffPtr] & 0xffff; 
+      lastSample[AudioOutput::RIGHTCHANNEL] = buff[buffPtr + 1] & 0xffff; 
+    }
     buffPtr += 2;
   } while (running && output->ConsumeSample(lastSample));
 
@@ -133,7 +172,7 @@ int AudioGeneratorOpus::seek_cb(opus_int64 _offset, int _whence) {
 }
 
 opus_int64 AudioGeneratorOpus::tell_cb() {
-  return file->getPos();
+  return file->getReadPos();
 }
 
 int AudioGeneratorOpus::close_cb() {
@@ -35,6 +35,13 @@ class AudioGeneratorOpus : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // Decode at a lower rate and/or in mono, straight out of libopus (no resampling afterwards).
+    // rate is 8000, 12000, 16000, 24000 or 48000, channels 1 or 2; 0 picks either from the stream's
+    // OpusHead, i.e. its original input rate rounded up and mono for mono streams.  In mono, links
+    // libopus can't decode that way (more than one stream) are decoded whole and mixed down, later
+    // links of a chain included.  The default is 48 kHz stereo.  Call before begin().
+    bool SetDecodeFormat(int rate, int channels);
+
   protected:
     // Opus callbacks, need static functions to bounce into C++ from C
     static int OPUS_read(void *_stream, unsigned char *_ptr, int _nbytes) {
@@ -60,6 +67,9 @@ class AudioGeneratorOpus : public AudioGenerator
     OpusFileCallbacks cb = {OPUS_read, OPUS_seek, OPUS_tell, OPUS_close};
     OggOpusFile *of;
     int prev_li; // To detect changes in streams
+    int decodeRate;
+    int decodeChannels;
+    int channels; // Output channels, buff always holds stereo pairs
 
     int16_t *buff;
     uint32_t buffPtr;
@@ -1,6 +1,6 @@
 /*
   AudioGeneratorWAV
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8, 16, 24 and 32-bit, float, u-law, A-law and IMA ADPCM WAV files
   
   Copyright (C) 2017  Earle F. Philhower, III
 
@@ -30,6 +30,14 @@ AudioGeneratorWAV::AudioGeneratorWAV()
   buff = NULL;
   buffPtr = 0;
   buffLen = 0;
+  data = NULL;
+  mapped = false;
+  out = NULL;
+  outPtr = 0;
+  outLen = 0;
+  blockFrames = 0;
+  blockFrame = 0;
+  blockLen = 0;
 }
 
 AudioGeneratorWAV::~AudioGeneratorWAV()
@@ -54,22 +62,269 @@ bool AudioGeneratorWAV::isRunning()
 }
 
 
-// Handle buffered reading, reload each time we run out of data
-bool AudioGeneratorWAV::GetBufferedData(int bytes, void *dest)
+// Where the samples are read from: the RAM buffer, or a memory-mapped source which on the ESP8266
+// can only be read a word at a time
+struct WAVRAM {
+  static uint8_t At(const uint8_t *p) { return *p; }
+};
+#ifdef ESP8266
+struct WAVFlash {
+  static uint8_t At(const uint8_t *p) { return pgm_read_byte(p); }
+};
+#else
+typedef WAVRAM WAVFlash;
+#endif
+
+// Sample formats, each reading one little-endian sample.  T is what the output gets.
+template <class M> struct WAVU8 {
+  enum { BYTES = 1 };
+  typedef int16_t T;
+  static T Get(const uint8_t *p) { return M::At(p); } // The output takes 8-bit samples as they are
+};
+template <class M> struct WAVS16 {
+  enum { BYTES = 2 };
+  typedef int16_t T;
+  static T Get(const uint8_t *p) { return (int16_t)(M::At(p) | (M::At(p + 1) << 8)); }
+};
+template <class M> struct WAVS24 {
+  enum { BYTES = 3 };
+  typedef int32_t T;
+  static T Get(const uint8_t *p) { return (int32_t)((M::At(p) << 8) | (M::At(p + 1) << 16) | ((uint32_t)M::At(p + 2) << 24)); }
+};
+template <class M> struct WAVS32 {
+  enum { BYTES = 4 };
+  typedef int32_t T;
+  static T Get(const uint8_t *p) { return (int32_t)(M::At(p) | (M::At(p + 1) << 8) | (M::At(p + 2) << 16) | ((uint32_t)M::At(p + 3) << 24)); }
+};
+template <class M> struct WAVF32 {
+  enum { BYTES = 4 };
+  typedef int32_t T;
+  static T Get(const uint8_t *p) {
+    uint32_t u = (uint32_t)WAVS32<M>::Get(p);
+    float f;
+    memcpy(&f, &u, 4);
+    if (f >= 1.0f) return INT32_MAX;
+    if (f > -1.0f) return (int32_t)(f * 2147483648.0f);
+    return (f <= -1.0f) ? INT32_MIN : 0; // NaN is silence
+  }
+};
+
+// G.711 companding, decoded by table
+static const int16_t ulawTable[256] PROGMEM = {
+  -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+  -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+  -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+  -11900, -11388, -10876, -10364,  -9852,  -9340,  -8828,  -8316,
+   -7932,  -7676,  -7420,  -7164,  -6908,  -6652,  -6396,  -6140,
+   -5884,  -5628,  -5372,  -5116,  -4860,  -4604,  -4348,  -4092,
+   -3900,  -3772,  -3644,  -3516,  -3388,  -3260,  -3132,  -3004,
+   -2876,  -2748,  -2620,  -2492,  -2364,  -2236,  -2108,  -1980,
+   -1884,  -1820,  -1756,  -1692,  -1628,  -1564,  -1500,  -1436,
+   -1372,  -1308,  -1244,  -1180,  -1116,  -1052,   -988,   -924,
+    -876,   -844,   -812,   -780,   -748,   -716,   -684,   -652,
+    -620,   -588,   -556,   -524,   -492,   -460,   -428,   -396,
+    -372,   -356,   -340,   -324,   -308,   -292,   -276,   -260,
+    -244,   -228,   -212,   -196,   -180,   -164,   -148,   -132,
+    -120,   -112,   -104,    -96,    -88,    -80,    -72,    -64,
+     -56,    -48,    -40,    -32,    -24,    -16,     -8,      0,
+   32124,  31100,  30076,  29052,  28028,  27004,  25980,  24956,
+   23932,  22908,  21884,  20860,  19836,  18812,  17788,  16764,
+   15996,  15484,  14972,  14460,  13948,  13436,  12924,  12412,
+   11900,  11388,  10876,  10364,   9852,   9340,   8828,   8316,
+    7932,   7676,   7420,   7164,   6908,   6652,   6396,   6140,
+    5884,   5628,   5372,   5116,   4860,   4604,   4348,   4092,
+    3900,   3772,   3644,   3516,   3388,   3260,   3132,   3004,
+    2876,   2748,   2620,   2492,   2364,   2236,   2108,   1980,
+    1884,   1820,   1756,   1692,   1628,   1564,   1500,   1436,
+    1372,   1308,   1244,   1180,   1116,   1052,    988,    924,
+     876,    844,    812,    780,    748,    716,    684,    652,
+     620,    588,    556,    524,    492,    460,    428,    396,
+     372,    356,    340,    324,    308,    292,    276,    260,
+     244,    228,    212,    196,    180,    164,    148,    132,
+     120,    112,    104,     96,     88,     80,     72,     64,
+      56,     48,     40,     32,     24,     16,      8,      0
+};
+
+static const int16_t alawTable[256] PROGMEM = {
+   -5504,  -5248,  -6016,  -5760,  -4480,  -4224,  -4992,  -4736,
+   -7552,  -7296,  -8064,  -7808,  -6528,  -6272,  -7040,  -6784,
+   -2752,  -2624,  -3008,  -2880,  -2240,  -2112,  -2496,  -2368,
+   -3776,  -3648,  -4032,  -3904,  -3264,  -3136,  -3520,  -3392,
+  -22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944,
+  -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+  -11008, -10496, -12032, -11520,  -8960,  -8448,  -9984,  -9472,
+  -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+    -344,   -328,   -376,   -360,   -280,   -264,   -312,   -296,
+    -472,   -456,   -504,   -488,   -408,   -392,   -440,   -424,
+     -88,    -72,   -120,   -104,    -24,     -8,    -56,    -40,
+    -216,   -200,   -248,   -232,   -152,   -136,   -184,   -168,
+   -1376,  -1312,  -1504,  -1440,  -1120,  -1056,  -1248,  -1184,
+   -1888,  -1824,  -2016,  -1952,  -1632,  -1568,  -1760,  -1696,
+    -688,   -656,   -752,   -720,   -560,   -528,   -624,   -592,
+    -944,   -912,  -1008,   -976,   -816,   -784,   -880,   -848,
+    5504,   5248,   6016,   5760,   4480,   4224,   4992,   4736,
+    7552,   7296,   8064,   7808,   6528,   6272,   7040,   6784,
+    2752,   2624,   3008,   2880,   2240,   2112,   2496,   2368,
+    3776,   3648,   4032,   3904,   3264,   3136,   3520,   3392,
+   22016,  20992,  24064,  23040,  17920,  16896,  19968,  18944,
+   30208,  29184,  32256,  31232,  26112,  25088,  28160,  27136,
+   11008,  10496,  12032,  11520,   8960,   8448,   9984,   9472,
+   15104,  14592,  16128,  15616,  13056,  12544,  14080,  13568,
+     344,    328,    376,    360,    280,    264,    312,    296,
+     472,    456,    504,    488,    408,    392,    440,    424,
+      88,     72,    120,    104,     24,      8,     56,     40,
+     216,    200,    248,    232,    152,    136,    184,    168,
+    1376,   1312,   1504,   1440,   1120,   1056,   1248,   1184,
+    1888,   1824,   2016,   1952,   1632,   1568,   1760,   1696,
+     688,    656,    752,    720,    560,    528,    624,    592,
+     944,    912,   1008,    976,    816,    784,    880,    848
+};
+
+template <class M> struct WAVULaw {
+  enum { BYTES = 1 };
+  typedef int16_t T;
+  static T Get(const uint8_t *p) { return (int16_t)pgm_read_word(ulawTable + M::At(p)); }
+};
+template <class M> struct WAVALaw {
+  enum { BYTES = 1 };
+  typedef int16_t T;
+  static T Get(const uint8_t *p) { return (int16_t)pgm_read_word(alawTable + M::At(p)); }
+};
+
+// Convert frames of format F with CH channels into interleaved stereo, mono going to both channels
+template <class F, int CH>
+static void ConvertFrames(const uint8_t *src, void *dest, int frames)
+{
+  typename F::T *d = reinterpret_cast<typename F::T *>(dest);
+  for (int i = 0; i < frames; i++) {
+    d[0] = F::Get(src);
+    d[1] = (CH == 2) ? F::Get(src + F::BYTES) : d[0];
+    src += CH * F::BYTES;
+    d += 2;
+  }
+}
+
+// IMA ADPCM
+static const int16_t imaSteps[89] PROGMEM = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80,
+  88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544,
+  598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+  3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635,
+  13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t imaIndexes[16] PROGMEM = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// Decode frames [first, first+count) of the IMA ADPCM block blk into interleaved stereo.  Each
+// channel's block starts with its first sample and step index, then its nibbles follow four bytes
+// (eight samples) at a time, taking turns with the other channel's.
+template <class M>
+static void DecodeIMA(const uint8_t *blk, int channels, int16_t *pred, uint8_t *index, int16_t *dest, int first, int count)
+{
+  for (int c = 0; c < channels; c++) {
+    const uint8_t *hdr = blk + 4 * c;
+    if (!first) {
+      pred[c] = (int16_t)(M::At(hdr) | (M::At(hdr + 1) << 8));
+      index[c] = M::At(hdr + 2) > 88 ? 88 : M::At(hdr + 2);
+    }
+    const uint8_t *data = blk + 4 * channels + 4 * c;
+    int32_t p = pred[c];
+    int idx = index[c];
+    int16_t *d = dest + c;
+    for (int f = first; f < first + count; f++, d += 2) {
+      if (f) {
+        int j = f - 1;
+        uint8_t b = M::At(data + (j >> 3) * 4 * channels + ((j & 7) >> 1));
+        uint8_t nib = (j & 1) ? (b >> 4) : (b & 15);
+        int32_t step = (int16_t)pgm_read_word(imaSteps + idx);
+        int32_t diff = step >> 3;
+        if (nib & 4) diff += step;
+        if (nib & 2) diff += step >> 1;
+        if (nib & 1) diff += step >> 2;
+        p += (nib & 8) ? -diff : diff;
+        p = (p > 32767) ? 32767 : (p < -32768) ? -32768 : p;
+        idx += (int8_t)pgm_read_byte(imaIndexes + nib);
+        idx = (idx < 0) ? 0 : (idx > 88) ? 88 : idx;
+      }
+      *d = p;
+      if (channels == 1) d[1] = p;
+    }
+    pred[c] = p;
+    index[c] = idx;
+  }
+}
+
+// Frames in an IMA ADPCM block of len bytes, the header's sample and then eight for each whole four
+// bytes per channel
+static uint32_t IMAFrames(uint32_t len, int channels)
+{
+  return (len - 4 * channels) / (4 * channels) * 8 + 1;
+}
+
+#define WAVCONVERT(F) { { ConvertFrames<F<WAVRAM>, 1>, ConvertFrames<F<WAVRAM>, 2> }, { ConvertFrames<F<WAVFlash>, 1>, ConvertFrames<F<WAVFlash>, 2> } }
+
+// Pick the conversion for the format and channels, false if it's not one we play.  bitsPerSample
+// becomes what the output gets.
+bool AudioGeneratorWAV::SetFormat()
 {
-  if (!running) return false; // Nothing to do here!
-  uint8_t *p = reinterpret_cast<uint8_t*>(dest);
-  while (bytes--) {
-    // Potentially load next batch of data...
-    if (buffPtr >= buffLen) {
-      buffPtr = 0;
-      uint32_t toRead = availBytes > buffSize ? buffSize : availBytes;
-      buffLen = file->read( buff, toRead );
-      availBytes -= buffLen;
+  static const struct { uint16_t tag, bits, outBits; ConvertFn convert[2][2]; } formats[] = {
+    { 1,  8,  8, WAVCONVERT(WAVU8) },
+    { 1, 16, 16, WAVCONVERT(WAVS16) },
+    { 1, 24, 24, WAVCONVERT(WAVS24) },
+    { 1, 32, 32, WAVCONVERT(WAVS32) },
+    { 3, 32, 32, WAVCONVERT(WAVF32) },
+    { 6,  8, 16, WAVCONVERT(WAVALaw) },
+    { 7,  8, 16, WAVCONVERT(WAVULaw) },
+  };
+  if ((formatTag == 0x11) && (bitsPerSample == 4)) {
+    // IMA ADPCM is decoded a whole block at a time
+    if (blockAlign <= 4 * channels) return false;
+    frameBytes = blockAlign;
+    blockFrames = IMAFrames(blockAlign, channels);
+    convert = NULL;
+    wide = false;
+    bitsPerSample = 16;
+    return true;
+  }
+  blockFrames = 0;
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    if ((formats[i].tag == formatTag) && (formats[i].bits == bitsPerSample)) {
+      wide = formats[i].outBits > 16;
+      convert = formats[i].convert[mapped ? 1 : 0][channels - 1];
+      frameBytes = channels * bitsPerSample / 8;
+      bitsPerSample = formats[i].outBits;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      // Already what the output takes.  Not from the ESP8266's flash, which can only be read a word at
+      // a time, nor from anywhere the samples aren't aligned.
+#ifdef ESP8266
+      bool direct = !mapped;
+#else
+      bool direct = !mapped || !((uintptr_t)data & 1);
+#endif
+      if ((formatTag == 1) && (bitsPerSample == 16) && (channels == 2) && direct) convert = NULL;
+#endif
+      return true;
     }
-    if (buffPtr >= buffLen)
-      return false; // No data left!
-    *(p++) = buff[buffPtr++];
+  }
+  return false;
+}
+
+// Read as much as fits after what's left of the last partial frame.  False if that's still not a
+// whole frame, which is left at the start of buff.
+bool AudioGeneratorWAV::Fill()
+{
+  if (mapped) return false; // All of it was there from the start
+  uint32_t left = buffLen - buffPtr;
+  memmove(buff, buff + buffPtr, left);
+  data = buff;
+  buffPtr = 0;
+  buffLen = left;
+  while (buffLen < frameBytes) {
+    uint32_t toRead = buffSize - buffLen;
+    if (toRead > availBytes) toRead = availBytes;
+    uint32_t got = toRead ? file->read(buff + buffLen, toRead) : 0;
+    if (!got) return false; // No data left!
+    availBytes -= got;
+    buffLen += got;
   }
   return true;
 }
@@ -78,31 +333,58 @@ bool AudioGeneratorWAV::loop()
 {
   if (!running) goto done; // Nothing to do here!
 
-  // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
-
-  // Try and stuff the buffer one sample at a time
-  do
-  {
-    if (bitsPerSample == 8) {
-      uint8_t l, r;
-      if (!GetBufferedData(1, &l)) stop();
-      if (channels == 2) {
-        if (!GetBufferedData(1, &r)) stop();
-      } else {
-        r = 0;
+  // Convert a block at a time, stopping when the output won't take any more
+  while (running) {
+    if (outPtr < outLen) {
+      if (wide) outPtr += output->ConsumeSamples32(reinterpret_cast<int32_t*>(out) + 2 * outPtr, outLen - outPtr);
+      else outPtr += output->ConsumeSamples(reinterpret_cast<int16_t*>(out) + 2 * outPtr, outLen - outPtr);
+      if (outPtr < outLen) break; // Can't send, but no error detected
+      continue;
+    }
+    uint32_t frames;
+    if (blockFrames) {
+      // IMA ADPCM, going on through the block or starting the next one
+      if (!blockFrame) {
+        blockLen = blockFrames;
+        if ((buffLen - buffPtr < frameBytes) && !Fill()) {
+          // A short last block, if there's more than its header
+          uint32_t left = buffLen - buffPtr;
+          if (left < 4 * channels) {
+            stop();
+            break;
+          }
+          blockLen = IMAFrames(left, channels);
+        }
       }
-      lastSample[AudioOutput::LEFTCHANNEL] = l;
-      lastSample[AudioOutput::RIGHTCHANNEL] = r;
-    } else if (bitsPerSample == 16) {
-      if (!GetBufferedData(2, &lastSample[AudioOutput::LEFTCHANNEL])) stop();
-      if (channels == 2) {
-        if (!GetBufferedData(2, &lastSample[AudioOutput::RIGHTCHANNEL])) stop();
+      frames = blockLen - blockFrame;
+      if (frames > BLOCK) frames = BLOCK;
+      if (mapped) DecodeIMA<WAVFlash>(data + buffPtr, channels, imaPred, imaIndex, block16, blockFrame, frames);
+      else DecodeIMA<WAVRAM>(data + buffPtr, channels, imaPred, imaIndex, block16, blockFrame, frames);
+      out = block16;
+      blockFrame += frames;
+      if (blockFrame == blockLen) {
+        blockFrame = 0;
+        buffPtr += (buffLen - buffPtr < frameBytes) ? buffLen - buffPtr : frameBytes;
+      }
+    } else {
+      if ((buffLen - buffPtr < frameBytes) && !Fill()) {
+        stop();
+        break;
+      }
+      frames = (buffLen - buffPtr) / frameBytes;
+      if (!convert) {
+        if (frames > 0xffff) frames = 0xffff;
+        out = const_cast<uint8_t *>(data) + buffPtr;
       } else {
-        lastSample[AudioOutput::RIGHTCHANNEL] = 0;
+        if (frames > BLOCK) frames = BLOCK;
+        out = wide ? (void *)block32 : (void *)block16;
+        convert(data + buffPtr, out, frames);
       }
+      buffPtr += frames * frameBytes;
     }
-  } while (running && output->ConsumeSample(lastSample));
+    outPtr = 0;
+    outLen = frames;
+  }
 
 done:
   file->loop();
@@ -115,7 +397,6 @@ done:
 bool AudioGeneratorWAV::ReadWAVInfo()
 {
   uint32_t u32;
-  uint16_t u16;
   int toSkip;
 
   // WAV specification document:
@@ -161,23 +442,17 @@ bool AudioGeneratorWAV::ReadWAVInfo()
     Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
     return false;
   };
-  if (u32 == 16) { toSkip = 0; }
-  else if (u32 == 18) { toSkip = 18 - 16; }
-  else if (u32 == 40) { toSkip = 40 - 16; }
-  else {
-    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, appears not to be standard PCM \n"));
+  if (u32 < 16) {
+    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, format chunk too short \n"));
     return false;
-  } // we only do standard PCM
+  }
+  toSkip = u32 - 16 + (u32 & 1); // Chunks are padded to an even length
 
-  // AudioFormat
-  if (!ReadU16(&u16)) {
+  // AudioFormat, checked with the bits per sample
+  if (!ReadU16(&formatTag)) {
     Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
     return false;
   };
-  if (u16 != 1) {
-    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, AudioFormat appears not to be standard PCM \n"));
-    return false;
-  } // we only do standard PCM
 
   // NumChannels
   if (!ReadU16(&channels)) {
@@ -199,12 +474,12 @@ bool AudioGeneratorWAV::ReadWAVInfo()
     return false;
   }  // Weird rate, punt.  Will need to check w/DAC to see if supported
 
-  // Ignore byterate and blockalign
+  // Ignore byterate, blockalign is needed for IMA ADPCM
   if (!ReadU32(&u32)) {
     Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
     return false;
   };
-  if (!ReadU16(&u16)) {
+  if (!ReadU16(&blockAlign)) {
     Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
     return false;
   };
@@ -214,10 +489,16 @@ bool AudioGeneratorWAV::ReadWAVInfo()
     Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
     return false;
   };
-  if ((bitsPerSample!=8) && (bitsPerSample != 16)) {
-    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, only 8 or 16 bits is supported \n"));
-    return false;
-  }  // Only 8 or 16 bits
+
+  // WAVE_FORMAT_EXTENSIBLE has the real format in the first two bytes of its SubFormat GUID
+  if ((formatTag == 0xfffe) && (toSkip >= 40 - 16)) {
+    uint8_t ext[8]; // cbSize, wValidBitsPerSample, dwChannelMask
+    if ((8 != file->read(ext, 8)) || !ReadU16(&formatTag)) {
+      Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: failed to read WAV data\n"));
+      return false;
+    };
+    toSkip -= 10;
+  }
 
   // Skip any extra header
   while (toSkip) {
@@ -259,14 +540,39 @@ bool AudioGeneratorWAV::ReadWAVInfo()
   };
   availBytes = u32;
 
-  // Now set up the buffer or fail
-  buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
-  if (!buff) {
-    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, failed to set up buffer \n"));
+  // Play straight from the source if it has all the data in memory, to the end of the file if
+  // the data chunk claims more than that
+  uint32_t size = file->getSize();
+  uint32_t pos = file->getReadPos();
+  uint32_t left = availBytes;
+  if ((pos < size) && (left > size - pos)) left = size - pos;
+  data = reinterpret_cast<const uint8_t *>(file->readMapped(left));
+  mapped = (data != NULL);
+
+  if (!SetFormat()) {
+    Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, only 8, 16, 24 or 32-bit PCM, 32-bit float, u-law, A-law or IMA ADPCM is supported \n"));
     return false;
-  };
+  }
+
+  if (mapped) {
+    buffLen = left;
+    availBytes = 0;
+  } else {
+    // Now set up the buffer or fail, a whole number of frames and at least one
+    buffSize -= buffSize % frameBytes;
+    if (!buffSize) buffSize = frameBytes;
+    buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
+    if (!buff) {
+      Serial.printf_P(PSTR("AudioGeneratorWAV::ReadWAVInfo: cannot read WAV, failed to set up buffer \n"));
+      return false;
+    };
+    data = buff;
+    buffLen = 0;
+  }
   buffPtr = 0;
-  buffLen = 0;
+  blockFrame = 0;
+  outPtr = 0;
+  outLen = 0;
 
   return true;
 }
@@ -297,7 +603,8 @@ bool AudioGeneratorWAV::begin(AudioFileSource *source, AudioOutput *output)
     Serial.printf_P(PSTR("AudioGeneratorWAV::begin: failed to SetRate in output\n"));
     return false;
   }
-  if (!output->SetBitsPerSample( bitsPerSample )) {
+  // Outputs that only take 16 bits still get the wider samples, which ConsumeSamples32() dithers down
+  if (!output->SetBitsPerSample( bitsPerSample ) && (!wide || !output->SetBitsPerSample( 16 ))) {
     Serial.printf_P(PSTR("AudioGeneratorWAV::begin: failed to SetBitsPerSample in output\n"));
     return false;
   }
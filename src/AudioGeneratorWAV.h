@@ -1,6 +1,6 @@
 /*
   AudioGeneratorWAV
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8, 16, 24 and 32-bit, float, u-law, A-law and IMA ADPCM WAV files
     
   Copyright (C) 2017  Earle F. Philhower, III
 
@@ -32,13 +32,18 @@ class AudioGeneratorWAV : public AudioGenerator
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override;
+    // Bytes read from the file at a time, and converted straight from there.  Rounded down to whole
+    // sample frames.  A larger buffer costs RAM but saves calls into the file system.  Not used at all
+    // when the source has the data in memory already (AudioFileSourcePROGMEM), as it's played from
+    // there.
     void SetBufferSize(int sz) { buffSize = sz; }
 
   private:
     bool ReadU32(uint32_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 4); }
     bool ReadU16(uint16_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 2); }
     bool ReadU8(uint8_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 1); }
-    bool GetBufferedData(int bytes, void *dest);
+    bool SetFormat();
+    bool Fill();
     bool ReadWAVInfo();
 
     
@@ -47,14 +52,41 @@ class AudioGeneratorWAV : public AudioGenerator
     uint16_t channels;
     uint32_t sampleRate;
     uint16_t bitsPerSample;
+    uint16_t formatTag;
+    uint16_t blockAlign;
+    uint16_t frameBytes;  // For IMA ADPCM, a whole block
     
     uint32_t availBytes;
 
     // We need to buffer some data in-RAM to avoid doing 1000s of small reads
     uint32_t buffSize;
     uint8_t *buff;
-    uint16_t buffPtr;
-    uint16_t buffLen;
+    uint32_t buffPtr;
+    uint32_t buffLen;
+    // What's being played from, buff or the source's own memory
+    const uint8_t *data;
+    bool mapped;
+
+    // Whole frames are converted from buff a block at a time, into interleaved stereo for the output:
+    // 16-bit, or for more bits 32-bit MSB-aligned.  16-bit stereo needs no converting, and is sent
+    // from buff as it is.
+    enum { BLOCK = 32 };
+    typedef void (*ConvertFn)(const uint8_t *src, void *dest, int frames);
+    ConvertFn convert;
+    bool wide;
+    int16_t block16[2 * BLOCK];
+    int32_t block32[2 * BLOCK];
+    void *out;
+    uint16_t outPtr;
+    uint16_t outLen;
+
+    // IMA ADPCM blocks are decoded BLOCK frames at a time, each channel going on from its last
+    // sample and step index
+    uint32_t blockFrames;
+    uint32_t blockFrame;
+    uint32_t blockLen;
+    int16_t imaPred[2];
+    uint8_t imaIndex[2];
 };
 
 #endif
@@ -27,10 +27,12 @@
 class AudioOutput
 {
   public:
-    AudioOutput() { };
+    AudioOutput() { ditherState = 0x12345678; };
     virtual ~AudioOutput() {};
     virtual bool SetRate(int hz) { hertz = hz; return true; }
-    virtual bool SetBitsPerSample(int bits) { bps = bits; return true; }
+    // Only 8 and 16 bits unless overridden by an output that can play more, so generators with wider
+    // samples know to fall back to 16 bits and have ConsumeSample32() dither them
+    virtual bool SetBitsPerSample(int bits) { if ((bits != 16) && (bits != 8)) return false; bps = bits; return true; }
     virtual bool SetChannels(int chan) { channels = chan; return true; }
     virtual bool SetGain(float f) { if (f>4.0) f = 4.0; if (f<0.0) f=0.0; gainF2P6 = (uint8_t)(f*(1<<6)); return true; }
     virtual bool begin() { return false; };
@@ -44,10 +46,33 @@ class AudioOutput
       }
       return count;
     }
+    // Samples of more than 16 bits, MSB-aligned in 32-bit containers.  Outputs which can play them
+    // override these, everything else gets them TPDF-dithered down to 16 bits.
+    virtual bool ConsumeSample32(int32_t sample[2])
+    {
+      int16_t s[2];
+      s[LEFTCHANNEL] = Dither16(sample[LEFTCHANNEL]);
+      s[RIGHTCHANNEL] = Dither16(sample[RIGHTCHANNEL]);
+      return ConsumeSample(s);
+    }
+    virtual uint16_t ConsumeSamples32(int32_t *samples, uint16_t count)
+    {
+      for (uint16_t i=0; i<count; i++) {
+        if (!ConsumeSample32(samples)) return i;
+        samples += 2;
+      }
+      return count;
+    }
     virtual bool stop() { return false; }
     virtual void flush() { return; }
     virtual bool loop() { return true; }
 
+    // True when only one channel is ever heard, so decoders may skip the work for the other
+    virtual bool WantsMono() { return false; }
+    // How full the output's queue is in percent, -1 when it can't tell.  Generators with cheaper
+    // decoding modes may fall back to them when this runs low.
+    virtual int FillPercent() { return -1; }
+
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
     virtual bool RegisterStatusCB(AudioStatus::statusCBFn fn, void *data) { return cb.RegisterStatusCB(fn, data); }
@@ -71,11 +96,32 @@ class AudioOutput
       else return (int16_t)(v&0xffff);
     }
 
+    inline int32_t Amplify32(int32_t s) {
+      int64_t v = ((int64_t)s * gainF2P6)>>6;
+      if (v < -2147483647LL) return -2147483647;
+      else if (v > 2147483647LL) return 2147483647;
+      else return (int32_t)v;
+    }
+
+    // Round a 32-bit sample to 16 bits with triangular dither of +-1 LSB, so the dropped bits become
+    // a little noise instead of distortion
+    inline int16_t Dither16(int32_t s) {
+      ditherState ^= ditherState << 13;
+      ditherState ^= ditherState >> 17;
+      ditherState ^= ditherState << 5;
+      int32_t tpdf = (int32_t)(ditherState >> 16) + (int32_t)(ditherState & 0xffff) - 0xffff;
+      int64_t v = ((int64_t)s + tpdf + 0x8000) >> 16;
+      if (v < -32768) return -32768;
+      else if (v > 32767) return 32767;
+      else return (int16_t)v;
+    }
+
   protected:
     uint16_t hertz;
     uint8_t bps;
     uint8_t channels;
     uint8_t gainF2P6; // Fixed point 2.6
+    uint32_t ditherState;
 
   protected:
     AudioStatus cb;
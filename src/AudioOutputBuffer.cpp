@@ -44,6 +44,7 @@ bool AudioOutputBuffer::SetRate(int hz)
 
 bool AudioOutputBuffer::SetBitsPerSample(int bits)
 {
+  if ((bits != 16) && (bits != 8)) return false; // Passes 16-bit samples on, wider ones are dithered first
   return sink->SetBitsPerSample(bits);
 }
 
@@ -81,6 +82,13 @@ bool AudioOutputBuffer::ConsumeSample(int16_t sample[2])
   return true;
 }
 
+int AudioOutputBuffer::FillPercent()
+{
+  if (!filled) return -1; // Still priming, not playing from the buffer yet
+  int used = (writePtr - readPtr + buffSize) % buffSize;
+  return used * 100 / (buffSize - 1);
+}
+
 bool AudioOutputBuffer::stop()
 {
   return sink->stop();
@@ -34,6 +34,8 @@ class AudioOutputBuffer : public AudioOutput
     virtual bool begin() override;
     virtual bool ConsumeSample(int16_t sample[2]) override;
     virtual bool stop() override;
+    virtual bool WantsMono() override { return sink->WantsMono(); }
+    virtual int FillPercent() override;
     
   protected:
     AudioOutput *sink;
@@ -52,6 +52,7 @@ bool AudioOutputFilterBiquad::SetRate(int hz)
 
 bool AudioOutputFilterBiquad::SetBitsPerSample(int bits)
 {
+  if ((bits != 16) && (bits != 8)) return false; // Passes 16-bit samples on, wider ones are dithered first
   return sink->SetBitsPerSample(bits);
 }
 
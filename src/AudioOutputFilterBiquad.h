@@ -50,6 +50,8 @@ class AudioOutputFilterBiquad : public AudioOutput
     virtual bool begin() override;
     virtual bool ConsumeSample(int16_t sample[2]) override;
     virtual bool stop() override;
+    virtual bool WantsMono() override { return sink->WantsMono(); }
+    virtual int FillPercent() override { return sink->FillPercent(); }
 
   private:
     void SetType(int type);
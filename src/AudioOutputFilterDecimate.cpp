@@ -58,6 +58,7 @@ bool AudioOutputFilterDecimate::SetRate(int hz)
 
 bool AudioOutputFilterDecimate::SetBitsPerSample(int bits)
 {
+  if ((bits != 16) && (bits != 8)) return false; // Passes 16-bit samples on, wider ones are dithered first
   return sink->SetBitsPerSample(bits);
 }
 
@@ -132,7 +132,16 @@ bool AudioOutputI2S::SetRate(int hz)
 
 bool AudioOutputI2S::SetBitsPerSample(int bits)
 {
+#ifdef ESP32
+  // 24 and 32 bit samples go out in 32-bit slots, which only external DACs understand
+  bool wide = (bits == 24) || (bits == 32);
+  if ( (bits != 16) && (bits != 8) && !(wide && (output_mode == EXTERNAL_I2S)) ) return false;
+  if (i2sOn && (wide != (bps > 16))) {
+    i2s_set_clk((i2s_port_t)portNo, AdjustI2SRate(hertz), wide ? I2S_BITS_PER_SAMPLE_32BIT : I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+  }
+#else
   if ( (bits != 16) && (bits != 8) ) return false;
+#endif
   this->bps = bits;
   return true;
 }
@@ -220,7 +229,7 @@ bool AudioOutputI2S::begin(bool txDAC)
       i2s_config_t i2s_config_dac = {
           .mode = mode,
           .sample_rate = 44100,
-          .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+          .bits_per_sample = (bps > 16) ? I2S_BITS_PER_SAMPLE_32BIT : I2S_BITS_PER_SAMPLE_16BIT,
           .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
           .communication_format = comm_fmt,
           .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1, // lowest interrupt priority
@@ -304,6 +313,10 @@ bool AudioOutputI2S::ConsumeSample(int16_t sample[2])
     ms[LEFTCHANNEL] = ms[RIGHTCHANNEL] = (ttl>>1) & 0xffff;
   }
   #ifdef ESP32
+    if (bps > 16) {
+      // 32-bit slots, put the 16 bits at the top
+      return Write32((int32_t)Amplify(ms[LEFTCHANNEL]) << 16, (int32_t)Amplify(ms[RIGHTCHANNEL]) << 16);
+    }
     uint32_t s32;
     if (output_mode == INTERNAL_DAC)
     {
@@ -330,6 +343,31 @@ bool AudioOutputI2S::ConsumeSample(int16_t sample[2])
   #endif
 }
 
+#ifdef ESP32
+bool AudioOutputI2S::ConsumeSample32(int32_t sample[2])
+{
+  if (bps <= 16) return AudioOutput::ConsumeSample32(sample); // 16-bit slots, dither down
+  if (!i2sOn)
+    return false;
+
+  int32_t l = sample[LEFTCHANNEL];
+  int32_t r = (channels == 1) ? l : sample[RIGHTCHANNEL];
+  if (this->mono) {
+    l = r = (int32_t)(((int64_t)l + r) >> 1);
+  }
+  return Write32(Amplify32(l), Amplify32(r));
+}
+
+// One stereo frame of 32-bit slots, false if the DMA buffers are full
+bool AudioOutputI2S::Write32(int32_t l, int32_t r)
+{
+  int32_t frame[2] = { l, r };
+  size_t i2s_bytes_written;
+  i2s_write((i2s_port_t)portNo, (const char*)frame, sizeof(frame), &i2s_bytes_written, 0);
+  return i2s_bytes_written;
+}
+#endif
+
 void AudioOutputI2S::flush()
 {
   #ifdef ESP32
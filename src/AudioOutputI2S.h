@@ -44,8 +44,12 @@ class AudioOutputI2S : public AudioOutput
     virtual bool SetChannels(int channels) override;
     virtual bool begin() override { return begin(true); }
     virtual bool ConsumeSample(int16_t sample[2]) override;
+#ifdef ESP32
+    virtual bool ConsumeSample32(int32_t sample[2]) override;
+#endif
     virtual void flush() override;
     virtual bool stop() override;
+    virtual bool WantsMono() override { return mono; }
     
     bool begin(bool txDAC);
     bool SetOutputModeMono(bool mono);  // Force mono output no matter the input
@@ -53,6 +57,9 @@ class AudioOutputI2S : public AudioOutput
 
   protected:
     bool SetPinout();
+#ifdef ESP32
+    bool Write32(int32_t l, int32_t r);
+#endif
     virtual int AdjustI2SRate(int hz) { return hz; }
     uint8_t portNo;
     int output_mode;
@@ -38,6 +38,7 @@ class AudioOutputI2SNoDAC : public AudioOutputI2S
     virtual ~AudioOutputI2SNoDAC() override;
     virtual bool begin() override { return AudioOutputI2S::begin(false); }
     virtual bool ConsumeSample(int16_t sample[2]) override;
+    virtual bool WantsMono() override { return true; } // DeltaSigma() mixes down to one bitstream
     
     bool SetOversampling(int os);
     
@@ -40,6 +40,7 @@ bool AudioOutputMixerStub::SetRate(int hz)
 
 bool AudioOutputMixerStub::SetBitsPerSample(int bits)
 {
+  if ((bits != 16) && (bits != 8)) return false; // Passes 16-bit samples on, wider ones are dithered first
   return parent->SetBitsPerSample(bits, id);
 }
 
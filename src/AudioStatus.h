@@ -35,6 +35,7 @@ class AudioStatus
 
     typedef void (*metadataCBFn)(void *cbData, const char *type, bool isUnicode, const char *str);
     bool RegisterMetadataCB(metadataCBFn f, void *cbData) { mdFn = f; mdData = cbData; return true; }
+    bool HasMetadataCB() const { return mdFn != NULL; }
 
     // Returns a unique warning/error code, varying by the object.  The string may be a PSTR, use _P functions!
     typedef void (*statusCBFn)(void *cbData, int code, const char *string);
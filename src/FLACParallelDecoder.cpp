@@ -0,0 +1,697 @@
+/*
+  FLACParallelDecoder
+  Splits a FLAC stream into frames and decodes them on several cores at once
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FLACParallelDecoder.h"
+
+#pragma GCC optimize ("O3")
+
+FLACParallelDecoder::FLACParallelDecoder()
+{
+  file = NULL;
+  threads = 0;
+  for (int i = 0; i < MAX_THREADS; i++) {
+    workers[i].owner = this;
+    workers[i].index = i;
+    workers[i].dec = NULL;
+    workers[i].state = EMPTY;
+    workers[i].data = NULL;
+#if defined(ESP32)
+    workers[i].task = NULL;
+    workers[i].wake = NULL;
+    workers[i].exited = NULL;
+#elif defined(FLAC_PARALLEL_DECODE)
+    workers[i].started = false;
+#endif
+  }
+  head = 0;
+  tail = 0;
+  playing = false;
+  quit = false;
+  sampleRate = 0;
+  channels = 0;
+  bitsPerSample = 0;
+  totalSamples = 0;
+  maxBlocksize = 0;
+  maxFrame = 0;
+  firstFrame = 0;
+  seekTableSize = 0;
+  scan = NULL;
+  scanSize = 0;
+  scanStart = 0;
+  scanEnd = 0;
+  scanPos = 0;
+  eof = false;
+  variable = false;
+  skip = 0;
+#if defined(ESP32)
+  mutex = NULL;
+#elif defined(FLAC_PARALLEL_DECODE)
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+#endif
+}
+
+FLACParallelDecoder::~FLACParallelDecoder()
+{
+  End();
+#if !defined(ESP32) && defined(FLAC_PARALLEL_DECODE)
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+#endif
+}
+
+bool FLACParallelDecoder::Available()
+{
+#if defined(ESP32)
+  return portNUM_PROCESSORS > 1;
+#elif defined(FLAC_PARALLEL_DECODE)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool FLACParallelDecoder::Begin(AudioFileSource *source, int threads)
+{
+  End();
+  if (!Available() || (threads < 2) || (threads > MAX_THREADS)) return false;
+  file = source;
+  this->threads = threads;
+  if (!ReadHeader()) {
+    End();
+    return false;
+  }
+  // The block size strategy is the same for the whole stream, see what the first frame says
+  uint64_t number;
+  uint32_t blocksize;
+  Fill();
+  if (!ParseHeader(scan + scanStart, scanEnd - scanStart, &number, &blocksize, &variable)) {
+    End();
+    return false;
+  }
+
+#if defined(ESP32)
+  mutex = xSemaphoreCreateMutex();
+  if (!mutex) {
+    End();
+    return false;
+  }
+#endif
+  for (int i = 0; i < threads; i++) {
+    Worker *w = &workers[i];
+    w->data = (uint8_t*)malloc(maxFrame);
+    w->dec = FLAC__stream_decoder_new();
+    if (!w->data || !w->dec) {
+      End();
+      return false;
+    }
+    (void)FLAC__stream_decoder_set_md5_checking(w->dec, false);
+    if (FLAC__stream_decoder_init_stream(w->dec, _read_cb, NULL, NULL, NULL, NULL, _write_cb, NULL, _error_cb, w) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+      End();
+      return false;
+    }
+    // The frames refer back to the STREAMINFO for anything their header leaves out
+    w->in = streamHeader;
+    w->inLen = sizeof(streamHeader);
+    if (!FLAC__stream_decoder_process_until_end_of_metadata(w->dec) || (FLAC__stream_decoder_get_state(w->dec) != FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC)) {
+      End();
+      return false;
+    }
+    w->state = EMPTY;
+  }
+  quit = false;
+  for (int i = 1; i < threads; i++) {
+    if (!StartTask(&workers[i])) {
+      End();
+      return false;
+    }
+  }
+  head = 0;
+  tail = 0;
+  playing = false;
+  skip = 0;
+  return true;
+}
+
+void FLACParallelDecoder::End()
+{
+  if (threads) {
+    Lock();
+    quit = true;
+    Unlock();
+    for (int i = 1; i < threads; i++) StopTask(&workers[i]);
+  }
+  for (int i = 0; i < MAX_THREADS; i++) {
+    if (workers[i].dec) FLAC__stream_decoder_delete(workers[i].dec);
+    workers[i].dec = NULL;
+    free(workers[i].data);
+    workers[i].data = NULL;
+    workers[i].state = EMPTY;
+  }
+#if defined(ESP32)
+  if (mutex) vSemaphoreDelete(mutex);
+  mutex = NULL;
+#endif
+  free(scan);
+  scan = NULL;
+  threads = 0;
+  file = NULL;
+}
+
+// fLaC, the metadata blocks and an ID3v2 tag in front if there is one.  Keeps a copy of the
+// STREAMINFO and sets up the scan buffer, leaving source at the first frame.
+bool FLACParallelDecoder::ReadHeader()
+{
+  uint8_t hdr[10];
+  uint32_t pos = file->getReadPos();
+  if (file->read(hdr, 4) != 4) return false;
+  pos += 4;
+  if (!memcmp(hdr, "ID3", 3)) {
+    if (file->read(hdr + 4, 6) != 6) return false;
+    uint32_t tagLen = ((hdr[6] & 0x7f) << 21) | ((hdr[7] & 0x7f) << 14) | ((hdr[8] & 0x7f) << 7) | (hdr[9] & 0x7f);
+    if (hdr[5] & 0x10) tagLen += 10; // Footer
+    pos += 6;
+    while (tagLen) {
+      uint8_t junk[32];
+      int chunk = (tagLen > sizeof(junk)) ? sizeof(junk) : tagLen;
+      if (file->read(junk, chunk) != (uint32_t)chunk) return false;
+      tagLen -= chunk;
+      pos += chunk;
+    }
+    if (file->read(hdr, 4) != 4) return false;
+    pos += 4;
+  }
+  if (memcmp(hdr, "fLaC", 4)) return false;
+
+  // STREAMINFO always comes first
+  uint8_t *si = streamHeader + 8;
+  if ((file->read(streamHeader + 4, 4) != 4) || ((streamHeader[4] & 0x7f) != 0)) return false;
+  if ((streamHeader[5] != 0) || (streamHeader[6] != 0) || (streamHeader[7] != 34)) return false;
+  if (file->read(si, 34) != 34) return false;
+  pos += 38;
+  bool last = streamHeader[4] & 0x80;
+  memcpy(streamHeader, "fLaC", 4);
+  streamHeader[4] = 0x80; // The only block the decoders get
+
+  maxBlocksize = (si[2] << 8) | si[3];
+  uint32_t infoMaxFrame = ((uint32_t)si[7] << 16) | (si[8] << 8) | si[9];
+  sampleRate = ((uint32_t)si[10] << 12) | (si[11] << 4) | (si[12] >> 4);
+  channels = ((si[12] >> 1) & 7) + 1;
+  bitsPerSample = (((si[12] & 1) << 4) | (si[13] >> 4)) + 1;
+  totalSamples = ((uint64_t)(si[13] & 15) << 32) | ((uint32_t)si[14] << 24) | ((uint32_t)si[15] << 16) | (si[16] << 8) | si[17];
+  if (!maxBlocksize || !sampleRate) return false;
+
+  // No frame is larger than storing its samples verbatim, the encoder falls back to that
+  uint32_t verbatim = ((maxBlocksize * channels * (bitsPerSample + 1)) + 7) / 8 + 2 * channels + MAX_HEADER + 2;
+  maxFrame = (infoMaxFrame > verbatim) ? infoMaxFrame : verbatim;
+  scanSize = 2 * (maxFrame + MAX_HEADER);
+  scan = (uint8_t*)malloc(scanSize);
+  if (!scan) return false;
+
+  seekTableSize = 0;
+  while (!last) {
+    if (file->read(hdr, 4) != 4) return false;
+    pos += 4;
+    last = hdr[0] & 0x80;
+    uint32_t len = ((uint32_t)hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+    pos += len;
+    if ((hdr[0] & 0x7f) == 3) {
+      // SEEKTABLE, every stride'th point is kept so a long one still covers the whole stream.  Its
+      // offsets count from the first frame, which comes after all the metadata.
+      uint32_t points = len / 18;
+      uint32_t stride = (points + SEEK_TABLE - 1) / SEEK_TABLE;
+      for (uint32_t i = 0; i < points; i++) {
+        uint8_t pt[18];
+        if (file->read(pt, 18) != 18) return false;
+        len -= 18;
+        // Placeholders (all ones) and anything past 32 bits fail the top word check
+        bool small = !(pt[0] | pt[1] | pt[2] | pt[3] | pt[8] | pt[9] | pt[10] | pt[11]);
+        if ((i % stride) || !small || (seekTableSize == SEEK_TABLE)) continue;
+        seekTable[seekTableSize].sample = ((uint32_t)pt[4] << 24) | ((uint32_t)pt[5] << 16) | (pt[6] << 8) | pt[7];
+        seekTable[seekTableSize].offset = ((uint32_t)pt[12] << 24) | ((uint32_t)pt[13] << 16) | (pt[14] << 8) | pt[15];
+        seekTableSize++;
+      }
+    }
+    while (len) {
+      int chunk = (len > (uint32_t)scanSize) ? scanSize : len;
+      if (file->read(scan, chunk) != (uint32_t)chunk) return false;
+      len -= chunk;
+    }
+  }
+  firstFrame = pos;
+  for (int i = 0; i < seekTableSize; i++) {
+    if (seekTable[i].offset > 0xffffffff - pos) {
+      seekTableSize = i;
+      break;
+    }
+    seekTable[i].offset += pos;
+  }
+  scanPos = pos;
+  scanStart = 0;
+  scanEnd = 0;
+  eof = false;
+  return true;
+}
+
+bool FLACParallelDecoder::SeekTablePoint(int i, uint32_t *sample, uint32_t *offset) const
+{
+  if ((i < 0) || (i >= seekTableSize)) return false;
+  *sample = seekTable[i].sample;
+  *offset = seekTable[i].offset;
+  return true;
+}
+
+// Top up the scan buffer, first moving what's left to the front if the room after it couldn't take
+// a whole frame and the next header
+void FLACParallelDecoder::Fill()
+{
+  if (scanSize - scanStart < maxFrame + MAX_HEADER) {
+    memmove(scan, scan + scanStart, scanEnd - scanStart);
+    scanPos += scanStart;
+    scanEnd -= scanStart;
+    scanStart = 0;
+  }
+  while (!eof && (scanEnd < scanSize)) {
+    int got = file->read(scan + scanEnd, scanSize - scanEnd);
+    if (got <= 0) eof = true;
+    else scanEnd += got;
+  }
+}
+
+static uint8_t Crc8(const uint8_t *p, int len)
+{
+  uint8_t crc = 0;
+  while (len--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Length of the frame header at p, 0 if there isn't a valid one.  Returns the frame number (fixed
+// block size) or sample number (variable), the block size and which of the two the stream uses.
+int FLACParallelDecoder::ParseHeader(const uint8_t *p, int avail, uint64_t *number, uint32_t *blocksize, bool *var)
+{
+  if ((avail < 6) || (p[0] != 0xff) || ((p[1] & 0xfe) != 0xf8)) return 0;
+  int bsCode = p[2] >> 4;
+  int srCode = p[2] & 15;
+  int chCode = p[3] >> 4;
+  int ssCode = (p[3] >> 1) & 7;
+  if (!bsCode || (srCode == 15) || (chCode > 10) || (ssCode == 3) || (ssCode == 7) || (p[3] & 1)) return 0;
+
+  // UTF-8 style coded number
+  uint64_t v = p[4];
+  int extra;
+  if (!(v & 0x80)) { extra = 0; }
+  else if ((v & 0xe0) == 0xc0) { v &= 0x1f; extra = 1; }
+  else if ((v & 0xf0) == 0xe0) { v &= 0x0f; extra = 2; }
+  else if ((v & 0xf8) == 0xf0) { v &= 0x07; extra = 3; }
+  else if ((v & 0xfc) == 0xf8) { v &= 0x03; extra = 4; }
+  else if ((v & 0xfe) == 0xfc) { v &= 0x01; extra = 5; }
+  else if ((v == 0xfe) && (p[1] & 1)) { v = 0; extra = 6; } // Only sample numbers go to 36 bits
+  else return 0;
+  int i = 5;
+  int tail = ((bsCode == 6) ? 1 : (bsCode == 7) ? 2 : 0) + ((srCode == 12) ? 1 : ((srCode == 13) || (srCode == 14)) ? 2 : 0);
+  if (i + extra + tail + 1 > avail) return 0;
+  for (int j = 0; j < extra; j++) {
+    if ((p[i] & 0xc0) != 0x80) return 0;
+    v = (v << 6) | (p[i++] & 0x3f);
+  }
+
+  uint32_t bs;
+  if (bsCode == 1) bs = 192;
+  else if (bsCode <= 5) bs = 576 << (bsCode - 2);
+  else if (bsCode == 6) bs = p[i] + 1;
+  else if (bsCode == 7) bs = ((p[i] << 8) | p[i + 1]) + 1;
+  else bs = 256 << (bsCode - 8);
+  i += tail;
+  if (Crc8(p, i) != p[i]) return 0;
+
+  *number = v;
+  *blocksize = bs;
+  *var = p[1] & 1;
+  return i + 1;
+}
+
+// Find the next frame, at scan[scanStart] and *len bytes long.  False at the end of the stream.
+bool FLACParallelDecoder::NextScan(int *len, uint64_t *sample, uint32_t *blocksize)
+{
+  while (true) {
+    Fill();
+    if (scanStart >= scanEnd) return false;
+    uint64_t number;
+    uint32_t bs;
+    bool var;
+    int hdrLen = ParseHeader(scan + scanStart, scanEnd - scanStart, &number, &bs, &var);
+    if (!hdrLen || (var != variable)) {
+      // Lost track, e.g. right after a seek into garbage.  Any header will do to start again, the
+      // check for the one following it weeds out false syncs.
+      int from = scanStart + 1;
+      scanStart = scanEnd;
+      int p = from;
+      while (p < scanEnd) {
+        const uint8_t *ff = (const uint8_t *)memchr(scan + p, 0xff, scanEnd - p);
+        if (!ff) break;
+        p = ff - scan;
+        if (ParseHeader(ff, scanEnd - p, &number, &bs, &var) && (var == variable)) {
+          scanStart = p;
+          break;
+        }
+        p++;
+      }
+      if (scanStart == scanEnd) {
+        if (eof) return false;
+        // A header cut off by the end of the buffer gets another look once there's more
+        scanStart = (scanEnd - (MAX_HEADER - 1) > from) ? scanEnd - (MAX_HEADER - 1) : from;
+      }
+      continue;
+    }
+
+    // The frame ends where the one carrying on from it starts
+    uint64_t next = variable ? number + bs : number + 1;
+    int end = -1;
+    int p = scanStart + hdrLen;
+    while (p < scanEnd) {
+      const uint8_t *ff = (const uint8_t *)memchr(scan + p, 0xff, scanEnd - p);
+      if (!ff) break;
+      p = ff - scan;
+      uint64_t n;
+      uint32_t b;
+      bool v;
+      if (ParseHeader(ff, scanEnd - p, &n, &b, &v) && (v == variable) && (n == next)) {
+        end = p;
+        break;
+      }
+      p++;
+    }
+    if (end < 0) {
+      if (!eof) {
+        // A whole frame's worth of bytes without the next header, so this one was a false sync
+        scanStart++;
+        continue;
+      }
+      end = scanEnd; // The last frame
+    }
+
+    *len = end - scanStart;
+    *sample = variable ? number : number * maxBlocksize;
+    *blocksize = bs;
+    return true;
+  }
+}
+
+uint8_t FLACParallelDecoder::State(Worker *w)
+{
+  Lock();
+  uint8_t state = w->state;
+  Unlock();
+  return state;
+}
+
+void FLACParallelDecoder::SetState(Worker *w, uint8_t state)
+{
+  Lock();
+  w->state = state;
+  Unlock();
+  if (state == PENDING) Wake(w);
+}
+
+// Hand the coming frames to every decoder that's free, in turn
+void FLACParallelDecoder::Dispatch()
+{
+  while (State(&workers[tail]) == EMPTY) {
+    int len;
+    uint64_t sample;
+    uint32_t blocksize;
+    if (!NextScan(&len, &sample, &blocksize)) return;
+    Worker *w = &workers[tail];
+    w->offset = scanPos + scanStart;
+    w->sample = sample;
+    w->dataLen = (len > maxFrame) ? maxFrame : len; // Only junk after the last frame can be longer
+    memcpy(w->data, scan + scanStart, w->dataLen);
+    scanStart += len;
+    if (sample + blocksize <= skip) continue; // Seeking past it
+    SetState(w, PENDING);
+    tail = (tail + 1) % threads;
+  }
+}
+
+void FLACParallelDecoder::Decode(Worker *w)
+{
+  w->len = 0;
+  w->in = w->data;
+  w->inLen = w->dataLen;
+  FLAC__stream_decoder_flush(w->dec);
+  FLAC__stream_decoder_process_single(w->dec);
+}
+
+int FLACParallelDecoder::NextFrame(Frame *f)
+{
+  if (!threads) return -1;
+  if (playing) {
+    SetState(&workers[head], EMPTY);
+    head = (head + 1) % threads;
+    playing = false;
+  }
+  while (true) {
+    Dispatch();
+    Worker *w = &workers[head];
+    uint8_t state = State(w);
+    if (state == EMPTY) return -1; // Nothing left to hand out
+    // Our own decoder's frame gets done when it's the next to play or while waiting on another
+    if (State(&workers[0]) == PENDING && ((head == 0) || (state != DONE))) {
+      Decode(&workers[0]);
+      SetState(&workers[0], DONE);
+      state = State(w);
+    }
+    if (state != DONE) return 0;
+    if (!w->len) {
+      // Didn't decode, go on with the next one
+      SetState(w, EMPTY);
+      head = (head + 1) % threads;
+      continue;
+    }
+    f->pcm[0] = w->pcm[0];
+    f->pcm[1] = w->pcm[1];
+    f->len = w->len;
+    f->sample = w->sample;
+    f->offset = w->offset;
+    playing = true;
+    return 1;
+  }
+}
+
+bool FLACParallelDecoder::Restart(uint32_t offset, uint64_t skip)
+{
+  if (!threads) return false;
+  // Let the tasks finish what they're on, then drop everything
+  for (int i = 0; i < threads; i++) {
+    Lock();
+    if (workers[i].state == PENDING) workers[i].state = EMPTY;
+    Unlock();
+    while (State(&workers[i]) == BUSY) Pause();
+    SetState(&workers[i], EMPTY);
+  }
+  head = 0;
+  tail = 0;
+  playing = false;
+  if (!file->seek(offset, SEEK_SET)) return false;
+  scanPos = offset;
+  scanStart = 0;
+  scanEnd = 0;
+  eof = false;
+  this->skip = skip;
+  return true;
+}
+
+// Decode task body, for every decoder but the caller's
+void FLACParallelDecoder::Run(Worker *w)
+{
+  while (true) {
+    Lock();
+    while ((w->state != PENDING) && !quit) Wait(w);
+    if (quit) {
+      Unlock();
+      break;
+    }
+    w->state = BUSY;
+    Unlock();
+    Decode(w);
+    SetState(w, DONE);
+  }
+}
+
+FLAC__StreamDecoderReadStatus FLACParallelDecoder::_read_cb(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data)
+{
+  (void) decoder;
+  Worker *w = static_cast<Worker*>(client_data);
+  if (*bytes > (size_t)w->inLen) *bytes = w->inLen;
+  if (!*bytes) return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+  memcpy(buffer, w->in, *bytes);
+  w->in += *bytes;
+  w->inLen -= *bytes;
+  return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus FLACParallelDecoder::_write_cb(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data)
+{
+  (void) decoder;
+  Worker *w = static_cast<Worker*>(client_data);
+  // libflac keeps these until the next frame is decoded, which isn't until this one's been played
+  w->pcm[0] = buffer[0];
+  w->pcm[1] = (frame->header.channels > 1) ? buffer[1] : buffer[0];
+  w->len = frame->header.blocksize;
+  return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FLACParallelDecoder::_error_cb(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data)
+{
+  // Called from the decode tasks, so nothing to report to.  A frame failing its CRC comes out silent.
+  (void) decoder;
+  (void) status;
+  (void) client_data;
+}
+
+#if defined(ESP32)
+
+void FLACParallelDecoder::_run(void *param)
+{
+  Worker *w = static_cast<Worker*>(param);
+  w->owner->Run(w);
+  xSemaphoreGive(w->exited);
+  vTaskDelete(NULL);
+}
+
+bool FLACParallelDecoder::StartTask(Worker *w)
+{
+  w->wake = xSemaphoreCreateBinary();
+  w->exited = xSemaphoreCreateBinary();
+  if (!w->wake || !w->exited) return false;
+  int core = (xPortGetCoreID() + w->index) % portNUM_PROCESSORS;
+  if (xTaskCreatePinnedToCore(_run, "flacdec", 8192, w, uxTaskPriorityGet(NULL), &w->task, core) != pdPASS) {
+    w->task = NULL;
+    return false;
+  }
+  return true;
+}
+
+void FLACParallelDecoder::StopTask(Worker *w)
+{
+  if (w->task) {
+    Wake(w);
+    xSemaphoreTake(w->exited, portMAX_DELAY);
+    w->task = NULL;
+  }
+  if (w->wake) vSemaphoreDelete(w->wake);
+  if (w->exited) vSemaphoreDelete(w->exited);
+  w->wake = NULL;
+  w->exited = NULL;
+}
+
+void FLACParallelDecoder::Lock()
+{
+  if (mutex) xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void FLACParallelDecoder::Unlock()
+{
+  if (mutex) xSemaphoreGive(mutex);
+}
+
+void FLACParallelDecoder::Wait(Worker *w)
+{
+  Unlock();
+  xSemaphoreTake(w->wake, portMAX_DELAY);
+  Lock();
+}
+
+void FLACParallelDecoder::Wake(Worker *w)
+{
+  if (w->wake) xSemaphoreGive(w->wake);
+}
+
+void FLACParallelDecoder::Pause()
+{
+  vTaskDelay(1);
+}
+
+#elif defined(FLAC_PARALLEL_DECODE)
+
+void FLACParallelDecoder::_run(void *param)
+{
+  Worker *w = static_cast<Worker*>(param);
+  w->owner->Run(w);
+}
+
+bool FLACParallelDecoder::StartTask(Worker *w)
+{
+  w->started = !pthread_create(&w->thread, NULL, _thread, w);
+  return w->started;
+}
+
+void FLACParallelDecoder::StopTask(Worker *w)
+{
+  if (w->started) {
+    Wake(w);
+    pthread_join(w->thread, NULL);
+    w->started = false;
+  }
+}
+
+void FLACParallelDecoder::Lock()
+{
+  pthread_mutex_lock(&mutex);
+}
+
+void FLACParallelDecoder::Unlock()
+{
+  pthread_mutex_unlock(&mutex);
+}
+
+void FLACParallelDecoder::Wait(Worker *w)
+{
+  (void) w;
+  pthread_cond_wait(&cond, &mutex);
+}
+
+void FLACParallelDecoder::Wake(Worker *w)
+{
+  (void) w;
+  pthread_cond_broadcast(&cond);
+}
+
+void FLACParallelDecoder::Pause()
+{
+  sched_yield();
+}
+
+#else
+
+// Single core, Begin() never gets as far as starting anything
+void FLACParallelDecoder::_run(void *param) { (void) param; }
+bool FLACParallelDecoder::StartTask(Worker *w) { (void) w; return false; }
+void FLACParallelDecoder::StopTask(Worker *w) { (void) w; }
+void FLACParallelDecoder::Lock() { }
+void FLACParallelDecoder::Unlock() { }
+void FLACParallelDecoder::Wait(Worker *w) { (void) w; }
+void FLACParallelDecoder::Wake(Worker *w) { (void) w; }
+void FLACParallelDecoder::Pause() { }
+
+#endif
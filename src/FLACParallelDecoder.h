@@ -0,0 +1,180 @@
+/*
+  FLACParallelDecoder
+  Splits a FLAC stream into frames and decodes them on several cores at once
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FLACPARALLELDECODER_H
+#define _FLACPARALLELDECODER_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+extern "C" {
+    #include "libflac/FLAC/stream_decoder.h"
+};
+
+#if defined(ESP32)
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+  #include <freertos/semphr.h>
+  #define FLAC_PARALLEL_DECODE 1
+#elif !defined(ARDUINO)
+  #include <pthread.h>
+  #define FLAC_PARALLEL_DECODE 1
+#endif
+
+// FLAC frames only depend on the STREAMINFO, so once their boundaries are known they can be decoded
+// in any order.  The stream is cut into frames on the calling core by looking for frame headers
+// (sync code, valid CRC-8, and the frame or sample number following on from the last frame's), and
+// the frames are dealt out round robin to a decoder per thread: the caller's own and one task on each
+// other core (FreeRTOS on the ESP32, pthreads on the host).  Each decoder holds on to its output
+// until it has been played, so frames come back in order without copying.  Memory is a libflac
+// decoder plus one maximum size frame per thread, which on an ESP32 means PSRAM.
+class FLACParallelDecoder
+{
+  public:
+    enum { MAX_THREADS = 4 };
+
+    struct Frame {
+      const FLAC__int32 *pcm[2]; // Both the same channel for mono
+      uint32_t len;
+      uint64_t sample;           // Stream sample number of pcm[][0]
+      uint32_t offset;           // Source offset of the frame
+    };
+
+    // Whether this platform has more than one core to decode on
+    static bool Available();
+
+    FLACParallelDecoder();
+    ~FLACParallelDecoder();
+
+    // Read the stream header from source and start threads-1 decode tasks.  False if it's not a FLAC
+    // stream or there's not enough memory, the source may have been read from by then.
+    bool Begin(AudioFileSource *source, int threads);
+    void End();
+
+    uint32_t SampleRate() const { return sampleRate; }
+    int Channels() const { return channels; }
+    int BitsPerSample() const { return bitsPerSample; }
+    uint64_t TotalSamples() const { return totalSamples; }
+    uint32_t FixedBlocksize() const { return variable ? 0 : maxBlocksize; }
+    uint32_t FirstFrame() const { return firstFrame; }
+    // The i'th point kept from the stream's SEEKTABLE, false past the last.  Offsets are in the source.
+    bool SeekTablePoint(int i, uint32_t *sample, uint32_t *offset) const;
+
+    // The next frame in stream order, valid until the next call.  1 with a frame, 0 while it's still
+    // being decoded, -1 at the end of the stream.
+    int NextFrame(Frame *f);
+    // Go on from the frame at source offset, dropping frames that end at or before sample skip
+    // without decoding them.  Needs a seekable source.
+    bool Restart(uint32_t offset, uint64_t skip);
+
+  private:
+    enum { MAX_HEADER = 16, STREAM_HEADER = 42, SEEK_TABLE = 64 };
+    enum { EMPTY, PENDING, BUSY, DONE };
+
+    struct Worker {
+      FLACParallelDecoder *owner;
+      int index;
+      FLAC__StreamDecoder *dec;
+      volatile uint8_t state;
+      uint8_t *data;      // The frame to decode
+      int dataLen;
+      const uint8_t *in;  // What's left of data (or the stream header) for the read callback
+      int inLen;
+      uint64_t sample;
+      uint32_t offset;
+      uint32_t len;       // Decoded samples, 0 if the frame didn't decode
+      const FLAC__int32 *pcm[2];
+#if defined(ESP32)
+      TaskHandle_t task;
+      SemaphoreHandle_t wake;
+      SemaphoreHandle_t exited;
+#elif defined(FLAC_PARALLEL_DECODE)
+      pthread_t thread;
+      bool started;
+#endif
+    };
+
+    AudioFileSource *file;
+    int threads;
+    Worker workers[MAX_THREADS];
+    int head;           // Worker with the next frame to play
+    int tail;           // Worker to hand the next frame to
+    bool playing;       // The head worker's frame has been handed out
+    volatile bool quit;
+    uint8_t streamHeader[STREAM_HEADER]; // fLaC and the STREAMINFO, fed to each decoder first
+
+    // From STREAMINFO
+    uint32_t sampleRate;
+    int channels;
+    int bitsPerSample;
+    uint64_t totalSamples;
+    uint32_t maxBlocksize;
+    int maxFrame;
+    uint32_t firstFrame;
+    // Up to SEEK_TABLE points spread over the SEEKTABLE, if there is one
+    struct { uint32_t sample, offset; } seekTable[SEEK_TABLE];
+    int seekTableSize;
+
+    // Frame scanner
+    uint8_t *scan;
+    int scanSize;
+    int scanStart;      // First byte of the next frame
+    int scanEnd;
+    uint32_t scanPos;   // Source offset of scan[0]
+    bool eof;
+    bool variable;      // Variable block size stream, headers carry sample instead of frame numbers
+    uint64_t skip;
+
+#if defined(ESP32)
+    SemaphoreHandle_t mutex;
+#elif defined(FLAC_PARALLEL_DECODE)
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+
+    bool ReadHeader();
+    void Fill();
+    int ParseHeader(const uint8_t *p, int avail, uint64_t *number, uint32_t *blocksize, bool *var);
+    bool NextScan(int *len, uint64_t *sample, uint32_t *blocksize);
+    void Dispatch();
+    void Decode(Worker *w);
+    uint8_t State(Worker *w);
+    void SetState(Worker *w, uint8_t state);
+
+    // Platform threading
+    bool StartTask(Worker *w);
+    void StopTask(Worker *w);
+    void Lock();
+    void Unlock();
+    void Wait(Worker *w);
+    void Wake(Worker *w);
+    void Pause();
+    void Run(Worker *w);
+    static void _run(void *param);
+#if !defined(ESP32) && defined(FLAC_PARALLEL_DECODE)
+    static void *_thread(void *param) { _run(param); return NULL; }
+#endif
+
+    // libflac callbacks for the per-thread decoders
+    static FLAC__StreamDecoderReadStatus _read_cb(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data);
+    static FLAC__StreamDecoderWriteStatus _write_cb(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data);
+    static void _error_cb(const FLAC__StreamDecoder *decoder, FLAC__StreamDecoderErrorStatus status, void *client_data);
+};
+
+#endif
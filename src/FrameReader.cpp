@@ -0,0 +1,204 @@
+/*
+  FrameReader
+  Ring-buffered sync search and framing for the Helix MP3 and AAC generators
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameReader.h"
+
+#pragma GCC optimize ("O3")
+
+FrameReader::FrameReader(int ringSize, int maxFrame, int headerLen, const uint8_t *fixedMask, FrameLengthFn frameLength)
+{
+  file = NULL;
+  buff = NULL;
+  this->ringSize = ringSize;
+  this->maxFrame = maxFrame;
+  this->headerLen = headerLen;
+  this->fixedMask = fixedMask;
+  this->frameLength = frameLength;
+  rd = 0;
+  avail = 0;
+  eof = false;
+  locked = false;
+  haveRef = false;
+}
+
+void FrameReader::Begin(AudioFileSource *source, uint8_t *buffer, const uint8_t *head, int headLen)
+{
+  file = source;
+  buff = buffer;
+  haveRef = false;
+  Flush();
+  if (head && (headLen > 0) && (headLen <= ringSize)) {
+    memcpy(buff, head, headLen);
+    avail = headLen;
+  }
+}
+
+void FrameReader::Flush()
+{
+  rd = 0;
+  avail = 0;
+  eof = false;
+  locked = false;
+}
+
+void FrameReader::Header(int ofs, uint8_t *hdr) const
+{
+  for (int i = 0; i < headerLen; i++) hdr[i] = At(ofs + i);
+}
+
+// Make sure at least len bytes are buffered, filling all free space while at it.  False at EOF.
+bool FrameReader::Need(int len)
+{
+  if (len > ringSize) return false;
+  while ((avail < len) && !eof) {
+    int wr = rd + avail;
+    if (wr >= ringSize) wr -= ringSize;
+    int chunk = ringSize - avail;
+    if (chunk > ringSize - wr) chunk = ringSize - wr;
+    int got = file->read(buff + wr, chunk);
+    if (got <= 0) {
+      eof = true;
+    } else {
+      avail += got;
+    }
+  }
+  return avail >= len;
+}
+
+void FrameReader::Consume(int len)
+{
+  if (len > avail) len = avail;
+  avail -= len;
+  if (!avail) {
+    rd = 0; // Start over at the beginning, fewer frames will wrap
+  } else {
+    rd += len;
+    if (rd >= ringSize) rd -= ringSize;
+  }
+}
+
+// First 0xff in [p, end), end if none.  Checks a word at a time where it can.
+static const uint8_t *FindFF(const uint8_t *p, const uint8_t *end)
+{
+  while ((p < end) && ((uintptr_t)p & 3)) {
+    if (*p == 0xff) return p;
+    p++;
+  }
+  while (p + 4 <= end) {
+    uint32_t x;
+    memcpy(&x, p, 4); // Aligned, so a single load
+    x = ~x;
+    if ((x - 0x01010101) & ~x & 0x80808080) break; // Some byte of x is 0, so that byte of the word is 0xff
+    p += 4;
+  }
+  while ((p < end) && (*p != 0xff)) p++;
+  return p;
+}
+
+// Offset of the first position holding a valid frame header, -1 if none
+int FrameReader::FindSync()
+{
+  uint8_t hdr[MAX_HEADER];
+  int limit = avail - headerLen + 1;
+  int ofs = 0;
+  while (ofs < limit) {
+    int i = rd + ofs;
+    if (i >= ringSize) i -= ringSize;
+    int run = limit - ofs;
+    if (run > ringSize - i) run = ringSize - i;
+    int skip = FindFF(buff + i, buff + i + run) - (buff + i);
+    ofs += skip;
+    if (skip < run) {
+      Header(ofs, hdr);
+      if (frameLength(hdr)) return ofs;
+      ofs++;
+    }
+  }
+  return -1;
+}
+
+bool FrameReader::SameStream(const uint8_t *a, const uint8_t *b) const
+{
+  for (int i = 0; i < headerLen; i++) {
+    if ((a[i] ^ b[i]) & fixedMask[i]) return false;
+  }
+  return true;
+}
+
+// Whether the header at ofs is followed by more of the same stream, up to depth frames deep.
+// Can't tell at the very end of the data, so yes.
+bool FrameReader::Confirmed(const uint8_t *hdr, int ofs, int depth)
+{
+  int len = frameLength(hdr);
+  if ((len < 0) || !Need(ofs + len + headerLen)) return true;
+  uint8_t next[MAX_HEADER];
+  Header(ofs + len, next);
+  if (!frameLength(next) || !SameStream(hdr, next)) return false;
+  return (depth <= 1) || Confirmed(next, ofs + len, depth - 1);
+}
+
+// Copy what wraps of the next len bytes past the end of the ring, so they are contiguous
+void FrameReader::Mirror(int len)
+{
+  int over = rd + len - ringSize;
+  if (over > 0) memcpy(buff + ringSize, buff, over);
+}
+
+bool FrameReader::NextFrame(uint8_t **frame, int *len)
+{
+  uint8_t hdr[MAX_HEADER];
+  while (true) {
+    if (!Need(headerLen)) return false;
+    int ofs = FindSync();
+    if (ofs < 0) {
+      // Keep just what could be the start of a header cut off by the end of the data
+      Consume(avail - (headerLen - 1));
+      if (eof) return false;
+      continue;
+    }
+    if (ofs) {
+      Consume(ofs);
+      locked = false;
+    }
+
+    // Right where the last good frame ended needs no second opinion, anywhere else it does.  One
+    // that doesn't look like the frames so far needs a third.
+    Header(0, hdr);
+    int frameLen = frameLength(hdr);
+    bool known = haveRef && SameStream(hdr, lastHdr);
+    if ((frameLen > maxFrame) || (!(locked && known) && !Confirmed(hdr, 0, known ? 1 : 2))) {
+      Consume(1); // Not a real frame, look again from the next byte
+      locked = false;
+      continue;
+    }
+    if (frameLen < 0) {
+      frameLen = maxFrame; // Decoder finds the end by itself
+    }
+    Need(frameLen);
+    if (frameLen > avail) frameLen = avail;
+    Mirror(frameLen);
+    memcpy(lastHdr, hdr, headerLen);
+    haveRef = true;
+    locked = true;
+    *frame = buff + rd;
+    *len = frameLen;
+    return true;
+  }
+}
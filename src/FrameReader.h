@@ -0,0 +1,86 @@
+/*
+  FrameReader
+  Ring-buffered sync search and framing for the Helix MP3 and AAC generators
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FRAMEREADER_H
+#define _FRAMEREADER_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+
+// Finds frames of a sync-word based stream (MP3, AAC ADTS) in a ring buffer and hands them to the
+// decoder in place.  A candidate sync is only taken when its header parses and the header one frame
+// length later belongs to the same stream, so garbage in a radio stream costs a byte-skip instead of
+// a buffer.  The ring is followed by a mirror area the size of the largest frame; the start of a
+// frame which wraps around the end of the ring is copied there so the decoder always sees it whole.
+class FrameReader
+{
+  public:
+    // Frame length in bytes of the header at hdr, 0 if it isn't a valid header, -1 if valid but of
+    // unknown length (MP3 free format)
+    typedef int (*FrameLengthFn)(const uint8_t *hdr);
+
+    enum { MAX_HEADER = 8 };
+
+    // Two frame headers are of the same stream when the bits set in fixedMask (headerLen bytes) are
+    // equal in both
+    FrameReader(int ringSize, int maxFrame, int headerLen, const uint8_t *fixedMask, FrameLengthFn frameLength);
+    // Size of the buffer to pass to Begin()
+    int BufferSize() const { return ringSize + maxFrame; }
+
+    // Any bytes already read from the source to identify it are passed in as head
+    void Begin(AudioFileSource *source, uint8_t *buffer, const uint8_t *head = NULL, int headLen = 0);
+    // Throw away everything buffered, i.e. after the source has been seeked
+    void Flush();
+
+    // Find the next frame, false at the end of the stream.  *frame points to *len contiguous bytes,
+    // the whole frame when its length is known.
+    bool NextFrame(uint8_t **frame, int *len);
+    // Done with the first len bytes of the current frame
+    void Consume(int len);
+
+    // Source offset of the current frame
+    uint32_t GetPos() { return file->getReadPos() - avail; }
+
+  private:
+    AudioFileSource *file;
+    uint8_t *buff;
+    int ringSize;
+    int maxFrame;
+    int headerLen;
+    const uint8_t *fixedMask;
+    FrameLengthFn frameLength;
+
+    int rd;    // Ring index of the first valid byte
+    int avail; // Valid bytes from rd on, wrapping
+    bool eof;
+    bool locked;                 // The last frame handed out was good, expect the next right behind it
+    bool haveRef;                // lastHdr is set
+    uint8_t lastHdr[MAX_HEADER]; // Header of the last frame handed out, what the stream looks like
+
+    uint8_t At(int ofs) const { int i = rd + ofs; return buff[(i >= ringSize) ? i - ringSize : i]; }
+    void Header(int ofs, uint8_t *hdr) const;
+    bool Need(int len);
+    int FindSync();
+    bool SameStream(const uint8_t *a, const uint8_t *b) const;
+    bool Confirmed(const uint8_t *hdr, int ofs, int depth);
+    void Mirror(int len);
+};
+
+#endif
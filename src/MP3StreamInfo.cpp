@@ -0,0 +1,228 @@
+/*
+  MP3StreamInfo
+  Xing/Info, VBRI and LAME tag parsing for duration, seeking and gapless playback
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MP3StreamInfo.h"
+
+// Layer III bitrates in kbit/s, MPEG1 and MPEG2/2.5
+static const uint16_t bitrateTab[2][15] PROGMEM = {
+  { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+  { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160 }
+};
+static const uint16_t rateTab[3] PROGMEM = { 44100, 48000, 32000 };
+
+// Samples the synthesis filterbank lags the input by, as assumed by the LAME delay field
+static const uint32_t decoderDelay = 529;
+
+static uint32_t be32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+void MP3StreamInfo::Reset()
+{
+  sampleRate = 0;
+  samplesPerFrame = 0;
+  bitrate = 0;
+  firstFrame = 0;
+  tocBase = 0;
+  infoBytes = 0;
+  frames = 0;
+  bytes = 0;
+  hasTOC = false;
+  trimStart = 0;
+  trimEnd = 0;
+}
+
+int MP3StreamInfo::FrameBytes(const uint8_t *hdr)
+{
+  if ((hdr[0] != 0xff) || ((hdr[1] & 0xe0) != 0xe0)) return 0;
+
+  int ver = (hdr[1] >> 3) & 3;   // 3=MPEG1, 2=MPEG2, 0=MPEG2.5
+  int layer = (hdr[1] >> 1) & 3; // 1=Layer III
+  int brIdx = hdr[2] >> 4;
+  int srIdx = (hdr[2] >> 2) & 3;
+  if ((ver == 1) || (layer != 1) || (brIdx == 15) || (srIdx == 3) || ((hdr[3] & 3) == 2)) return 0;
+  if (!brIdx) return -1;
+
+  bool lsf = (ver != 3);
+  uint32_t rate = pgm_read_word(&rateTab[srIdx]) >> (lsf ? ((ver == 0) ? 2 : 1) : 0);
+  uint32_t br = pgm_read_word(&bitrateTab[lsf ? 1 : 0][brIdx]);
+  return (lsf ? 72 : 144) * 1000 * br / rate + ((hdr[2] >> 1) & 1);
+}
+
+bool MP3StreamInfo::Parse(const uint8_t *buff, int len, uint32_t pos)
+{
+  Reset();
+  if ((len < 4) || !FrameBytes(buff)) return false;
+
+  int ver = (buff[1] >> 3) & 3;
+  int brIdx = buff[2] >> 4;
+  int srIdx = (buff[2] >> 2) & 3;
+  bool lsf = (ver != 3);
+  sampleRate = pgm_read_word(&rateTab[srIdx]) >> (lsf ? ((ver == 0) ? 2 : 1) : 0);
+  samplesPerFrame = lsf ? 576 : 1152;
+  bitrate = pgm_read_word(&bitrateTab[lsf ? 1 : 0][brIdx]);
+  firstFrame = pos;
+  if (!bitrate) return false; // Free format, no tag and no way to estimate anything
+
+  // The tag sits where the side info would start (Xing/Info), or at a fixed 32 bytes in (VBRI)
+  bool mono = ((buff[3] >> 6) == 3);
+  int sideInfo = lsf ? (mono ? 9 : 17) : (mono ? 17 : 32);
+  infoBytes = FrameBytes(buff);
+  tocBase = firstFrame;
+  if (!ParseXing(buff + 4 + sideInfo, len - 4 - sideInfo) && !ParseVBRI(buff + 4 + 32, len - 4 - 32)) {
+    infoBytes = 0;
+    return false;
+  }
+
+  bitrate = 0; // The tag frame's bitrate says nothing about the rest of a VBR file
+  return true;
+}
+
+bool MP3StreamInfo::ParseXing(const uint8_t *tag, int len)
+{
+  if ((len < 8) || (memcmp(tag, "Xing", 4) && memcmp(tag, "Info", 4))) return false;
+  uint32_t flags = be32(tag + 4);
+  const uint8_t *p = tag + 8;
+  const uint8_t *end = tag + len;
+
+  if (flags & 0x01) {
+    if (p + 4 > end) return false;
+    frames = be32(p);
+    p += 4;
+  }
+  if (flags & 0x02) {
+    if (p + 4 > end) return false;
+    bytes = be32(p);
+    p += 4;
+  }
+  if (flags & 0x04) {
+    if (p + 100 > end) return false;
+    memcpy(toc, p, 100);
+    hasTOC = true;
+    p += 100;
+  }
+  if (flags & 0x08) p += 4; // Quality
+
+  // LAME (or libavcodec) extension: 9-byte encoder name, then at +21 the 12-bit delay and padding
+  if ((p + 24 <= end) && frames && (!memcmp(p, "LAME", 4) || !memcmp(p, "Lavc", 4) || !memcmp(p, "Lavf", 4))) {
+    uint32_t delay = (p[21] << 4) | (p[22] >> 4);
+    uint32_t padding = ((p[22] & 0x0f) << 8) | p[23];
+    uint32_t total = frames * samplesPerFrame;
+    if (delay + padding < total) {
+      trimStart = delay + decoderDelay;
+      trimEnd = total - padding + decoderDelay;
+      if (trimEnd > total) trimEnd = total;
+    }
+  }
+  return true;
+}
+
+// Fraunhofer's VBRI header, its seek table is folded into the Xing TOC format
+bool MP3StreamInfo::ParseVBRI(const uint8_t *tag, int len)
+{
+  if ((len < 26) || memcmp(tag, "VBRI", 4)) return false;
+  bytes = be32(tag + 10);
+  frames = be32(tag + 14);
+  uint32_t entries = be16(tag + 18);
+  uint32_t scale = be16(tag + 20);
+  uint32_t entrySize = be16(tag + 22);
+  uint32_t framesPerEntry = be16(tag + 24);
+  if (!frames || !bytes || !entries || !framesPerEntry || (entrySize < 1) || (entrySize > 4) ||
+      (26 + entries * entrySize > (uint32_t)len)) {
+    return true; // Still a tag frame, just no usable seek table
+  }
+
+  // VBRI offsets count from the first audio frame, after this one
+  tocBase = firstFrame + infoBytes;
+  const uint8_t *p = tag + 26;
+  uint32_t entry = 0, entryStart = 0, entryBytes = 0;
+  for (int i = 0; i < 100; i++) {
+    uint32_t frame = (uint32_t)(((uint64_t)frames * i) / 100);
+    while ((entry < entries) && (frame >= (entry + 1) * framesPerEntry)) {
+      entryBytes = 0;
+      for (uint32_t j = 0; j < entrySize; j++) entryBytes = (entryBytes << 8) | *(p++);
+      entryStart += entryBytes * scale;
+      entry++;
+    }
+    uint32_t at = entryStart;
+    if (entry < entries) {
+      // Interpolate inside the entry, peeking at its size
+      uint32_t size = 0;
+      for (uint32_t j = 0; j < entrySize; j++) size = (size << 8) | p[j];
+      at += (uint32_t)(((uint64_t)size * scale * (frame - entry * framesPerEntry)) / framesPerEntry);
+    }
+    uint32_t t = (uint32_t)(((uint64_t)at * 256) / bytes);
+    toc[i] = (t > 255) ? 255 : t;
+  }
+  hasTOC = true;
+  return true;
+}
+
+uint32_t MP3StreamInfo::DurationMs(uint32_t streamSize) const
+{
+  if (!IsValid()) return 0;
+  if (frames) {
+    uint32_t samples = trimEnd ? (trimEnd - trimStart) : (frames * samplesPerFrame);
+    return (uint32_t)(((uint64_t)samples * 1000) / sampleRate);
+  }
+  uint32_t audioStart = firstFrame + infoBytes;
+  if (bitrate && (streamSize > audioStart)) {
+    return (uint32_t)(((uint64_t)(streamSize - audioStart) * 8) / bitrate); // kbit/s == bits/ms
+  }
+  return 0;
+}
+
+uint32_t MP3StreamInfo::OffsetForMs(uint32_t ms, uint32_t streamSize) const
+{
+  if (!IsValid()) return 0;
+  uint32_t audioStart = firstFrame + infoBytes;
+  uint64_t samples = ((uint64_t)ms * sampleRate) / 1000;
+  uint64_t offset = audioStart;
+
+  if (frames) {
+    uint64_t total = (uint64_t)frames * samplesPerFrame;
+    uint32_t span = bytes ? bytes : ((streamSize > tocBase) ? streamSize - tocBase : 0);
+    if (samples >= total) {
+      offset = tocBase + span;
+    } else if (hasTOC && span) {
+      // Linear between the two TOC points bracketing the time
+      uint32_t pct = (uint32_t)((samples * 100) / total);
+      uint64_t rem = samples * 100 - pct * total;
+      uint32_t a = toc[pct];
+      uint32_t b = (pct < 99) ? toc[pct + 1] : 256;
+      uint64_t pos256 = a * total + ((b > a) ? (b - a) * rem : 0);
+      offset = tocBase + (pos256 * span) / (256 * total);
+    } else if (span) {
+      offset = tocBase + (samples * span) / total;
+    }
+  } else if (bitrate) {
+    offset = audioStart + ((uint64_t)ms * bitrate) / 8;
+  }
+
+  if (offset < audioStart) offset = audioStart;
+  if (streamSize && (offset > streamSize)) offset = streamSize;
+  return (uint32_t)offset;
+}
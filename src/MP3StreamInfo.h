@@ -0,0 +1,100 @@
+/*
+  MP3StreamInfo
+  Xing/Info, VBRI and LAME tag parsing for duration, seeking and gapless playback
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MP3STREAMINFO_H
+#define _MP3STREAMINFO_H
+
+#include <Arduino.h>
+
+// Shared by the libmad and Helix MP3 generators.  Fed the first decodable frame of a stream, it
+// remembers the frame layout and any VBR tag so that the generator can report a duration, turn a
+// time into a byte offset for a single seek, and drop the encoder delay/padding samples.
+class MP3StreamInfo
+{
+  public:
+    MP3StreamInfo() { Reset(); }
+    void Reset();
+
+    // Parse the MPEG audio frame at buff[0] (len valid bytes) found at byte offset pos of the
+    // source.  Returns true if it is a Xing/Info or VBRI tag frame, which holds no audio and
+    // must be skipped (see InfoFrameBytes())
+    bool Parse(const uint8_t *buff, int len, uint32_t pos);
+
+    // Length in bytes of the Layer III frame whose 4-byte header is at hdr, 0 if the header is
+    // invalid, -1 for a valid free format header
+    static int FrameBytes(const uint8_t *hdr);
+
+    bool IsValid() const { return sampleRate != 0; }
+    int InfoFrameBytes() const { return infoBytes; }
+    uint32_t SampleRate() const { return sampleRate; }
+
+    // Length of the playable audio, 0 if unknown (VBR without a tag and unknown stream size)
+    uint32_t DurationMs(uint32_t streamSize) const;
+    // Byte offset to seek the source to for a time, the decoder must resync from there
+    uint32_t OffsetForMs(uint32_t ms, uint32_t streamSize) const;
+    // Decoded-sample index (including encoder delay) of a time, to restart the gapless trim after a seek
+    uint32_t SampleForMs(uint32_t ms) const { return ms ? (uint32_t)(((uint64_t)ms * sampleRate) / 1000) + trimStart : 0; }
+    uint32_t MsForSample(uint32_t sample) const
+    {
+      if (trimEnd && (sample > trimEnd)) sample = trimEnd;
+      return (sample <= trimStart) ? 0 : (uint32_t)(((uint64_t)(sample - trimStart) * 1000) / sampleRate);
+    }
+
+    // Gapless playback: narrow a block of len decoded samples, the first of which is stream sample
+    // start, to [*first, *end) so encoder delay and padding are dropped.  Sample numbers are at the
+    // decoded rate, which is the stream rate >> shift.  Returns false once the audio has ended.
+    inline bool Clip(uint32_t start, int len, int shift, int *first, int *end) const
+    {
+      *first = 0;
+      *end = len;
+      uint32_t skip = trimStart >> shift;
+      if (start < skip) {
+        *first = (skip - start < (uint32_t)len) ? (int)(skip - start) : len;
+      }
+      if (trimEnd) {
+        uint32_t stop = trimEnd >> shift;
+        if (start >= stop) {
+          *end = *first;
+          return false;
+        }
+        if (start + len > stop) *end = stop - start;
+      }
+      return true;
+    }
+
+  private:
+    uint32_t sampleRate;
+    uint16_t samplesPerFrame;
+    uint16_t bitrate;        // kbit/s of the first frame, meaningful for CBR streams only
+    uint32_t firstFrame;     // Source offset of the first frame (the tag frame if there is one)
+    uint32_t tocBase;        // Source offset the TOC and byte count are relative to
+    int infoBytes;           // Size of the tag frame, 0 if none
+    uint32_t frames;         // From the tag, 0 if unknown
+    uint32_t bytes;          // From the tag, 0 if unknown
+    bool hasTOC;
+    uint8_t toc[100];        // Xing-style TOC: byte position/256 of each 1% of the duration
+    uint32_t trimStart;      // Samples of encoder + decoder delay
+    uint32_t trimEnd;        // Index one past the last real sample, 0 if unknown
+
+    bool ParseXing(const uint8_t *tag, int len);
+    bool ParseVBRI(const uint8_t *tag, int len);
+};
+
+#endif
@@ -0,0 +1,532 @@
+/*
+  MP4Demuxer
+  Streaming MP4/M4A parser handing out the raw AAC access units of the first audio track
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MP4Demuxer.h"
+
+#define BOX(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+// Sample tables up to this size (all of a track's together) are simply loaded
+#ifdef ESP8266
+static const uint32_t tableRamLimit = 8192;
+#else
+static const uint32_t tableRamLimit = 65536;
+#endif
+
+// Window sizes in entries, WORK_SIZE bytes in all
+static const int sttsWin = 16; // 8-byte entries
+static const int stscWin = 16; // 12-byte entries
+static const int stszWin = 128;
+static const int stcoWin = 32; // Room for co64's 8-byte entries
+
+static const uint32_t rateTab[13] PROGMEM = {
+  96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+static uint32_t be32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+MP4Demuxer::MP4Demuxer()
+{
+  file = NULL;
+  work = NULL;
+  workLen = 0;
+  memset(&stts, 0, sizeof(stts));
+  memset(&stsc, 0, sizeof(stsc));
+  memset(&stsz, 0, sizeof(stsz));
+  memset(&stco, 0, sizeof(stco));
+  ramUsed = 0;
+  timescale = 0;
+  duration = 0;
+  time = 0;
+}
+
+MP4Demuxer::~MP4Demuxer()
+{
+  FreeTables();
+}
+
+bool MP4Demuxer::IsMP4(const uint8_t *head)
+{
+  return (be32(head + 4) == BOX('f', 't', 'y', 'p')) && (be32(head) >= 8);
+}
+
+void MP4Demuxer::FreeTables()
+{
+  Table *all[4] = { &stts, &stsc, &stsz, &stco };
+  for (int i = 0; i < 4; i++) {
+    free(all[i]->ram);
+    all[i]->ram = NULL;
+    all[i]->count = 0;
+    all[i]->cached = 0;
+  }
+  ramUsed = 0;
+}
+
+void MP4Demuxer::End()
+{
+  FreeTables();
+  file = NULL;
+}
+
+bool MP4Demuxer::Read(void *data, uint32_t len)
+{
+  uint8_t *p = reinterpret_cast<uint8_t*>(data);
+  uint32_t got = 0;
+  while (got < len) {
+    uint32_t ret = file->read(p + got, len - got);
+    if (!ret) return false;
+    got += ret;
+  }
+  pos += len;
+  return true;
+}
+
+bool MP4Demuxer::Seek(uint32_t to)
+{
+  if (to == pos) return true;
+  if (!file->seek(to, SEEK_SET)) return false;
+  pos = to;
+  return true;
+}
+
+// Move forward to to, reading through the gap so a source that can't seek still works
+bool MP4Demuxer::Skip(uint32_t to)
+{
+  if (to < pos) return Seek(to);
+  if (to > pos) {
+    stts.cached = stsc.cached = stsz.cached = stco.cached = 0; // The work buffer is scratch now
+  }
+  while (pos < to) {
+    uint32_t len = to - pos;
+    if (len > (uint32_t)workLen) len = workLen;
+    if (!Read(work, len)) return false;
+  }
+  return true;
+}
+
+// Read a box header, returning its type and the source offset just past it
+bool MP4Demuxer::BoxHeader(uint32_t *type, uint32_t *end)
+{
+  uint32_t start = pos;
+  uint8_t hdr[8];
+  if (!Read(hdr, 8)) return false;
+  uint32_t size = be32(hdr);
+  *type = be32(hdr + 4);
+  if (size == 1) {
+    if (!Read(hdr, 8)) return false;
+    if (be32(hdr)) return false; // Past 4GB, AudioFileSource can't get there
+    size = be32(hdr + 4);
+    if (size < 16) return false;
+  } else if (size == 0) {
+    uint32_t fileSize = file->getSize();
+    size = (fileSize > start) ? fileSize - start : 0xffffffff - start; // Runs to the end of the file
+  } else if (size < 8) {
+    return false;
+  }
+  *end = start + size;
+  return true;
+}
+
+bool MP4Demuxer::Begin(AudioFileSource *source, uint8_t *work, int workLen, const uint8_t *head)
+{
+  FreeTables();
+  file = source;
+  this->work = work;
+  this->workLen = workLen;
+  pos = 8;
+  failed = false;
+  found = false;
+  timescale = 0;
+  duration = 0;
+  time = 0;
+  if (!IsMP4(head) || (workLen < WORK_SIZE) || !Skip(be32(head))) return false;
+
+  // Top level: ftyp, then moov and mdat in either order, maybe free/skip/uuid boxes in between
+  while (!found) {
+    uint32_t type, end;
+    if (!BoxHeader(&type, &end)) return false; // No moov, or no AAC track in it
+    if (type == BOX('m', 'o', 'o', 'v')) {
+      if (!ParseBoxes(end)) return false;
+    } else if (type == BOX('m', 'd', 'a', 't')) {
+      if (!Seek(end)) {
+        audioLogger->printf_P(PSTR("MP4: moov after mdat needs a seekable source\n"));
+        return false;
+      }
+    } else if (!Skip(end)) {
+      return false;
+    }
+  }
+
+  // Sample tables are all read through the windows from here on
+  uint8_t *w = work;
+  stts.win = w; stts.winLen = sttsWin; w += sttsWin * 8;
+  stsc.win = w; stsc.winLen = stscWin; w += stscWin * 12;
+  stsz.win = w; stsz.winLen = stszWin; w += stszWin * 4;
+  stco.win = w; stco.winLen = stcoWin;
+  stts.cached = stsc.cached = stsz.cached = stco.cached = 0;
+
+  SampleAt(~(uint64_t)0);
+  duration = time;
+  uint32_t s = SampleAt(0);
+  bool ok = Locate(s);
+  SampleBytes(s); // Every table has now been read once, so one that can't be shows up here and not mid-play
+  if (failed) {
+    audioLogger->printf_P(PSTR("MP4: can't read the sample tables, over %u bytes of them need a seekable source\n"), tableRamLimit);
+    return false;
+  }
+  return ok;
+}
+
+// Walk the children of a container box which ends at end, looking for a usable track
+bool MP4Demuxer::ParseBoxes(uint32_t end)
+{
+  while (!found && (pos + 8 <= end)) {
+    uint32_t type, boxEnd;
+    uint8_t b[24];
+    if (!BoxHeader(&type, &boxEnd) || (boxEnd > end)) return false;
+    switch (type) {
+      case BOX('t', 'r', 'a', 'k'):
+        FreeTables();
+        isAudio = false;
+        haveConfig = false;
+        timescale = 0;
+        sampleSize = 0;
+        sampleCount = 0;
+        if (!ParseBoxes(boxEnd)) return false;
+        found = isAudio && haveConfig && timescale && sampleCount && stsc.count && stco.count && stts.count &&
+                (sampleSize || (stsz.count >= sampleCount));
+        break;
+      case BOX('m', 'd', 'i', 'a'):
+      case BOX('m', 'i', 'n', 'f'):
+      case BOX('s', 't', 'b', 'l'):
+        if (!ParseBoxes(boxEnd)) return false;
+        break;
+      case BOX('m', 'd', 'h', 'd'):
+        if (!Read(b, 24)) return false;
+        timescale = be32(b + ((b[0] == 1) ? 20 : 12));
+        break;
+      case BOX('h', 'd', 'l', 'r'):
+        if (!Read(b, 12)) return false;
+        isAudio = (be32(b + 8) == BOX('s', 'o', 'u', 'n'));
+        break;
+      case BOX('s', 't', 's', 'd'):
+        if (!ParseStsd(boxEnd)) return false;
+        break;
+      case BOX('s', 't', 't', 's'):
+        if (!Read(b, 8) || !LoadTable(&stts, be32(b + 4), 8, boxEnd)) return false;
+        break;
+      case BOX('s', 't', 's', 'c'):
+        if (!Read(b, 8) || !LoadTable(&stsc, be32(b + 4), 12, boxEnd)) return false;
+        break;
+      case BOX('s', 't', 's', 'z'):
+        if (!Read(b, 12)) return false;
+        sampleSize = be32(b + 4);
+        sampleCount = be32(b + 8);
+        if (!sampleSize && !LoadTable(&stsz, sampleCount, 4, boxEnd)) return false;
+        break;
+      case BOX('s', 't', 'c', 'o'):
+      case BOX('c', 'o', '6', '4'):
+        if (!Read(b, 8) || !LoadTable(&stco, be32(b + 4), (type == BOX('s', 't', 'c', 'o')) ? 4 : 8, boxEnd)) return false;
+        break;
+      default:
+        break;
+    }
+    if (!Skip(boxEnd)) return false;
+  }
+  return Skip(end);
+}
+
+// Note where a table is, keeping it in RAM if it's small enough
+bool MP4Demuxer::LoadTable(Table *t, uint32_t count, int size, uint32_t end)
+{
+  if ((end < pos) || (count > (end - pos) / size)) return false; // Truncated table
+  t->pos = pos;
+  t->count = count;
+  t->size = size;
+  t->cached = 0;
+  free(t->ram);
+  t->ram = NULL;
+  uint32_t bytes = count * size;
+  if (ramUsed + bytes <= tableRamLimit) {
+    t->ram = (uint8_t*)malloc(bytes ? bytes : 1);
+    if (t->ram) {
+      ramUsed += bytes;
+      return Read(t->ram, bytes);
+    }
+  }
+  return true; // Read through the window later on
+}
+
+bool MP4Demuxer::ParseStsd(uint32_t end)
+{
+  uint32_t len = end - pos;
+  if (len > (uint32_t)workLen) return true; // Nothing we could play has a sample description that big
+  if (!Read(work, len)) return false;
+
+  // Full box header and entry count, then the first entry which has to be mp4a
+  const uint8_t *p = work + 8;
+  const uint8_t *stop = work + len;
+  if ((p + 36 > stop) || (be32(p + 4) != BOX('m', 'p', '4', 'a'))) return true;
+  uint32_t entryLen = be32(p);
+  if ((entryLen < 36) || (p + entryLen > stop)) return true;
+  stop = p + entryLen;
+  int version = be16(p + 16); // QuickTime sound description versions add fields
+  channels = be16(p + 24);
+  sampleRate = be32(p + 32) >> 16;
+  p += 36 + ((version == 1) ? 16 : (version == 2) ? 36 : 0);
+
+  // Child boxes, esds possibly wrapped in a QuickTime wave box
+  while (p + 8 <= stop) {
+    uint32_t size = be32(p);
+    uint32_t type = be32(p + 4);
+    if ((size < 8) || (p + size > stop)) break;
+    if (type == BOX('e', 's', 'd', 's')) {
+      haveConfig = ParseEsds(p + 12, p + size);
+      break;
+    }
+    if (type == BOX('w', 'a', 'v', 'e')) {
+      stop = p + size;
+      p += 8;
+    } else {
+      p += size;
+    }
+  }
+  return true;
+}
+
+// Length of an MPEG-4 descriptor, stored 7 bits a byte
+static bool DescriptorLen(const uint8_t **p, const uint8_t *end, uint32_t *len)
+{
+  *len = 0;
+  for (int i = 0; i < 4; i++) {
+    if (*p >= end) return false;
+    uint8_t b = *((*p)++);
+    *len = (*len << 7) | (b & 0x7f);
+    if (!(b & 0x80)) return true;
+  }
+  return true;
+}
+
+bool MP4Demuxer::ParseEsds(const uint8_t *p, const uint8_t *end)
+{
+  while (p + 2 <= end) {
+    uint8_t tag = *(p++);
+    uint32_t len;
+    if (!DescriptorLen(&p, end, &len) || (p + len > end)) return false;
+    if (tag == 0x03) { // ES_Descriptor, its children follow its own fields
+      if (len < 3) return false;
+      uint8_t flags = p[2];
+      p += 3;
+      if (flags & 0x80) p += 2;
+      if ((flags & 0x40) && (p < end)) p += 1 + *p;
+      if (flags & 0x20) p += 2;
+    } else if (tag == 0x04) { // DecoderConfigDescriptor
+      if (len < 13) return false;
+      if ((p[0] != 0x40) && ((p[0] < 0x66) || (p[0] > 0x68))) return false; // MPEG-4 or MPEG-2 AAC
+      p += 13;
+    } else if (tag == 0x05) { // DecoderSpecificInfo: the AudioSpecificConfig
+      return ParseConfig(p, len);
+    } else {
+      p += len;
+    }
+  }
+  return false;
+}
+
+static uint32_t GetBits(const uint8_t *p, int len, int *bit, int n)
+{
+  uint32_t v = 0;
+  while (n--) {
+    int i = *bit >> 3;
+    v = (v << 1) | ((i < len) ? ((p[i] >> (7 - (*bit & 7))) & 1) : 0);
+    (*bit)++;
+  }
+  return v;
+}
+
+static uint32_t GetRate(const uint8_t *p, int len, int *bit)
+{
+  uint32_t idx = GetBits(p, len, bit, 4);
+  if (idx == 15) return GetBits(p, len, bit, 24);
+  return (idx < 13) ? pgm_read_dword(&rateTab[idx]) : 0;
+}
+
+bool MP4Demuxer::ParseConfig(const uint8_t *p, int len)
+{
+  if (len < 2) return false;
+  int bit = 0;
+  int aot = GetBits(p, len, &bit, 5);
+  if (aot == 31) aot = 32 + GetBits(p, len, &bit, 6);
+  uint32_t rate = GetRate(p, len, &bit);
+  int chanConfig = GetBits(p, len, &bit, 4);
+  if ((aot == 5) || (aot == 29)) {
+    // Explicit SBR (and PS): the extension rate, then the core's object type
+    GetRate(p, len, &bit);
+    aot = GetBits(p, len, &bit, 5);
+  }
+  if (!rate) return false;
+  profile = aot - 1; // The ADTS profile field, AAC_PROFILE_LC for AAC-LC
+  sampleRate = rate;
+  if (chanConfig) channels = chanConfig; // 0 means a program config element, trust stsd then
+  return true;
+}
+
+// Entry idx of a table, refilling its window from the source when needed
+const uint8_t *MP4Demuxer::Entry(Table *t, uint32_t idx)
+{
+  static const uint8_t none[12] = { 0 };
+  if (idx >= t->count) return none;
+  if (t->ram) return t->ram + idx * t->size;
+  if ((idx < t->first) || (idx >= t->first + t->cached)) {
+    uint32_t n = t->count - idx;
+    if (n > t->winLen) n = t->winLen;
+    uint32_t back = pos;
+    t->cached = 0;
+    if (!Seek(t->pos + idx * t->size) || !Read(t->win, n * t->size) || !Seek(back)) {
+      failed = true;
+      return none;
+    }
+    t->first = idx;
+    t->cached = n;
+  }
+  return t->win + (idx - t->first) * t->size;
+}
+
+uint32_t MP4Demuxer::ChunkOffset(uint32_t idx)
+{
+  const uint8_t *e = Entry(&stco, idx);
+  return (stco.size == 8) ? be32(e + 4) : be32(e); // co64 past 4GB isn't reachable anyway
+}
+
+uint32_t MP4Demuxer::SampleBytes(uint32_t idx)
+{
+  return sampleSize ? sampleSize : be32(Entry(&stsz, idx));
+}
+
+// Sample playing at time t (timescale units), setting up the time cursor for it.  Past the end
+// returns sampleCount and leaves time at the track's duration.
+uint32_t MP4Demuxer::SampleAt(uint64_t t)
+{
+  uint32_t s = 0;
+  uint64_t at = 0;
+  for (sttsIdx = 0; sttsIdx < stts.count; sttsIdx++) {
+    const uint8_t *e = Entry(&stts, sttsIdx);
+    uint32_t count = be32(e);
+    uint32_t delta = be32(e + 4);
+    uint64_t span = (uint64_t)count * delta;
+    if (delta && (t < at + span)) {
+      uint32_t n = (uint32_t)((t - at) / delta);
+      time = at + (uint64_t)n * delta;
+      sttsLeft = count - n;
+      sttsDelta = delta;
+      return s + n;
+    }
+    s += count;
+    at += span;
+  }
+  time = at;
+  sttsLeft = 0;
+  sttsDelta = 0;
+  return (s < sampleCount) ? s : sampleCount;
+}
+
+// Point the sample cursor at sample s
+bool MP4Demuxer::Locate(uint32_t s)
+{
+  uint32_t base = 0;
+  sample = sampleCount;
+  chunkLeft = 0;
+  for (uint32_t i = 0; i < stsc.count; i++) {
+    const uint8_t *e = Entry(&stsc, i);
+    uint32_t first = be32(e) - 1; // Chunks count from 1 in stsc
+    uint32_t perChunk = be32(e + 4);
+    uint32_t last = (i + 1 < stsc.count) ? be32(Entry(&stsc, i + 1)) - 1 : stco.count;
+    if (!perChunk || (last <= first)) continue;
+    uint32_t run = (last - first) * perChunk;
+    if (s - base < run) {
+      uint32_t in = (s - base) % perChunk;
+      stscIdx = i;
+      spc = perChunk;
+      nextFirst = last;
+      chunk = first + (s - base) / perChunk;
+      chunkLeft = spc - in;
+      offset = ChunkOffset(chunk);
+      for (uint32_t j = s - in; j < s; j++) offset += SampleBytes(j);
+      sample = s;
+      return !failed;
+    }
+    base += run;
+  }
+  return s >= sampleCount; // At the end is fine, anywhere else is a broken table
+}
+
+bool MP4Demuxer::NextSample(uint8_t *frame, int maxLen, int *len)
+{
+  *len = 0;
+  if (!file || (sample >= sampleCount)) return false;
+  if (!chunkLeft) {
+    // Next chunk, maybe of the next stsc run
+    chunk++;
+    while (chunk >= nextFirst) {
+      if (++stscIdx >= stsc.count) return false;
+      const uint8_t *e = Entry(&stsc, stscIdx);
+      spc = be32(e + 4);
+      nextFirst = (stscIdx + 1 < stsc.count) ? be32(Entry(&stsc, stscIdx + 1)) - 1 : stco.count;
+      if (!spc) nextFirst = chunk; // Empty run, on to the one after
+    }
+    if (chunk >= stco.count) return false;
+    chunkLeft = spc;
+    offset = ChunkOffset(chunk);
+  }
+
+  uint32_t bytes = SampleBytes(sample);
+  if (failed) return false;
+  bool fits = (bytes <= (uint32_t)maxLen);
+  if (fits) {
+    if (((offset < pos) ? !Seek(offset) : !Skip(offset)) || !Read(frame, bytes)) return false;
+    *len = bytes;
+  }
+  offset += bytes;
+  chunkLeft--;
+  sample++;
+  if (sttsLeft) {
+    time += sttsDelta;
+    if (!--sttsLeft && (++sttsIdx < stts.count)) {
+      const uint8_t *e = Entry(&stts, sttsIdx);
+      sttsLeft = be32(e);
+      sttsDelta = be32(e + 4);
+    }
+  }
+  return !failed;
+}
+
+bool MP4Demuxer::SeekMs(uint32_t ms)
+{
+  if (!file || !timescale) return false;
+  uint32_t s = SampleAt(((uint64_t)ms * timescale) / 1000);
+  return Locate(s) && !failed;
+}
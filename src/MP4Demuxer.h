@@ -0,0 +1,130 @@
+/*
+  MP4Demuxer
+  Streaming MP4/M4A parser handing out the raw AAC access units of the first audio track
+
+  Copyright (C) 2026  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MP4DEMUXER_H
+#define _MP4DEMUXER_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+
+// Walks the box tree of an MP4/M4A file once, remembering where the sample tables of the first
+// AAC track are instead of loading them.  Up to 8KB of tables (64KB off the ESP8266) are kept in
+// RAM anyway; bigger ones are read through small windows in the caller's work buffer, so memory use
+// doesn't grow with track length, but every window refill seeks back into moov.
+// A source that can't seek (HTTP) therefore only plays files with moov before mdat whose tables fit
+// in RAM.  At 4 bytes of stsz per AAC frame that is well under a minute of 44.1kHz audio on the
+// ESP8266; Begin() fails on anything longer.  A moov after mdat is found by seeking past mdat,
+// which needs a seekable source too.
+class MP4Demuxer
+{
+  public:
+    // Bytes of work buffer Begin() needs at the least, for the table windows
+    enum { WORK_SIZE = 1088 };
+
+    MP4Demuxer();
+    ~MP4Demuxer();
+
+    // Whether the first 8 bytes of a file are an MP4 ftyp box header
+    static bool IsMP4(const uint8_t *head);
+
+    // Parse the file whose first 8 bytes (head) have already been read from source.  Returns false
+    // if there is no playable AAC track.
+    bool Begin(AudioFileSource *source, uint8_t *work, int workLen, const uint8_t *head);
+    void End();
+
+    // From the esds AudioSpecificConfig, in the terms of AACSetRawBlockParams()
+    int Profile() const { return profile; }
+    int Channels() const { return channels; }
+    int SampleRate() const { return sampleRate; }
+
+    // Read the next access unit into frame, false at the end of the track or on a read error.
+    // Units larger than maxLen are skipped, with *len set to 0.
+    bool NextSample(uint8_t *frame, int maxLen, int *len);
+
+    uint32_t DurationMs() const { return timescale ? (uint32_t)((duration * 1000) / timescale) : 0; }
+    uint32_t PositionMs() const { return timescale ? (uint32_t)((time * 1000) / timescale) : 0; }
+    // Move to the access unit playing at ms.  Costs a walk of the (short) stts and stsc run lists
+    // and at most one chunk of stsz, never a scan of the whole track.
+    bool SeekMs(uint32_t ms);
+
+  private:
+    // A sample table, either in RAM or read on demand through a window of cached entries
+    struct Table {
+      uint32_t pos;    // Source offset of entry 0
+      uint32_t count;
+      uint8_t size;    // Bytes per entry
+      uint8_t *ram;    // The whole table, or NULL
+      uint8_t *win;
+      uint16_t winLen; // Entries the window holds
+      uint16_t cached; // Valid entries in the window
+      uint32_t first;  // Index of the first cached entry
+    };
+
+    AudioFileSource *file;
+    uint8_t *work;
+    int workLen;
+    uint32_t pos;      // Our idea of the source position
+    bool failed;       // A table read went wrong
+    uint32_t ramUsed;  // Bytes of tables held in RAM
+
+    // Track being parsed, and once found the one being played
+    bool found;
+    bool isAudio;
+    bool haveConfig;
+    int profile;
+    int channels;
+    int sampleRate;
+    uint32_t timescale;
+    uint32_t sampleSize;  // Constant sample size from stsz, 0 if the table has them
+    uint32_t sampleCount;
+    Table stts, stsc, stsz, stco;
+
+    // Playback cursor
+    uint32_t sample;
+    uint32_t chunk;
+    uint32_t chunkLeft;   // Samples still to come from the current chunk
+    uint32_t stscIdx;
+    uint32_t nextFirst;   // First chunk of the next stsc run
+    uint32_t spc;         // Samples per chunk of the current run
+    uint32_t offset;      // Source offset of the next sample
+    uint32_t sttsIdx;
+    uint32_t sttsLeft;
+    uint32_t sttsDelta;
+    uint64_t time;        // In timescale units
+    uint64_t duration;
+
+    bool Read(void *data, uint32_t len);
+    bool Skip(uint32_t to);
+    bool Seek(uint32_t to);
+    bool BoxHeader(uint32_t *type, uint32_t *end);
+    bool ParseBoxes(uint32_t end);
+    bool ParseStsd(uint32_t end);
+    bool ParseEsds(const uint8_t *p, const uint8_t *end);
+    bool ParseConfig(const uint8_t *p, int len);
+    bool LoadTable(Table *t, uint32_t count, int size, uint32_t end);
+    void FreeTables();
+    const uint8_t *Entry(Table *t, uint32_t idx);
+    uint32_t ChunkOffset(uint32_t idx);
+    uint32_t SampleBytes(uint32_t idx);
+    uint32_t SampleAt(uint64_t t);
+    bool Locate(uint32_t s);
+};
+
+#endif
@@ -783,6 +783,22 @@ void FLAC__lpc_compute_residual_from_qlp_coefficients_wide(const FLAC__int32 * f
 
 #endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
 
+uint32_t FLAC__lpc_max_prediction_before_shift_bps(uint32_t subframe_bps, const FLAC__int32 * flac_restrict qlp_coeff, uint32_t order)
+{
+	/* |sum| <= sum(|qlp_coeff[j]|) * 2^(subframe_bps-1), which is below
+	 * 2^(subframe_bps + ilog2(abs_sum)), so that many bits plus a sign
+	 * hold it, and every partial sum along the way.
+	 */
+	FLAC__uint32 abs_sum_of_qlp_coeff = 0;
+	uint32_t i;
+
+	for(i = 0; i < order; i++)
+		abs_sum_of_qlp_coeff += (FLAC__uint32)(qlp_coeff[i] < 0 ? -qlp_coeff[i] : qlp_coeff[i]);
+	if(abs_sum_of_qlp_coeff == 0)
+		return subframe_bps;
+	return subframe_bps + FLAC__bitmath_ilog2(abs_sum_of_qlp_coeff) + 1;
+}
+
 void FLAC__lpc_restore_signal(const FLAC__int32 * flac_restrict residual, uint32_t data_len, const FLAC__int32 * flac_restrict qlp_coeff, uint32_t order, int lp_quantization, FLAC__int32 * flac_restrict data)
 #if defined(FLAC__OVERFLOW_DETECT) || !defined(FLAC__LPC_UNROLLED_FILTER_LOOPS)
 {
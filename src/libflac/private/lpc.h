@@ -194,6 +194,21 @@ void FLAC__lpc_compute_residual_from_qlp_coefficients_wide_intrin_avx2(const FLA
 
 #endif /* !defined FLAC__INTEGER_ONLY_LIBRARY */
 
+/*
+ *	FLAC__lpc_max_prediction_before_shift_bps()
+ *	--------------------------------------------------------------------
+ *	Bits needed to hold the prediction sum of a subframe before it is
+ *	shifted down by the quantization.  The coefficients are known, so
+ *	this is bounded by the sum of their magnitudes rather than by their
+ *	precision and the order, and decides whether the 32-bit restore can
+ *	be used instead of the (much slower on 32-bit CPUs) 64-bit one.
+ *
+ *	IN subframe_bps            bits per sample of the subframe
+ *	IN qlp_coeff[0,order-1]    quantized LP coefficients
+ *	IN order > 0               LP order
+ */
+uint32_t FLAC__lpc_max_prediction_before_shift_bps(uint32_t subframe_bps, const FLAC__int32 qlp_coeff[], uint32_t order);
+
 /*
  *	FLAC__lpc_restore_signal()
  *	--------------------------------------------------------------------
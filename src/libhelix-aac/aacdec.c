@@ -98,6 +98,26 @@ HAACDecoder AACInitDecoderPre(void *ptr, int sz)
         return (HAACDecoder)aacDecInfo;
 }
 
+/**************************************************************************************
+ * Function:    AACGetPreAllocSize
+ *
+ * Description: size of the space AACInitDecoderPre() carves the decoder out of
+ *
+ * Inputs:      none
+ *
+ * Outputs:     none
+ *
+ * Return:      number of bytes, including the SBR state if enabled
+ **************************************************************************************/
+int AACGetPreAllocSize(void)
+{
+#ifdef AAC_ENABLE_SBR
+        return BuffersPreSize() + SBRPreSize();
+#else
+        return BuffersPreSize();
+#endif
+}
+
 /**************************************************************************************
  * Function:    AACFreeDecoder
  *
@@ -191,6 +211,46 @@ void AACGetLastFrameInfo(HAACDecoder hAACDecoder, AACFrameInfo *aacFrameInfo)
 	}
 }
 
+/**************************************************************************************
+ * Function:    AACSetSBRBypass
+ *
+ * Description: decode only the AAC-LC core of HE-AAC streams, ignoring the SBR data
+ *
+ * Inputs:      valid AAC decoder instance pointer (HAACDecoder)
+ *              nonzero to bypass SBR, zero to apply it again
+ *
+ * Outputs:     updated state variables in aacDecInfo
+ *
+ * Return:      0 if successful, error code (< 0) if error
+ *
+ * Notes:       while bypassed, output is at the core sample rate (half of the SBR rate)
+ *                with 1024 samples per channel, see AACGetLastFrameInfo()
+ *              SBR restarts from scratch when turned back on, upsampling only until
+ *                the next SBR header arrives
+ **************************************************************************************/
+int AACSetSBRBypass(HAACDecoder hAACDecoder, int bypass)
+{
+	AACDecInfo *aacDecInfo = (AACDecInfo *)hAACDecoder;
+
+	if (!aacDecInfo)
+		return ERR_AAC_NULL_POINTER;
+
+	bypass = (bypass ? 1 : 0);
+	if (bypass == aacDecInfo->sbrBypass)
+		return ERR_AAC_NONE;
+
+	aacDecInfo->sbrBypass = bypass;
+	if (bypass) {
+		aacDecInfo->sbrEnabled = 0;
+#ifdef AAC_ENABLE_SBR
+	} else {
+		FlushCodecSBR(aacDecInfo);
+#endif
+	}
+
+	return ERR_AAC_NONE;
+}
+
 /**************************************************************************************
  * Function:    AACSetRawBlockParams
  *
@@ -153,6 +153,7 @@ typedef void *HAACDecoder;
 /* public C API */
 HAACDecoder AACInitDecoder(void);
 HAACDecoder AACInitDecoderPre(void *ptr, int sz);
+int AACGetPreAllocSize(void);
 void AACFreeDecoder(HAACDecoder hAACDecoder);
 int AACDecode(HAACDecoder hAACDecoder, unsigned char **inbuf, int *bytesLeft, short *outbuf);
 
@@ -160,6 +161,7 @@ int AACFindSyncWord(unsigned char *buf, int nBytes);
 void AACGetLastFrameInfo(HAACDecoder hAACDecoder, AACFrameInfo *aacFrameInfo);
 int AACSetRawBlockParams(HAACDecoder hAACDecoder, int copyLast, AACFrameInfo *aacFrameInfo);
 int AACFlushCodec(HAACDecoder hAACDecoder);
+int AACSetSBRBypass(HAACDecoder hAACDecoder, int bypass);
 
 #ifdef HELIX_CONFIG_AAC_GENERATE_TRIGTABS_FLOAT
 int AACInitTrigtabsFloat(void);
@@ -113,6 +113,11 @@ AACDecInfo *AllocateBuffers(void)
 	return aacDecInfo;
 }
 
+int BuffersPreSize(void)
+{
+        return ((sizeof(AACDecInfo) + 7) & ~7) + ((sizeof(PSInfoBase) + 7) & ~7);
+}
+
 AACDecInfo *AllocateBuffersPre(void **ptr, int *sz)
 {
         AACDecInfo *aacDecInfo;
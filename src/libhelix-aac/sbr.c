@@ -115,6 +115,11 @@ int InitSBR(AACDecInfo *aacDecInfo)
 	return ERR_AAC_NONE;
 }
 
+int SBRPreSize(void)
+{
+        return sizeof(PSInfoSBR);
+}
+
 int InitSBRPre(AACDecInfo *aacDecInfo, void **ptr, int *sz)
 {
         PSInfoSBR *psi;
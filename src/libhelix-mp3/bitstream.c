@@ -252,6 +252,7 @@ int UnpackFrameHeader(MP3DecInfo *mp3DecInfo, unsigned char *buf)
 
 	/* init user-accessible data */
 	mp3DecInfo->nChans = (fh->sMode == Mono ? 1 : 2);
+	mp3DecInfo->outChans = (mp3DecInfo->chanMode == MP3_CHANNELS_STEREO ? mp3DecInfo->nChans : 1);
 	mp3DecInfo->samprate = samplerateTab[fh->ver][fh->srIdx];
 	mp3DecInfo->nGrans = (fh->ver == MPEG1 ? NGRANS_MPEG1 : NGRANS_MPEG2);
 	mp3DecInfo->nGranSamps = ((int)samplesPerFrameTab[fh->ver][fh->layer - 1]) / mp3DecInfo->nGrans;
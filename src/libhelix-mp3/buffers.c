@@ -145,6 +145,29 @@ MP3DecInfo *AllocateBuffers(void)
 	return mp3DecInfo;
 }
 
+/**************************************************************************************
+ * Function:    FlushBuffers
+ *
+ * Description: clear the state carried from frame to frame (overlap-add, synthesis
+ *                history), leaving the decoder as if it had just been allocated
+ *
+ * Inputs:      pointer to initialized MP3DecInfo structure
+ *
+ * Outputs:     cleared IMDCT and subband state
+ *
+ * Return:      none
+ **************************************************************************************/
+void FlushBuffers(MP3DecInfo *mp3DecInfo)
+{
+	if (!mp3DecInfo)
+		return;
+
+	if (mp3DecInfo->IMDCTInfoPS)
+		ClearBuffer(mp3DecInfo->IMDCTInfoPS, sizeof(IMDCTInfo));
+	if (mp3DecInfo->SubbandInfoPS)
+		ClearBuffer(mp3DecInfo->SubbandInfoPS, sizeof(SubbandInfo));
+}
+
 #define SAFE_FREE(x)	{if (x)	free(x);	(x) = 0;}	/* helper macro */
 
 /**************************************************************************************
@@ -93,6 +93,9 @@ typedef struct _MP3DecInfo {
 
 	int part23Length[MAX_NGRAN][MAX_NCHAN];
 
+	MP3ChannelMode chanMode;	/* only used for stereo streams */
+	int outChans;			/* channels in the PCM output, 1 when chanMode is not stereo */
+
 } MP3DecInfo;
 
 typedef struct _SFBandTable {
@@ -103,6 +106,7 @@ typedef struct _SFBandTable {
 /* decoder functions which must be implemented for each platform */
 MP3DecInfo *AllocateBuffers(void);
 void FreeBuffers(MP3DecInfo *mp3DecInfo);
+void FlushBuffers(MP3DecInfo *mp3DecInfo);
 int CheckPadBit(MP3DecInfo *mp3DecInfo);
 int UnpackFrameHeader(MP3DecInfo *mp3DecInfo, unsigned char *buf);
 int UnpackSideInfo(MP3DecInfo *mp3DecInfo, unsigned char *buf);
@@ -201,15 +201,69 @@ void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo)
 		mp3FrameInfo->version = 0;
 	} else {
 		mp3FrameInfo->bitrate = mp3DecInfo->bitrate;
-		mp3FrameInfo->nChans = mp3DecInfo->nChans;
+		mp3FrameInfo->nChans = mp3DecInfo->outChans;
 		mp3FrameInfo->samprate = mp3DecInfo->samprate;
 		mp3FrameInfo->bitsPerSample = 16;
-		mp3FrameInfo->outputSamps = mp3DecInfo->nChans * (int)samplesPerFrameTab[mp3DecInfo->version][mp3DecInfo->layer - 1];
+		mp3FrameInfo->outputSamps = mp3DecInfo->outChans * (int)samplesPerFrameTab[mp3DecInfo->version][mp3DecInfo->layer - 1];
 		mp3FrameInfo->layer = mp3DecInfo->layer;
 		mp3FrameInfo->version = mp3DecInfo->version;
 	}
 }
 
+/**************************************************************************************
+ * Function:    MP3SetChannelMode
+ *
+ * Description: select which channels of a stereo stream get decoded
+ *
+ * Inputs:      valid MP3 decoder instance pointer (HMP3Decoder)
+ *              channel mode (see MP3ChannelMode in mp3dec.h)
+ *
+ * Outputs:     none
+ *
+ * Return:      none
+ *
+ * Notes:       anything but MP3_CHANNELS_STEREO gives mono output, and skips the
+ *                subband synthesis (and, for left/right, the IMDCT) of one channel
+ *              takes effect on the next frame header, mono streams are unaffected
+ **************************************************************************************/
+void MP3SetChannelMode(HMP3Decoder hMP3Decoder, MP3ChannelMode mode)
+{
+	MP3DecInfo *mp3DecInfo = (MP3DecInfo *)hMP3Decoder;
+
+	if (!mp3DecInfo)
+		return;
+
+	mp3DecInfo->chanMode = mode;
+}
+
+/**************************************************************************************
+ * Function:    MP3FlushCodec
+ *
+ * Description: flush internal codec state (after seeking, for example)
+ *
+ * Inputs:      valid MP3 decoder instance pointer (HMP3Decoder)
+ *
+ * Outputs:     empty bit reservoir, cleared overlap and synthesis buffers
+ *
+ * Return:      0 if successful, error code (< 0) if error
+ *
+ * Notes:       the next frames may return ERR_MP3_MAINDATA_UNDERFLOW until the
+ *                bit reservoir has refilled
+ **************************************************************************************/
+int MP3FlushCodec(HMP3Decoder hMP3Decoder)
+{
+	MP3DecInfo *mp3DecInfo = (MP3DecInfo *)hMP3Decoder;
+
+	if (!mp3DecInfo)
+		return ERR_MP3_NULL_POINTER;
+
+	mp3DecInfo->mainDataBegin = 0;
+	mp3DecInfo->mainDataBytes = 0;
+	FlushBuffers(mp3DecInfo);
+
+	return ERR_MP3_NONE;
+}
+
 /**************************************************************************************
  * Function:    MP3GetNextFrameInfo
  *
@@ -275,7 +329,7 @@ static void MP3ClearBadFrame(MP3DecInfo *mp3DecInfo, short *outbuf)
  *                or reformatted as "self-contained" frames (useSize = 1)
  *
  * Outputs:     PCM data in outbuf, interleaved LRLRLR... if stereo
- *                number of output samples = nGrans * nGranSamps * nChans
+ *                number of output samples = nGrans * nGranSamps * outChans
  *              updated inbuf pointer, updated bytesLeft
  *
  * Return:      error code, defined in mp3dec.h (0 means no error, < 0 means error)
@@ -453,6 +507,10 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 		/* alias reduction, inverse MDCT, overlap-add, frequency inversion */
 		for (ch = 0; ch < mp3DecInfo->nChans; ch++)
 		{
+			/* single channel output only needs the selected channel */
+			if ((mp3DecInfo->chanMode == MP3_CHANNELS_LEFT && ch != 0) ||
+				(mp3DecInfo->chanMode == MP3_CHANNELS_RIGHT && ch != 1))
+				continue;
 		#ifdef PROFILE
 			time = systime_get();
 		#endif
@@ -470,7 +528,7 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 			time = systime_get();
 		#endif
 		/* subband transform - if stereo, interleaves pcm LRLRLR */
-		if (Subband(mp3DecInfo, outbuf + gr*mp3DecInfo->nGranSamps*mp3DecInfo->nChans) < 0) {
+		if (Subband(mp3DecInfo, outbuf + gr*mp3DecInfo->nGranSamps*mp3DecInfo->outChans) < 0) {
 			MP3ClearBadFrame(mp3DecInfo, outbuf);
 			return ERR_MP3_INVALID_SUBBAND;			
 		}
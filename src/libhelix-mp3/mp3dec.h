@@ -92,6 +92,14 @@ typedef enum {
 
 typedef void *HMP3Decoder;
 
+/* channel decoding modes for stereo streams (see MP3SetChannelMode) */
+typedef enum {
+	MP3_CHANNELS_STEREO = 0,	/* decode both channels */
+	MP3_CHANNELS_LEFT =   1,	/* decode left channel only, output mono */
+	MP3_CHANNELS_RIGHT =  2,	/* decode right channel only, output mono */
+	MP3_CHANNELS_MIX =    3		/* average both channels ahead of subband synthesis, output mono */
+} MP3ChannelMode;
+
 enum {
 	ERR_MP3_NONE =                  0,
 	ERR_MP3_INDATA_UNDERFLOW =     -1,
@@ -128,6 +136,8 @@ int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, sh
 void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo);
 int MP3GetNextFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo, unsigned char *buf);
 int MP3FindSyncWord(unsigned char *buf, int nBytes);
+void MP3SetChannelMode(HMP3Decoder hMP3Decoder, MP3ChannelMode mode);
+int MP3FlushCodec(HMP3Decoder hMP3Decoder);
 
 #ifdef __cplusplus
 }
@@ -59,7 +59,7 @@
  **************************************************************************************/
 /*__attribute__ ((section (".data"))) */ int Subband(MP3DecInfo *mp3DecInfo, short *pcmBuf)
 {
-	int b;
+	int b, i, ch, gb;
 	//HuffmanInfo *hi;
 	IMDCTInfo *mi;
 	SubbandInfo *sbi;
@@ -72,7 +72,7 @@
 	mi = (IMDCTInfo *)(mp3DecInfo->IMDCTInfoPS);
 	sbi = (SubbandInfo*)(mp3DecInfo->SubbandInfoPS);
 
-	if (mp3DecInfo->nChans == 2) {
+	if (mp3DecInfo->outChans == 2) {
 		/* stereo */
 		for (b = 0; b < BLOCK_SIZE; b++) {
 			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[0]);
@@ -81,10 +81,22 @@
 			sbi->vindex = (sbi->vindex - (b & 0x01)) & 7;
 			pcmBuf += (2 * NBANDS);
 		}
+	} else if (mp3DecInfo->nChans == 2 && mp3DecInfo->chanMode == MP3_CHANNELS_MIX) {
+		/* stereo in, mono out - average the IMDCT outputs, headroom is at least that of the louder channel */
+		gb = MIN(mi->gb[0], mi->gb[1]);
+		for (b = 0; b < BLOCK_SIZE; b++) {
+			for (i = 0; i < NBANDS; i++)
+				mi->outBuf[0][b][i] = (mi->outBuf[0][b][i] >> 1) + (mi->outBuf[1][b][i] >> 1);
+			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), gb);
+			PolyphaseMono(pcmBuf, sbi->vbuf + sbi->vindex + VBUF_LENGTH * (b & 0x01), polyCoef);
+			sbi->vindex = (sbi->vindex - (b & 0x01)) & 7;
+			pcmBuf += NBANDS;
+		}
 	} else {
-		/* mono */
+		/* mono, or one channel of a stereo stream */
+		ch = (mp3DecInfo->nChans == 2 && mp3DecInfo->chanMode == MP3_CHANNELS_RIGHT) ? 1 : 0;
 		for (b = 0; b < BLOCK_SIZE; b++) {
-			FDCT32(mi->outBuf[0][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[0]);
+			FDCT32(mi->outBuf[ch][b], sbi->vbuf + 0*32, sbi->vindex, (b & 0x01), mi->gb[ch]);
 			PolyphaseMono(pcmBuf, sbi->vbuf + sbi->vindex + VBUF_LENGTH * (b & 0x01), polyCoef);
 			sbi->vindex = (sbi->vindex - (b & 0x01)) & 7;
 			pcmBuf += NBANDS;
@@ -2414,6 +2414,123 @@ void III_freqinver(mad_fixed_t sample[18][32], unsigned int sb)
 # endif
 }
 
+/*
+   NAME:	III_antialias()
+   DESCRIPTION:	reorder short blocks and perform alias reduction ahead of IMDCT
+*/
+static
+enum mad_error III_antialias(mad_fixed_t xr[576], struct channel const *channel,
+                             unsigned int const *sfbwidth, mad_fixed_t tmp[576])
+{
+  if (channel->block_type == 2) {
+    enum mad_error error;
+
+    error = III_reorder(xr, channel, sfbwidth, tmp);
+    if (error)
+      return error;
+
+# if !defined(OPT_STRICT)
+    /*
+       According to ISO/IEC 11172-3, "Alias reduction is not applied for
+       granules with block_type == 2 (short block)." However, other
+       sources suggest alias reduction should indeed be performed on the
+       lower two subbands of mixed blocks. Most other implementations do
+       this, so by default we will too.
+    */
+    if (channel->flags & mixed_block_flag)
+      III_aliasreduce(xr, 36);
+# endif
+  }
+  else
+    III_aliasreduce(xr, 576);
+
+  return MAD_ERROR_NONE;
+}
+
+/*
+   NAME:	III_sblimit()
+   DESCRIPTION:	return the number of subbands holding nonzero lines (min. 2)
+*/
+static inline
+unsigned int III_sblimit(mad_fixed_t const xr[576])
+{
+  unsigned int i = 576;
+
+  while (i > 36 && xr[i - 1] == 0)
+    --i;
+
+  return 32 - (576 - i) / 18;
+}
+
+/*
+   NAME:	III_imdct_sb()
+   DESCRIPTION:	perform IMDCT and windowing for one subband of a channel
+*/
+static
+void III_imdct_sb(mad_fixed_t const xr[576], struct channel const *channel,
+                  unsigned int sb, mad_fixed_t output[36])
+{
+  if (sb < 2 && (channel->flags & mixed_block_flag))
+    III_imdct_l(&xr[18 * sb], output, 0);
+  else if (channel->block_type != 2)
+    III_imdct_l(&xr[18 * sb], output, channel->block_type);
+  else
+    III_imdct_s(&xr[18 * sb], output);
+}
+
+/*
+   NAME:	III_downmix()
+   DESCRIPTION:	combine two channels with different block layouts into one;
+		the IMDCT outputs are averaged, and since overlap-add is linear
+		a single overlap state (channel 0) is kept for the mix
+*/
+static
+enum mad_error III_downmix(mad_fixed_t *xr[2], struct granule const *granule,
+                           unsigned int const *sfbwidth[2],
+                           struct mad_frame *frame, mad_fixed_t sample[18][32])
+{
+  mad_fixed_t output[36], *other;
+  unsigned int ch, sb, i, sblimit[2];
+  enum mad_error error;
+
+  for (ch = 0; ch < 2; ++ch) {
+    error = III_antialias(xr[ch], &granule->ch[ch], sfbwidth[ch], frame->tmp);
+    if (error)
+      return error;
+
+    sblimit[ch] = III_sblimit(xr[ch]);
+  }
+
+  /* frame->tmp is free again once both channels are reordered */
+  other = frame->tmp;
+
+  for (sb = 0; sb < 32; ++sb) {
+    if (sb < sblimit[0] || sb < sblimit[1]) {
+      if (sb < sblimit[0])
+        III_imdct_sb(xr[0], &granule->ch[0], sb, output);
+      else
+        memset(output, 0, sizeof(output));
+
+      if (sb < sblimit[1])
+        III_imdct_sb(xr[1], &granule->ch[1], sb, other);
+      else
+        memset(other, 0, 36 * sizeof(mad_fixed_t));
+
+      for (i = 0; i < 36; ++i)
+        output[i] = (output[i] >> 1) + (other[i] >> 1);
+
+      III_overlap(output, frame->overlap[0][sb], sample, sb);
+    }
+    else
+      III_overlap_z(frame->overlap[0][sb], sample, sb);
+
+    if (sb & 1)
+      III_freqinver(sample, sb);
+  }
+
+  return MAD_ERROR_NONE;
+}
+
 /*
    NAME:	III_decode()
    DESCRIPTION:	decode frame main_data
@@ -2456,7 +2573,7 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
   for (gr = 0; gr < ngr; ++gr) {
     struct granule *granule = &si->gr[gr];
     unsigned int const *sfbwidth[2];
-    unsigned int ch;
+    unsigned int ch, outch, first;
     enum mad_error error;
 
     for (ch = 0; ch < nch; ++ch) {
@@ -2497,35 +2614,58 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
       }
     }
 
+    /* single channel output: pick one channel, or fold both into channel 0 */
+
+    outch = nch;
+    first = 0;
+
+    if (nch == 2 && (frame->options & MAD_OPTION_SINGLECHANNEL)) {
+      outch = 1;
+
+      switch (frame->options & MAD_OPTION_SINGLECHANNEL) {
+      case MAD_OPTION_LEFTCHANNEL:
+        break;
+
+      case MAD_OPTION_RIGHTCHANNEL:
+        first = 1;
+        break;
+
+      default:
+        if (granule->ch[0].block_type == granule->ch[1].block_type &&
+            (granule->ch[0].flags & mixed_block_flag) ==
+            (granule->ch[1].flags & mixed_block_flag)) {
+          unsigned int i;
+
+          /* same block layout, so one IMDCT of the summed spectrum will do */
+          for (i = 0; i < 576; ++i)
+            xr[0][i] = (xr[0][i] >> 1) + (xr[1][i] >> 1);
+        }
+        else {
+          error = III_downmix(xr, granule, sfbwidth, frame,
+                              &frame->sbsample[0][18 * gr]);
+          if (error)
+            return error;
+
+          continue;
+        }
+        break;
+      }
+    }
+
     /* reordering, alias reduction, IMDCT, overlap-add, frequency inversion */
 
-    for (ch = 0; ch < nch; ++ch) {
-      struct channel const *channel = &granule->ch[ch];
+    for (ch = 0; ch < outch; ++ch) {
+      struct channel const *channel = &granule->ch[ch + first];
       mad_fixed_t (*sample)[32] = &frame->sbsample[ch][18 * gr];
-      unsigned int sb, l, i, sblimit;
+      mad_fixed_t *chxr = xr[ch + first];
+      unsigned int sb, l, sblimit;
       mad_fixed_t output[36];
 
-      if (channel->block_type == 2) {
-        error = III_reorder(xr[ch], channel, sfbwidth[ch], frame->tmp);
-        if (error) {
-//          free(xr_raw);
-          return error;
-        }
-
-# if !defined(OPT_STRICT)
-        /*
-           According to ISO/IEC 11172-3, "Alias reduction is not applied for
-           granules with block_type == 2 (short block)." However, other
-           sources suggest alias reduction should indeed be performed on the
-           lower two subbands of mixed blocks. Most other implementations do
-           this, so by default we will too.
-        */
-        if (channel->flags & mixed_block_flag)
-          III_aliasreduce(xr[ch], 36);
-# endif
+      error = III_antialias(chxr, channel, sfbwidth[ch + first], frame->tmp);
+      if (error) {
+//        free(xr_raw);
+        return error;
       }
-      else
-        III_aliasreduce(xr[ch], 576);
 
       l = 0;
 
@@ -2540,14 +2680,14 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
 
         /* long blocks */
         for (sb = 0; sb < 2; ++sb, l += 18) {
-          III_imdct_l(&xr[ch][l], output, block_type);
+          III_imdct_l(&chxr[l], output, block_type);
           III_overlap(output, frame->overlap[ch][sb], sample, sb);
         }
       }
       else {
         /* short blocks */
         for (sb = 0; sb < 2; ++sb, l += 18) {
-          III_imdct_s(&xr[ch][l], output);
+          III_imdct_s(&chxr[l], output);
           III_overlap(output, frame->overlap[ch][sb], sample, sb);
         }
       }
@@ -2556,16 +2696,12 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
 
       /* (nonzero) subbands 2-31 */
 
-      i = 576;
-      while (i > 36 && xr[ch][i - 1] == 0)
-        --i;
-
-      sblimit = 32 - (576 - i) / 18;
+      sblimit = III_sblimit(chxr);
 
       if (channel->block_type != 2) {
         /* long blocks */
         for (sb = 2; sb < sblimit; ++sb, l += 18) {
-          III_imdct_l(&xr[ch][l], output, channel->block_type);
+          III_imdct_l(&chxr[l], output, channel->block_type);
           III_overlap(output, frame->overlap[ch][sb], sample, sb);
 
           if (sb & 1)
@@ -2575,7 +2711,7 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
       else {
         /* short blocks */
         for (sb = 2; sb < sblimit; ++sb, l += 18) {
-          III_imdct_s(&xr[ch][l], output);
+          III_imdct_s(&chxr[l], output);
           III_overlap(output, frame->overlap[ch][sb], sample, sb);
 
           if (sb & 1)
@@ -879,6 +879,10 @@ enum mad_flow mad_synth_frame(struct mad_synth *synth, struct mad_frame const *f
   nch = MAD_NCHANNELS(&frame->header);
   ns  = MAD_NSBSAMPLES(&frame->header);
 
+  /* layer III leaves a single channel in sbsample[0] for these */
+  if (nch == 2 && (frame->options & MAD_OPTION_SINGLECHANNEL))
+    nch = 1;
+
   synth->pcm.samplerate = frame->header.samplerate;
   synth->pcm.channels   = nch;
   synth->pcm.length     = 32;// * ns;
@@ -909,6 +913,10 @@ enum mad_flow mad_synth_frame_onens(struct mad_synth *synth, struct mad_frame co
   nch = MAD_NCHANNELS(&frame->header);
 //  ns  = MAD_NSBSAMPLES(&frame->header);
 
+  /* layer III leaves a single channel in sbsample[0] for these */
+  if (nch == 2 && (frame->options & MAD_OPTION_SINGLECHANNEL))
+    nch = 1;
+
   synth->pcm.samplerate = frame->header.samplerate;
   synth->pcm.channels   = nch;
   synth->pcm.length     = 32;// * ns;
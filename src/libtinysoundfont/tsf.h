@@ -119,6 +119,11 @@ TSFDEF const char* tsf_get_presetname(const tsf* f, int preset_index);
 // Returns the name of a preset by bank and preset number
 TSFDEF const char* tsf_bank_get_presetname(const tsf* f, int bank, int preset_number);
 
+// Presets are indexed by tsf_load, but their regions are only read in from the SoundFont when first
+// played.  Does that now for a preset index >= 0 and < tsf_get_presetcount(), to keep it off the
+// playback path.
+TSFDEF void tsf_preload_preset(tsf* f, int preset_index);
+
 // Supported output modes by the render methods
 enum TSFOutputMode
 {
@@ -163,6 +168,14 @@ TSFDEF void tsf_note_off_all(tsf* f);
 // Returns the number of active voices
 TSFDEF int tsf_active_voice_count(tsf* f);
 
+// Limit the voices sounding at once, 0 for no limit (the default).  Over it, a note on (or a lower
+// limit, right away) cuts a voice short with the fast release: a releasing one if there is any, the
+// quietest, then the oldest.  The stolen voices keep playing out their fade on top of the limit.
+TSFDEF void tsf_set_max_voices(tsf* f, int max_voices);
+
+// Returns the number of voices that were cut short by the limit so far
+TSFDEF int tsf_stolen_voice_count(tsf* f);
+
 // Render output samples into a buffer
 // You can either render as signed 16-bit values (tsf_render_short) or
 // as 32-bit float values (tsf_render_float)
@@ -172,6 +185,17 @@ TSFDEF int tsf_active_voice_count(tsf* f);
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 
+// Like tsf_render_short, but without interpolation and with the envelopes, LFOs, gain, pitch and
+// low-pass filter all run in fixed point, for CPUs without (double precision) floating point.  Only
+// note events still use floating point.  A low-pass filter modulated by an LFO or the modulation
+// envelope is approximated by a one-pole filter.
+TSFDEF void tsf_render_short_fixed(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
+
+// Renders with linear interpolation and, for the stereo output modes, panning, mixing all voices at
+// 32 bits before a single saturating pass.  Still much cheaper than tsf_render_short, with the
+// effects of tsf_render_short_fast (flag_fixed 0) or tsf_render_short_fixed (1).
+TSFDEF void tsf_render_short_mix(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0, int flag_fixed CPP_DEFAULT0);
+
 // Higher level channel based functions, set up channel parameters
 //   channel: channel number
 //   preset_index: preset index >= 0 and < tsf_get_presetcount()
@@ -302,22 +326,29 @@ struct tsf
 	unsigned int fontSampleCount;
 	struct tsf_channels* channels;
 	float* outputSamples;
+	int32_t* mixBus;
 
 	int presetNum;
 	int voiceNum;
 	int outputSampleSize;
+	int mixBusSize;
+	int maxVoices;
+	int voicesStolen;
 	unsigned int voicePlayIndex;
 
 	enum TSFOutputMode outputmode;
 	float outSampleRate;
 	float globalGainDB;
+	int lowpassLog2Q16; // log2(2 * pi * 8.176 / outSampleRate), for the fixed point one-pole cutoff
 
 	struct tsf_hydra *hydra;
 
-	// Cached sample read 
+	// Cached sample read.  refs counts the voices whose sample window is in a buffer, those are only
+	// evicted when every buffer is in use.
 	short *buffer[TSF_BUFFS];
 	int offset[TSF_BUFFS];
 	int timestamp[TSF_BUFFS];
+	int refs[TSF_BUFFS];
 	int epoch;
 };
 
@@ -522,16 +553,17 @@ struct tsf_hydra_imod { tsf_u16 modSrcOper, modDestOper; tsf_s16 modAmount; tsf_
 struct tsf_hydra_igen { tsf_u16 genOper; union tsf_hydra_genamount genAmount; };
 struct tsf_hydra_shdr { tsf_char20 sampleName; tsf_u32 start, end, startLoop, endLoop, sampleRate; tsf_u8 originalPitch; tsf_s8 pitchCorrection; tsf_u16 sampleLink, sampleType; };
 
-#define TSFR(FIELD) stream->read(stream->data, &i->FIELD, sizeof(i->FIELD));
-static void tsf_hydra_read_phdr(struct tsf_hydra_phdr* i, struct tsf_stream* stream) { TSFR(presetName) TSFR(preset) TSFR(bank) TSFR(presetBagNdx) TSFR(library) TSFR(genre) TSFR(morphology) }
-static void tsf_hydra_read_pbag(struct tsf_hydra_pbag* i, struct tsf_stream* stream) { TSFR(genNdx) TSFR(modNdx) }
-//static void tsf_hydra_read_pmod(struct tsf_hydra_pmod* i, struct tsf_stream* stream) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
-static void tsf_hydra_read_pgen(struct tsf_hydra_pgen* i, struct tsf_stream* stream) { TSFR(genOper) TSFR(genAmount) }
-static void tsf_hydra_read_inst(struct tsf_hydra_inst* i, struct tsf_stream* stream) { TSFR(instName) TSFR(instBagNdx) }
-static void tsf_hydra_read_ibag(struct tsf_hydra_ibag* i, struct tsf_stream* stream) { TSFR(instGenNdx) TSFR(instModNdx) }
-//static void tsf_hydra_read_imod(struct tsf_hydra_imod* i, struct tsf_stream* stream) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
-static void tsf_hydra_read_igen(struct tsf_hydra_igen* i, struct tsf_stream* stream) { TSFR(genOper) TSFR(genAmount) }
-static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, struct tsf_stream* stream) { TSFR(sampleName) TSFR(start) TSFR(end) TSFR(startLoop) TSFR(endLoop) TSFR(sampleRate) TSFR(originalPitch) TSFR(pitchCorrection) TSFR(sampleLink) TSFR(sampleType) }
+// Records are read whole and picked apart here, fields being packed in the file
+#define TSFR(FIELD) TSF_MEMCPY(&i->FIELD, p, sizeof(i->FIELD)); p += sizeof(i->FIELD);
+static void tsf_hydra_read_phdr(struct tsf_hydra_phdr* i, const tsf_u8* p) { TSFR(presetName) TSFR(preset) TSFR(bank) TSFR(presetBagNdx) TSFR(library) TSFR(genre) TSFR(morphology) }
+static void tsf_hydra_read_pbag(struct tsf_hydra_pbag* i, const tsf_u8* p) { TSFR(genNdx) TSFR(modNdx) }
+//static void tsf_hydra_read_pmod(struct tsf_hydra_pmod* i, const tsf_u8* p) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
+static void tsf_hydra_read_pgen(struct tsf_hydra_pgen* i, const tsf_u8* p) { TSFR(genOper) TSFR(genAmount) }
+static void tsf_hydra_read_inst(struct tsf_hydra_inst* i, const tsf_u8* p) { TSFR(instName) TSFR(instBagNdx) }
+static void tsf_hydra_read_ibag(struct tsf_hydra_ibag* i, const tsf_u8* p) { TSFR(instGenNdx) TSFR(instModNdx) }
+//static void tsf_hydra_read_imod(struct tsf_hydra_imod* i, const tsf_u8* p) { TSFR(modSrcOper) TSFR(modDestOper) TSFR(modAmount) TSFR(modAmtSrcOper) TSFR(modTransOper) }
+static void tsf_hydra_read_igen(struct tsf_hydra_igen* i, const tsf_u8* p) { TSFR(genOper) TSFR(genAmount) }
+static void tsf_hydra_read_shdr(struct tsf_hydra_shdr* i, const tsf_u8* p) { TSFR(sampleName) TSFR(start) TSFR(end) TSFR(startLoop) TSFR(endLoop) TSFR(sampleRate) TSFR(originalPitch) TSFR(pitchCorrection) TSFR(sampleLink) TSFR(sampleType) }
 #undef TSFR
 enum
 {
@@ -543,8 +575,10 @@ enum
 #define TGET(TYPE) \
 static struct tsf_hydra_##TYPE *get_##TYPE(struct tsf_hydra *t, int idx, struct tsf_hydra_##TYPE *data) \
 { \
+	tsf_u8 record[TYPE##SizeInFile]; \
 	t->stream->seek(t->stream->data, t->TYPE##Offset + TYPE##SizeInFile * idx); \
-	tsf_hydra_read_##TYPE(data, t->stream); \
+	t->stream->read(t->stream->data, record, TYPE##SizeInFile); \
+	tsf_hydra_read_##TYPE(data, record); \
 	return data; \
 }
 
@@ -569,9 +603,11 @@ typedef int32_t fixed8p24;
 
 struct tsf_riffchunk { tsf_fourcc id; tsf_u32 size; };
 struct tsf_envelope { float delay, attack, hold, decay, sustain, release, keynumToHold, keynumToDecay; };
-struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; short segment, midiVelocity; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, isAmpEnv; };
-struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
-struct tsf_voice_lfo { int samplesUntil; float level, delta; };
+// The fixed point renderer keeps envelope and LFO levels in Q30 (levelQ30 etc.), the float ones
+// follow at segment changes.  levelIsFixed says which of level and levelQ30 is current.
+struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; short segment, midiVelocity; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, isAmpEnv; int32_t levelQ30, slopeQ30; TSF_BOOL levelIsFixed; };
+struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; int32_t a0Q28, a1Q28, b1Q28, b2Q28, z1Q, z2Q; };
+struct tsf_voice_lfo { int samplesUntil; float level, delta; int32_t levelQ30, deltaQ30; };
 
 struct tsf_region
 {
@@ -594,8 +630,9 @@ struct tsf_preset
 {
 	tsf_char20 presetName;
 	tsf_u16 preset, bank;
-	struct tsf_region* regions;
+	struct tsf_region* regions; // Loaded on first use
 	int regionNum;
+	int phdrIdx;
 };
 
 struct tsf_voice
@@ -603,8 +640,13 @@ struct tsf_voice
 	int playingPreset, playingKey, playingChannel;
 	struct tsf_region* region;
 	double pitchInputTimecents, pitchOutputFactor;
+	fixed32p32 pitchRatioF32P32; // Unmodulated playback rate
 	double sourceSamplePosition;
   fixed32p32 sourceSamplePositionF32P32;
+	// The cached block the fast renderer reads this voice's samples from, windowLen 0 if none
+	const short* window;
+	unsigned int windowStart, windowLen;
+	int windowBuff;
 	float  noteGainDB, panFactorLeft, panFactorRight;
 	unsigned int playIndex, loopStart, loopEnd;
 	struct tsf_voice_envelope ampenv, modenv;
@@ -631,6 +673,51 @@ static float tsf_cents2Hertz(float cents) { return 8.176f * TSF_POWF(2.0f, cents
 static float tsf_decibelsToGain(float db) { return (db > -100.f ? TSF_POWF(10.0f, db * 0.05f) : 0); }
 static float tsf_gainToDecibels(float gain) { return (gain <= .00001f ? -100.f : (float)(20.0 * TSF_LOG10(gain))); }
 
+// 2^(k/32) in Q30, k = 0..32
+static const uint32_t tsf_pow2Q30[33] = {
+	1073741824, 1097253708, 1121280436, 1145833280, 1170923762, 1196563654, 1222764986, 1249540052,
+	1276901417, 1304861917, 1333434672, 1362633090, 1392470869, 1422962010, 1454120821, 1485961921,
+	1518500250, 1551751076, 1585730000, 1620452965, 1655936265, 1692196547, 1729250827, 1767116489,
+	1805811301, 1845353420, 1885761398, 1927054196, 1969251188, 2012372174, 2056437387, 2101467502,
+	2147483648U };
+
+// 2^(frac/65536) in Q30 for frac = 0..65535, interpolated from the table
+static uint32_t tsf_pow2FracQ30(uint32_t frac)
+{
+	uint32_t a = tsf_pow2Q30[frac >> 11], b = tsf_pow2Q30[(frac >> 11) + 1];
+	return a + (uint32_t)(((uint64_t)(b - a) * (frac & 2047)) >> 11);
+}
+
+// 2^(x/65536) in Q(q), saturating
+static int32_t tsf_pow2Q(int32_t x, int q)
+{
+	int shift = 30 - q - (x >> 16); // Arithmetic shift, floor
+	uint32_t m = tsf_pow2FracQ30((uint32_t)x & 0xffff);
+	if (shift >= 32) return 0;
+	if (shift < 0) return 0x7fffffff; // m is at least 2^30
+	return (int32_t)(m >> shift);
+}
+
+// Decibels in Q8 to gain in Q15 (can be more than 1.0)
+static int32_t tsf_decibelsToGainQ15(int32_t dbQ8)
+{
+	if (dbQ8 <= -100 * 256) return 0;
+	return tsf_pow2Q((int32_t)(((int64_t)dbQ8 * 43541) >> 10), 15); // dB / 6.0206 in Q16
+}
+
+// ratio * 2^(centsQ8 / 256 / 1200)
+static fixed32p32 tsf_scaleByCents(fixed32p32 ratio, int32_t centsQ8)
+{
+	int32_t x = (int32_t)(((int64_t)centsQ8 * 13981) >> 16); // Octaves in Q16
+	int shift = x >> 16;
+	uint64_t m = tsf_pow2FracQ30((uint32_t)x & 0xffff);
+	uint64_t r = (uint64_t)ratio;
+	r = (((r >> 32) * m) << 2) + (((r & 0xffffffffULL) * m) >> 30);
+	return (fixed32p32)(shift >= 0 ? r << shift : r >> -shift);
+}
+
+static int32_t tsf_mulQ30(int32_t a, int32_t b) { return (int32_t)(((int64_t)a * b) >> 30); }
+
 static TSF_BOOL tsf_riffchunk_read(struct tsf_riffchunk* parent, struct tsf_riffchunk* chunk, struct tsf_stream* stream)
 {
 	TSF_BOOL IsRiff, IsList;
@@ -862,27 +949,12 @@ static void tsf_load_preset(const tsf* res, struct tsf_hydra *hydra, int presetT
 	// Read each preset.
 	struct tsf_hydra_phdr phdr;
 	int phdrIdx, phdrMaxIdx;
-	for (phdrIdx = presetToLoad, get_phdr(hydra, phdrIdx, &phdr), phdrMaxIdx = presetToLoad + 1 /*hydra->phdrNum - 1*/; phdrIdx != phdrMaxIdx; phdrIdx++, get_phdr(hydra, phdrIdx, &phdr))
+	// The name, bank and number are already there from tsf_index_presets
+	for (phdrIdx = res->presets[presetToLoad].phdrIdx, get_phdr(hydra, phdrIdx, &phdr), phdrMaxIdx = phdrIdx + 1; phdrIdx != phdrMaxIdx; phdrIdx++, get_phdr(hydra, phdrIdx, &phdr))
 	{
-		int sortedIndex = 0, region_index = 0;
-		struct tsf_hydra_phdr otherPhdr;
-		int otherPhdrIdx;
-		struct tsf_preset* preset;
+		int region_index = 0;
+		struct tsf_preset* preset = &res->presets[presetToLoad];
 		struct tsf_region globalRegion;
-		for (otherPhdrIdx = 0, get_phdr(hydra, otherPhdrIdx, &otherPhdr); otherPhdrIdx != phdrMaxIdx; otherPhdrIdx++, get_phdr(hydra, otherPhdrIdx, &otherPhdr))
-		{
-			if (otherPhdrIdx == phdrIdx || otherPhdr.bank > phdr.bank) continue;
-			else if (otherPhdr.bank < phdr.bank) sortedIndex++;
-			else if (otherPhdr.preset > phdr.preset) continue;
-			else if (otherPhdr.preset < phdr.preset) sortedIndex++;
-			else if (otherPhdrIdx < phdrIdx) sortedIndex++;
-		}
-
-		preset = &res->presets[sortedIndex];
-		TSF_MEMCPY(preset->presetName, phdr.presetName, sizeof(preset->presetName));
-		preset->presetName[sizeof(preset->presetName)-1] = '\0'; //should be zero terminated in source file but make sure
-		preset->bank = phdr.bank;
-		preset->preset = phdr.preset;
 		preset->regionNum = 0;
 
 		struct tsf_hydra_phdr phdrNext;
@@ -1033,6 +1105,32 @@ static void tsf_load_preset(const tsf* res, struct tsf_hydra *hydra, int presetT
 	}
 }
 
+// Reads just the preset headers, into presets sorted by bank, number and file order.  The regions
+// are left for tsf_load_preset, which only needs to look at the one preset's part of the hydra.
+static void tsf_index_presets(tsf* res, struct tsf_hydra *hydra)
+{
+	tsf_u8 record[phdrSizeInFile];
+	struct tsf_hydra_phdr phdr;
+	int i, j;
+	hydra->stream->seek(hydra->stream->data, hydra->phdrOffset);
+	for (i = 0; i < res->presetNum; i++)
+	{
+		struct tsf_preset preset;
+		hydra->stream->read(hydra->stream->data, record, phdrSizeInFile);
+		tsf_hydra_read_phdr(&phdr, record);
+		TSF_MEMSET(&preset, 0, sizeof(preset));
+		TSF_MEMCPY(preset.presetName, phdr.presetName, sizeof(preset.presetName));
+		preset.presetName[sizeof(preset.presetName)-1] = '\0'; //should be zero terminated in source file but make sure
+		preset.bank = phdr.bank;
+		preset.preset = phdr.preset;
+		preset.phdrIdx = i;
+		// Insertion sort, SoundFonts mostly come in order already
+		for (j = i; j > 0 && (res->presets[j - 1].bank > preset.bank || (res->presets[j - 1].bank == preset.bank && res->presets[j - 1].preset > preset.preset)); j--)
+			res->presets[j] = res->presets[j - 1];
+		res->presets[j] = preset;
+	}
+}
+
 static void tsf_load_samples(int *fontSamplesOffset, unsigned int* fontSampleCount, struct tsf_riffchunk *chunkSmpl, struct tsf_stream* stream)
 {
 	// Read sample data into float format buffer.
@@ -1042,7 +1140,7 @@ static void tsf_load_samples(int *fontSamplesOffset, unsigned int* fontSampleCou
 	stream->skip(stream->data, samplesLeft * sizeof(short));
 }
 
-static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, short active_segment, float outSampleRate)
+static void tsf_voice_envelope_segment(struct tsf_voice_envelope* e, short active_segment, float outSampleRate)
 {
 	switch (active_segment)
 	{
@@ -1147,6 +1245,14 @@ static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, short a
 	}
 }
 
+static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, short active_segment, float outSampleRate)
+{
+	if (e->levelIsFixed) e->level = e->levelQ30 * (1.0f / (1 << 30));
+	tsf_voice_envelope_segment(e, active_segment, outSampleRate);
+	e->levelQ30 = (int32_t)(e->level * (1 << 30));
+	e->slopeQ30 = (int32_t)(e->slope * (1 << 30));
+}
+
 static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_envelope* new_parameters, int midiNoteNumber, short midiVelocity, TSF_BOOL isAmpEnv, float outSampleRate)
 {
 	e->parameters = *new_parameters;
@@ -1162,11 +1268,13 @@ static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_en
 	}
 	e->midiVelocity = midiVelocity;
 	e->isAmpEnv = isAmpEnv;
+	e->levelIsFixed = TSF_FALSE;
 	tsf_voice_envelope_nextsegment(e, TSF_SEGMENT_NONE, outSampleRate);
 }
 
 static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, int numSamples, float outSampleRate)
 {
+	e->levelIsFixed = TSF_FALSE;
 	if (e->slope)
 	{
 		if (e->segmentIsExponential) e->level *= TSF_POWF(e->slope, (float)numSamples);
@@ -1176,6 +1284,30 @@ static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, int numSamp
 		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
 }
 
+static void tsf_voice_envelope_process_fixed(struct tsf_voice_envelope* e, int numSamples, float outSampleRate)
+{
+	e->levelIsFixed = TSF_TRUE;
+	if (e->slopeQ30)
+	{
+		if (e->segmentIsExponential)
+		{
+			// level * slope^numSamples, by squaring
+			int32_t m = e->slopeQ30, p = (1 << 30);
+			for (int n = numSamples; n; n >>= 1, m = tsf_mulQ30(m, m))
+				if (n & 1) p = tsf_mulQ30(p, m);
+			e->levelQ30 = tsf_mulQ30(e->levelQ30, p);
+		}
+		else
+		{
+			// In 64 bits and clamped, a steep slope over a long block would overflow 32
+			int64_t level = (int64_t)e->levelQ30 + (int64_t)e->slopeQ30 * numSamples;
+			e->levelQ30 = (int32_t)(level > 0x7FFFFFFF ? 0x7FFFFFFF : level < -0x7FFFFFFFLL - 1 ? -0x7FFFFFFFLL - 1 : level);
+		}
+	}
+	if ((e->samplesUntilNextSegment -= numSamples) <= 0)
+		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
+}
+
 static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
 {
 	// Lowpass filter from http://www.earlevel.com/main/2012/11/26/biquad-c-source-code/
@@ -1185,6 +1317,10 @@ static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
 	e->a1 = 2 * e->a0;
 	e->b1 = 2 * (KK - 1) * norm;
 	e->b2 = (1 - K * e->QInv + KK) * norm;
+	e->a0Q28 = (int32_t)(e->a0 * (1 << 28));
+	e->a1Q28 = (int32_t)(e->a1 * (1 << 28));
+	e->b1Q28 = (int32_t)(e->b1 * (1 << 28));
+	e->b2Q28 = (int32_t)(e->b2 * (1 << 28));
 }
 
 static float tsf_voice_lowpass_process(struct tsf_voice_lowpass* e, double In)
@@ -1197,6 +1333,8 @@ static void tsf_voice_lfo_setup(struct tsf_voice_lfo* e, float delay, int freqCe
 	e->samplesUntil = (int)(delay * outSampleRate);
 	e->delta = (4.0f * tsf_cents2Hertz((float)freqCents) / outSampleRate);
 	e->level = 0;
+	e->deltaQ30 = (int32_t)(e->delta * (1 << 30));
+	e->levelQ30 = 0;
 }
 
 static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
@@ -1207,8 +1345,25 @@ static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
 	else if (e->level < -1.0f) { e->delta = -e->delta; e->level = -2.0f - e->level; }
 }
 
-static void tsf_voice_kill(struct tsf_voice* v)
+static void tsf_voice_lfo_process_fixed(struct tsf_voice_lfo* e, int blockSamples)
+{
+	if (e->samplesUntil > blockSamples) { e->samplesUntil -= blockSamples; return; }
+	int64_t level = (int64_t)e->levelQ30 + (int64_t)e->deltaQ30 * blockSamples;
+	if      (level >  (1 << 30)) { e->deltaQ30 = -e->deltaQ30; level =  (2LL << 30) - level; }
+	else if (level < -(1 << 30)) { e->deltaQ30 = -e->deltaQ30; level = -(2LL << 30) - level; }
+	e->levelQ30 = (int32_t)level;
+}
+
+static void tsf_voice_release_window(tsf* f, struct tsf_voice* v)
 {
+	if (v->windowBuff >= 0) f->refs[v->windowBuff]--;
+	v->windowBuff = -1;
+	v->windowLen = 0;
+}
+
+static void tsf_voice_kill(tsf* f, struct tsf_voice* v)
+{
+	tsf_voice_release_window(f, v);
 	v->playingPreset = -1;
 }
 
@@ -1229,6 +1384,47 @@ static void tsf_voice_endquick(struct tsf_voice* v, float outSampleRate)
 	v->modenv.parameters.release = 0.0f; tsf_voice_envelope_nextsegment(&v->modenv, TSF_SEGMENT_SUSTAIN, outSampleRate);
 }
 
+// Whether the voice is already on its way out with the fast release, so doesn't count to the limit
+static TSF_BOOL tsf_voice_ending(struct tsf_voice* v)
+{
+	return (v->ampenv.segment >= TSF_SEGMENT_RELEASE && !v->ampenv.parameters.release);
+}
+
+// How loud the voice is now, or for one still in its delay or attack, is going to be.  Envelope
+// level in Q30 times note gain in Q15, kept in fixed point so ranking voices costs no powf().
+static int64_t tsf_voice_loudness(struct tsf_voice* v)
+{
+	int32_t levelQ30 = (v->ampenv.segment <= TSF_SEGMENT_ATTACK ? (1 << 30) : v->ampenv.levelIsFixed ? v->ampenv.levelQ30 : (int32_t)(v->ampenv.level * (1 << 30)));
+	return (int64_t)levelQ30 * tsf_decibelsToGainQ15((int32_t)(v->noteGainDB * 256));
+}
+
+// End the voices over keep with the fast release, leaving those of the note playIndex alone
+static void tsf_voice_steal(tsf* f, int keep, unsigned int playIndex)
+{
+	struct tsf_voice *vBegin = f->voices, *vEnd = vBegin + f->voiceNum;
+	for (;;)
+	{
+		struct tsf_voice *v, *victim = TSF_NULL;
+		int count = 0; TSF_BOOL victimReleasing = TSF_FALSE; int64_t victimLoudness = 0;
+		for (v = vBegin; v != vEnd; v++)
+			if (v->playingPreset != -1 && !tsf_voice_ending(v)) count++;
+		if (count <= keep) return;
+		for (v = vBegin; v != vEnd; v++)
+		{
+			TSF_BOOL releasing; int64_t loudness;
+			if (v->playingPreset == -1 || tsf_voice_ending(v) || v->playIndex == playIndex) continue;
+			releasing = (v->ampenv.segment >= TSF_SEGMENT_RELEASE);
+			loudness = tsf_voice_loudness(v);
+			if (victim && (releasing < victimReleasing || (releasing == victimReleasing &&
+				(loudness > victimLoudness || (loudness == victimLoudness && v->playIndex > victim->playIndex))))) continue;
+			victim = v, victimReleasing = releasing, victimLoudness = loudness;
+		}
+		if (!victim) return;
+		tsf_voice_endquick(victim, f->outSampleRate);
+		f->voicesStolen++;
+	}
+}
+
 static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, float outSampleRate)
 {
 	double note = v->playingKey + v->region->transpose + v->region->tune / 100.0;
@@ -1236,41 +1432,60 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, floa
 	if (pitchShift) adjustedPitch += pitchShift;
 	v->pitchInputTimecents = adjustedPitch * 100.0;
 	v->pitchOutputFactor = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * outSampleRate);
+	v->pitchRatioF32P32 = (fixed32p32)(tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor * 4294967296.0);
 }
 
-short tsf_read_short_cached(tsf *f, int pos)
+// Index of the buffer holding sample pos, reading it in if needed.  Buffers no voice window is in are
+// replaced first; when there are none left the oldest one is taken from the voices using it, which
+// will look up their window again.
+static int tsf_cache_block(tsf *f, int pos)
 {
-	static int hits = 0;
-	static int misses = 0;
-//	static int call =0;
-//	call++;
-//	if ((call % 88000) ==0) printf("Hit: %d, Miss: %d, Ratio: %f\n", hits, misses, (double)hits/(double)(misses+hits));
-
 	for (int i=0; i<TSF_BUFFS; i++) {
 		if ((f->offset[i] <= pos) && ((f->offset[i] + TSF_BUFFSIZE) > pos) ) {
 			f->timestamp[i] = f->epoch++;
 			if (f->epoch==0) {
 				for (int i=0; i<TSF_BUFFS; i++) f->timestamp[i] = f->epoch++;
 			}
-			hits++;
-      return f->buffer[i][pos - f->offset[i]];
+			return i;
 		}
 	}
-	int repl = 0;
-	for (int i=1; i<TSF_BUFFS; i++) {
-		if (f->timestamp[i] < f->timestamp[repl]) repl = i;
+	int repl = -1;
+	for (int i=0; i<TSF_BUFFS; i++) {
+		if (!f->refs[i] && ((repl < 0) || (f->timestamp[i] < f->timestamp[repl]))) repl = i;
+	}
+	if (repl < 0) {
+		repl = 0;
+		for (int i=1; i<TSF_BUFFS; i++) {
+			if (f->timestamp[i] < f->timestamp[repl]) repl = i;
+		}
+		struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+		for (; v != vEnd; v++)
+			if (v->windowBuff == repl) tsf_voice_release_window(f, v);
 	}
 	int readOff = pos - (pos % TSF_BUFFSIZE);
-// for (int i=0; i<TSF_BUFFSIZE; i++) { f->buffer[repl][i] = i; }
 	f->hydra->stream->seek(f->hydra->stream->data, readOff * sizeof(short));
 	f->hydra->stream->read(f->hydra->stream->data, f->buffer[repl], TSF_BUFFSIZE * sizeof(short));
-//static uint32_t *bp = NULL; if (!bp) bp = (uint32_t*)malloc(512);
-//printf("off=%08x, buff=%p, len=%08x\n", readOff * sizeof(short), bp, TSF_BUFFSIZE); spi_flash_read(0x0000, bp, 512/4-4) ;
 	f->timestamp[repl] = f->epoch++;
 	f->offset[repl] = readOff;
-	misses++;
-//	fprintf(stderr, "buffer[%d][%d-%d = %d]\n", repl, pos, readOff, pos - readOff);
-	return f->buffer[repl][pos - readOff];
+	return repl;
+}
+
+short tsf_read_short_cached(tsf *f, int pos)
+{
+	int i = tsf_cache_block(f, pos);
+	return f->buffer[i][pos - f->offset[i]];
+}
+
+// Point the voice's sample window at the cached block holding pos
+static void tsf_voice_window(tsf* f, struct tsf_voice* v, unsigned int pos)
+{
+	tsf_voice_release_window(f, v);
+	int i = tsf_cache_block(f, (int)pos);
+	f->refs[i]++;
+	v->windowBuff = i;
+	v->window = f->buffer[i];
+	v->windowStart = f->offset[i];
+	v->windowLen = TSF_BUFFSIZE;
 }
 
 static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
@@ -1412,7 +1627,7 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 
 		if (tmpSourceSamplePosition >= tmpSampleEndDbl || v->ampenv.segment == TSF_SEGMENT_DONE)
 		{
-			tsf_voice_kill(v);
+			tsf_voice_kill(f, v);
 			return;
 		}
 	}
@@ -1456,6 +1671,11 @@ static void tsf_voice_render_fast(tsf* f, struct tsf_voice* v, short* outputBuff
   TSF_BOOL dynamicGain = (region->modLfoToVolume != 0);
   float noteGain, tmpModLfoToVolume;
 
+  // Samples come straight out of the voice's window into the cache, a lookup is only needed when
+  // the position leaves it
+  const short* window = v->window;
+  unsigned int windowStart = v->windowStart, windowLen = v->windowLen;
+
   if (dynamicLowpass) tmpInitialFilterFc = (float)region->initialFilterFc, tmpModLfoToFilterFc = (float)region->modLfoToFilterFc, tmpModEnvToFilterFc = (float)region->modEnvToFilterFc;
   else tmpInitialFilterFc = 0, tmpModLfoToFilterFc = 0, tmpModEnvToFilterFc = 0;
 
@@ -1505,7 +1725,11 @@ static void tsf_voice_render_fast(tsf* f, struct tsf_voice* v, short* outputBuff
     {
       unsigned int pos = (unsigned int)(tmpSourceSamplePositionF32P32>>32);
       if (pos == 0xffffffff) pos = 0;
-      short val = tsf_read_short_cached(f, pos);
+      if (pos - windowStart >= windowLen) {
+        tsf_voice_window(f, v, pos);
+        window = v->window, windowStart = v->windowStart, windowLen = v->windowLen;
+      }
+      short val = window[pos - windowStart];
       int32_t val32 = (int)val * (int)gainMonoFP;
 
       *outL++ += val32>>16;
@@ -1519,7 +1743,7 @@ static void tsf_voice_render_fast(tsf* f, struct tsf_voice* v, short* outputBuff
 
     if (tmpSourceSamplePositionF32P32 >= tmpSampleEndF32P32 || v->ampenv.segment == TSF_SEGMENT_DONE)
     {
-      tsf_voice_kill(v);
+      tsf_voice_kill(f, v);
       return;
     }
   }
@@ -1531,6 +1755,234 @@ static void tsf_voice_render_fast(tsf* f, struct tsf_voice* v, short* outputBuff
 
 
 
+// Per effect block work of the fixed point renderers: advances the envelopes and LFOs and returns the
+// voice's gain (Q15) and its playback rate and low-pass filter for the block.  Modulation depths are
+// in cents (pitch, filter) and centibels (volume), so Q30 levels times depths shifted down give cents
+// or dB in Q8.  With a modulated cutoff the filter is a one-pole one with its coefficient in a0Q28
+// (as Q15) and its state in z1Q, otherwise the biquad set up at note on.
+static int32_t tsf_voice_block_fixed(tsf* f, struct tsf_voice* v, int blockSamples, int32_t noteGainQ8, fixed32p32* pitchRatioF32P32, struct tsf_voice_lowpass* lowpass)
+{
+  struct tsf_region* region = v->region;
+
+  if (region->modLfoToFilterFc || region->modEnvToFilterFc)
+  {
+    int32_t fres = region->initialFilterFc + (int32_t)(((int64_t)v->modlfo.levelQ30 * region->modLfoToFilterFc + (int64_t)v->modenv.levelQ30 * region->modEnvToFilterFc) >> 30);
+    lowpass->active = (fres <= 13500);
+    if (lowpass->active)
+    {
+      // w = 2 * pi * fc / rate, coefficient w / (1 + w)
+      int32_t w = tsf_pow2Q(f->lowpassLog2Q16 + (int32_t)(((int64_t)fres * 3579139) >> 16), 16);
+      lowpass->a0Q28 = (int32_t)(((int64_t)w << 15) / (65536 + (int64_t)w));
+    }
+  }
+
+  if (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch)
+  {
+    int32_t centsQ8 = (int32_t)(((int64_t)v->modlfo.levelQ30 * region->modLfoToPitch + (int64_t)v->viblfo.levelQ30 * region->vibLfoToPitch + (int64_t)v->modenv.levelQ30 * region->modEnvToPitch) >> 22);
+    *pitchRatioF32P32 = tsf_scaleByCents(v->pitchRatioF32P32, centsQ8);
+  }
+  else *pitchRatioF32P32 = v->pitchRatioF32P32;
+
+  if (region->modLfoToVolume)
+    noteGainQ8 += (int32_t)(((int64_t)v->modlfo.levelQ30 * region->modLfoToVolume * 128 / 5) >> 30);
+
+  int32_t gainFP = (int32_t)(((int64_t)tsf_decibelsToGainQ15(noteGainQ8) * v->ampenv.levelQ30) >> 30);
+  if (gainFP > 32767) gainFP = 32767;
+  if (gainFP < 0) gainFP = 0;
+
+  // Update EG.
+  tsf_voice_envelope_process_fixed(&v->ampenv, blockSamples, f->outSampleRate);
+  if (region->modEnvToPitch || region->modEnvToFilterFc) tsf_voice_envelope_process_fixed(&v->modenv, blockSamples, f->outSampleRate);
+
+  // Update LFOs.
+  if (v->modlfo.deltaQ30 && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume)) tsf_voice_lfo_process_fixed(&v->modlfo, blockSamples);
+  if (v->viblfo.deltaQ30 && region->vibLfoToPitch) tsf_voice_lfo_process_fixed(&v->viblfo, blockSamples);
+  return gainFP;
+}
+
+// The same with the floating point effects of tsf_voice_render_fast, which has no low-pass filter
+static int32_t tsf_voice_block_float(tsf* f, struct tsf_voice* v, int blockSamples, fixed32p32* pitchRatioF32P32)
+{
+  struct tsf_region* region = v->region;
+
+  if (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch)
+    *pitchRatioF32P32 = (fixed32p32)(tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * region->modLfoToPitch + v->viblfo.level * region->vibLfoToPitch + v->modenv.level * region->modEnvToPitch)) * v->pitchOutputFactor * 4294967296.0);
+  else *pitchRatioF32P32 = v->pitchRatioF32P32;
+
+  float noteGain = tsf_decibelsToGain(v->noteGainDB + (region->modLfoToVolume ? v->modlfo.level * region->modLfoToVolume * 0.1f : 0.0f));
+  float gain = noteGain * v->ampenv.level * 32767;
+  int32_t gainFP = (gain > 32767 ? 32767 : gain < 0 ? 0 : (int32_t)gain);
+
+  // Update EG.
+  tsf_voice_envelope_process(&v->ampenv, blockSamples, f->outSampleRate);
+  if (region->modEnvToPitch || region->modEnvToFilterFc) tsf_voice_envelope_process(&v->modenv, blockSamples, f->outSampleRate);
+
+  // Update LFOs.
+  if (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume)) tsf_voice_lfo_process(&v->modlfo, blockSamples);
+  if (v->viblfo.delta && region->vibLfoToPitch) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+  return gainFP;
+}
+
+// One sample through the low-pass filter, which runs with 8 more bits of precision
+static int32_t tsf_voice_lowpass_process_fixed(struct tsf_voice_lowpass* e, int32_t val, TSF_BOOL onePole)
+{
+  int32_t in = val * 256, out;
+  if (onePole)
+  {
+    out = e->z1Q + (int32_t)(((int64_t)(in - e->z1Q) * e->a0Q28) >> 15);
+    e->z1Q = out;
+  }
+  else
+  {
+    out = (int32_t)(((int64_t)in * e->a0Q28) >> 28) + e->z1Q;
+    e->z1Q = (int32_t)(((int64_t)in * e->a1Q28 - (int64_t)out * e->b1Q28) >> 28) + e->z2Q;
+    e->z2Q = (int32_t)(((int64_t)in * e->a0Q28 - (int64_t)out * e->b2Q28) >> 28);
+  }
+  val = out >> 8;
+  return (val > 32767 ? 32767 : val < -32768 ? -32768 : val);
+}
+
+// tsf_voice_render_fast with integer effects
+static void tsf_voice_render_fixed(tsf* f, struct tsf_voice* v, short* outputBuffer, int numSamples)
+{
+  struct tsf_region* region = v->region;
+  short* outL = outputBuffer;
+  short* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
+  int outStep = (f->outputmode == TSF_STEREO_INTERLEAVED ? 2 : 1);
+
+  TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
+  fixed32p32 tmpSampleEndF32P32 = ((fixed32p32)(region->end)) << 32;
+  fixed32p32 tmpLoopStartF32P32 = ((fixed32p32)(v->loopStart + 1)) << 32;
+  fixed32p32 tmpLoopEndF32P32 = ((fixed32p32)(v->loopEnd + 1)) << 32;
+  fixed32p32 tmpSourceSamplePositionF32P32 = v->sourceSamplePositionF32P32;
+  fixed32p32 pitchRatioF32P32;
+  struct tsf_voice_lowpass tmpLowpass = v->lowpass;
+  TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
+  int32_t noteGainQ8 = (int32_t)(v->noteGainDB * 256);
+
+  const short* window = v->window;
+  unsigned int windowStart = v->windowStart, windowLen = v->windowLen;
+
+  while (numSamples)
+  {
+    int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
+    numSamples -= blockSamples;
+
+    int32_t gainMonoFP = tsf_voice_block_fixed(f, v, blockSamples, noteGainQ8, &pitchRatioF32P32, &tmpLowpass);
+
+    while (blockSamples-- && tmpSourceSamplePositionF32P32 < tmpSampleEndF32P32)
+    {
+      unsigned int pos = (unsigned int)(tmpSourceSamplePositionF32P32>>32);
+      if (pos == 0xffffffff) pos = 0;
+      if (pos - windowStart >= windowLen) {
+        tsf_voice_window(f, v, pos);
+        window = v->window, windowStart = v->windowStart, windowLen = v->windowLen;
+      }
+      int32_t val = window[pos - windowStart];
+
+      if (tmpLowpass.active) val = tsf_voice_lowpass_process_fixed(&tmpLowpass, val, dynamicLowpass);
+      int32_t val32 = val * gainMonoFP;
+
+      *outL += val32>>16;
+      if (outR) *outR++ += val32>>16;
+      else if (outStep == 2) outL[1] += val32>>16;
+      outL += outStep;
+
+      // Next sample.
+      tmpSourceSamplePositionF32P32 += pitchRatioF32P32;
+      if (tmpSourceSamplePositionF32P32 >= tmpLoopEndF32P32 && isLooping)
+        tmpSourceSamplePositionF32P32 -= (tmpLoopEndF32P32 - tmpLoopStartF32P32 + (1LL<<32));
+    }
+
+    if (tmpSourceSamplePositionF32P32 >= tmpSampleEndF32P32 || v->ampenv.segment == TSF_SEGMENT_DONE)
+    {
+      tsf_voice_kill(f, v);
+      return;
+    }
+  }
+
+  v->sourceSamplePositionF32P32 = tmpSourceSamplePositionF32P32;
+  v->lowpass.z1Q = tmpLowpass.z1Q, v->lowpass.z2Q = tmpLowpass.z2Q;
+}
+
+// Adds a voice into the 32-bit mix bus (interleaved stereo, or mono) with linear interpolation and,
+// in stereo, its pan.  The left and right gains are worked out once per effect block; both samples
+// interpolated between normally come out of the voice's window.
+static void tsf_voice_render_mix(tsf* f, struct tsf_voice* v, int32_t* bus, int numSamples, TSF_BOOL fixedEffects)
+{
+  struct tsf_region* region = v->region;
+  TSF_BOOL stereo = (f->outputmode != TSF_MONO);
+  TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
+  unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
+  fixed32p32 tmpSampleEndF32P32 = ((fixed32p32)(region->end)) << 32;
+  fixed32p32 tmpLoopEndF32P32 = ((fixed32p32)(tmpLoopEnd + 1)) << 32;
+  fixed32p32 tmpLoopLenF32P32 = ((fixed32p32)(tmpLoopEnd - tmpLoopStart + 1)) << 32;
+  fixed32p32 tmpSourceSamplePositionF32P32 = v->sourceSamplePositionF32P32;
+  fixed32p32 pitchRatioF32P32;
+  struct tsf_voice_lowpass tmpLowpass = v->lowpass;
+  TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
+  int32_t noteGainQ8 = (int32_t)(v->noteGainDB * 256);
+  int32_t panLeftQ15 = (int32_t)(v->panFactorLeft * 32767), panRightQ15 = (int32_t)(v->panFactorRight * 32767);
+
+  const short* window = v->window;
+  unsigned int windowStart = v->windowStart, windowLen = v->windowLen;
+
+  while (numSamples)
+  {
+    int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
+    numSamples -= blockSamples;
+
+    int32_t gainFP = (fixedEffects ? tsf_voice_block_fixed(f, v, blockSamples, noteGainQ8, &pitchRatioF32P32, &tmpLowpass)
+                                   : tsf_voice_block_float(f, v, blockSamples, &pitchRatioF32P32));
+    int32_t gainLeft = (stereo ? (gainFP * panLeftQ15) >> 15 : gainFP), gainRight = (gainFP * panRightQ15) >> 15;
+
+    while (blockSamples-- && tmpSourceSamplePositionF32P32 < tmpSampleEndF32P32)
+    {
+      unsigned int pos = (unsigned int)(tmpSourceSamplePositionF32P32>>32);
+      unsigned int nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+      int32_t val, next;
+      if (pos - windowStart >= windowLen) {
+        tsf_voice_window(f, v, pos);
+        window = v->window, windowStart = v->windowStart, windowLen = v->windowLen;
+      }
+      val = window[pos - windowStart];
+      if (nextPos - windowStart < windowLen) next = window[nextPos - windowStart];
+      else {
+        // With every cache block in use this can take the window's own block away
+        next = tsf_read_short_cached(f, (int)nextPos);
+        window = v->window, windowStart = v->windowStart, windowLen = v->windowLen;
+      }
+
+      // Interpolate on the top 15 bits of the fraction
+      val += ((next - val) * (int32_t)((uint32_t)tmpSourceSamplePositionF32P32 >> 17)) >> 15;
+
+      if (fixedEffects && tmpLowpass.active) val = tsf_voice_lowpass_process_fixed(&tmpLowpass, val, dynamicLowpass);
+
+      if (stereo) {
+        bus[0] += (val * gainLeft) >> 8;
+        bus[1] += (val * gainRight) >> 8;
+        bus += 2;
+      } else {
+        *bus++ += (val * gainLeft) >> 8;
+      }
+
+      // Next sample.
+      tmpSourceSamplePositionF32P32 += pitchRatioF32P32;
+      if (tmpSourceSamplePositionF32P32 >= tmpLoopEndF32P32 && isLooping)
+        tmpSourceSamplePositionF32P32 -= tmpLoopLenF32P32;
+    }
+
+    if (tmpSourceSamplePositionF32P32 >= tmpSampleEndF32P32 || v->ampenv.segment == TSF_SEGMENT_DONE)
+    {
+      tsf_voice_kill(f, v);
+      return;
+    }
+  }
+
+  v->sourceSamplePositionF32P32 = tmpSourceSamplePositionF32P32;
+  v->lowpass.z1Q = tmpLowpass.z1Q, v->lowpass.z2Q = tmpLowpass.z2Q;
+}
+
 TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 {
 	tsf* res = TSF_NULL;
@@ -1611,6 +2063,7 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		TSF_MEMCPY(res->hydra, &hydra, sizeof(*res->hydra));
 		res->hydra->stream = (struct tsf_stream*)TSF_MALLOC(sizeof(struct tsf_stream));
 		TSF_MEMCPY(res->hydra->stream, stream, sizeof(*res->hydra->stream));
+		tsf_index_presets(res, res->hydra);
 
 		// Cached sample
 		for (int i=0; i<TSF_BUFFS; i++) {
@@ -1633,6 +2086,7 @@ TSFDEF void tsf_close(tsf* f)
 	TSF_FREE(f->voices);
 	if (f->channels) { TSF_FREE(f->channels->channels); TSF_FREE(f->channels); }
 	TSF_FREE(f->outputSamples);
+	TSF_FREE(f->mixBus);
 	f->hydra->stream->close(f->hydra->stream->data);
 	TSF_FREE(f->hydra->stream);
 	TSF_FREE(f->hydra);
@@ -1666,7 +2120,6 @@ TSFDEF int tsf_get_presetcount(const tsf* f)
 
 TSFDEF const char* tsf_get_presetname(const tsf* f, int preset)
 {
-	if (f->presets[preset].regions == NULL && preset >= 0 && preset < f->presetNum) tsf_load_preset(f, f->hydra, preset);
 	return (preset < 0 || preset >= f->presetNum ? TSF_NULL : f->presets[preset].presetName);
 }
 
@@ -1675,11 +2128,18 @@ TSFDEF const char* tsf_bank_get_presetname(const tsf* f, int bank, int preset_nu
 	return tsf_get_presetname(f, tsf_get_presetindex(f, bank, preset_number));
 }
 
+TSFDEF void tsf_preload_preset(tsf* f, int preset_index)
+{
+	if (preset_index < 0 || preset_index >= f->presetNum) return;
+	if (f->presets[preset_index].regions == NULL) tsf_load_preset(f, f->hydra, preset_index);
+}
+
 TSFDEF void tsf_set_output(tsf* f, enum TSFOutputMode outputmode, int samplerate, float global_gain_db)
 {
 	f->outputmode = outputmode;
 	f->outSampleRate = (float)(samplerate >= 1 ? samplerate : 44100.0f);
 	f->globalGainDB = global_gain_db;
+	f->lowpassLog2Q16 = (int)(TSF_LOG(2.0 * TSF_PI * 8.176 / f->outSampleRate) / TSF_LOG(2.0) * 65536.0);
 }
 
 TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
@@ -1699,14 +2159,14 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		struct tsf_voice *voice, *v, *vEnd; TSF_BOOL doLoop; float lowpassFilterQDB, lowpassFc;
 		if (key < region->lokey || key > region->hikey || midiVelocity < region->lovel || midiVelocity > region->hivel) continue;
 
-		voice = TSF_NULL, v = f->voices, vEnd = v + f->voiceNum;
+		voice = TSF_NULL, vEnd = f->voices + f->voiceNum;
 		if (region->group)
 		{
-			for (; v != vEnd; v++)
+			for (v = f->voices; v != vEnd; v++)
 				if (v->playingPreset == preset_index && v->region->group == region->group) tsf_voice_endquick(v, f->outSampleRate);
-				else if (v->playingPreset == -1 && !voice) voice = v;
 		}
-		else for (; v != vEnd; v++) if (v->playingPreset == -1) { voice = v; break; }
+		if (f->maxVoices) tsf_voice_steal(f, f->maxVoices - 1, voicePlayIndex);
+		for (v = f->voices; v != vEnd; v++) if (v->playingPreset == -1) { voice = v; break; }
 
 		if (!voice)
 		{
@@ -1720,6 +2180,7 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 			}
 			voice = &f->voices[f->voiceNum - 4];
 			voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
+			for (int i = 0; i < 4; i++) voice[i].windowBuff = -1, voice[i].windowLen = 0;
 		}
 
 		voice->region = region;
@@ -1758,6 +2219,7 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		lowpassFilterQDB = region->initialFilterQ / 10.0f;
 		voice->lowpass.QInv = 1.0 / TSF_POW(10.0, (lowpassFilterQDB / 20.0));
 		voice->lowpass.z1 = voice->lowpass.z2 = 0;
+		voice->lowpass.z1Q = voice->lowpass.z2Q = 0;
 		voice->lowpass.active = (lowpassFc < 0.499f);
 		if (voice->lowpass.active) tsf_voice_lowpass_setup(&voice->lowpass, lowpassFc);
 
@@ -1818,6 +2280,17 @@ TSFDEF int tsf_active_voice_count(tsf* f)
 	return count;
 }
 
+TSFDEF void tsf_set_max_voices(tsf* f, int max_voices)
+{
+	f->maxVoices = (max_voices > 0 ? max_voices : 0);
+	if (f->maxVoices) tsf_voice_steal(f, f->maxVoices, f->voicePlayIndex);
+}
+
+TSFDEF int tsf_stolen_voice_count(tsf* f)
+{
+	return f->voicesStolen;
+}
+
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
 {
 	float *floatSamples;
@@ -1868,6 +2341,50 @@ TSFDEF void tsf_render_short_fast(tsf* f, short* buffer, int samples, int flag_m
   }
 }
 
+TSFDEF void tsf_render_short_mix(tsf* f, short* buffer, int samples, int flag_mixing, int flag_fixed)
+{
+	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	int channelSamples = (f->outputmode == TSF_MONO ? 1 : 2) * samples, i;
+	int32_t *bus;
+	if (channelSamples > f->mixBusSize)
+	{
+		TSF_FREE(f->mixBus);
+		f->mixBus = (int32_t*)TSF_MALLOC(channelSamples * sizeof(int32_t));
+		f->mixBusSize = (f->mixBus ? channelSamples : 0);
+		if (!f->mixBus) return;
+	}
+	bus = f->mixBus;
+	if (flag_mixing && f->outputmode == TSF_STEREO_UNWEAVED)
+		for (i = 0; i < samples; i++) bus[2 * i] = buffer[i] * 256, bus[2 * i + 1] = buffer[samples + i] * 256;
+	else if (flag_mixing)
+		for (i = 0; i < channelSamples; i++) bus[i] = buffer[i] * 256;
+	else TSF_MEMSET(bus, 0, channelSamples * sizeof(int32_t));
+	for (; v != vEnd; v++) {
+		if (v->playingPreset != -1)
+			tsf_voice_render_mix(f, v, bus, samples, flag_fixed);
+		yield();
+	}
+	// The one saturating pass, bus samples being 8 bits up on the output's
+	for (i = 0; i < channelSamples; i++)
+	{
+		int32_t val = bus[i] >> 8;
+		val = (val > 32767 ? 32767 : val < -32768 ? -32768 : val);
+		if (f->outputmode == TSF_STEREO_UNWEAVED) buffer[(i & 1) * samples + (i >> 1)] = (short)val;
+		else buffer[i] = (short)val;
+	}
+}
+
+TSFDEF void tsf_render_short_fixed(tsf* f, short* buffer, int samples, int flag_mixing)
+{
+  struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+  if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(short) * samples);
+  for (; v != vEnd; v++) {
+    if (v->playingPreset != -1)
+      tsf_voice_render_fixed(f, v, buffer, samples);
+    yield();
+  }
+}
+
 
 static void tsf_channel_setup_voice(tsf* f, struct tsf_voice* v)
 {
@@ -225,11 +225,18 @@ struct OggOpusFile{
   int                od_channel_count;
   /*The channel mapping used to initialize the decoder.*/
   unsigned char      od_mapping[OP_NCHANNELS_MAX];
+  /*The ratio of 48 kHz to the rate the decoder runs at (1, 2, 3, 4 or 6).
+    Granule positions, pre-skip and discard counts stay in 48 kHz units; only
+     the decoded buffer is in decoder samples.*/
+  int                od_decim;
+  /*Whether a stereo link made of one coupled stream is decoded as mono.
+    od_channel_count is the number of channels in the decoded buffer.*/
+  int                od_mono;
   /*The buffered data for one decoded packet.*/
   op_sample         *od_buffer;
-  /*The current position in the decoded buffer.*/
+  /*The current position in the decoded buffer, in decoder samples.*/
   int                od_buffer_pos;
-  /*The number of valid samples in the decoded buffer.*/
+  /*The number of valid decoder samples in the decoded buffer.*/
   int                od_buffer_size;
   /*The type of gain offset to apply.
     One of OP_HEADER_GAIN, OP_ALBUM_GAIN, OP_TRACK_GAIN, or OP_ABSOLUTE_GAIN.*/
@@ -1368,6 +1368,12 @@ static int op_make_decode_ready(OggOpusFile *_of){
   stream_count=head->stream_count;
   coupled_count=head->coupled_count;
   channel_count=head->channel_count;
+  /*A single coupled stream can be decoded as mono by libopus itself, which
+     skips the stereo unmixing.*/
+  if(_of->od_mono&&stream_count==1&&coupled_count==1){
+    coupled_count=0;
+    channel_count=1;
+  }
   /*Check to see if the current decoder is compatible with the current link.*/
   if(_of->od!=NULL&&_of->od_stream_count==stream_count
    &&_of->od_coupled_count==coupled_count&&_of->od_channel_count==channel_count
@@ -1378,7 +1384,7 @@ static int op_make_decode_ready(OggOpusFile *_of){
   else{
     int err;
     opus_multistream_decoder_destroy(_of->od);
-    _of->od=opus_multistream_decoder_create(48000,channel_count,
+    _of->od=opus_multistream_decoder_create(48000/_of->od_decim,channel_count,
      stream_count,coupled_count,head->mapping,&err);
     if(_of->od==NULL)return OP_EFAULT;
     _of->od_stream_count=stream_count;
@@ -1526,6 +1532,7 @@ static int op_open1(OggOpusFile *_of,
   memset(_of,0,sizeof(*_of));
   if(OP_UNLIKELY(_initial_bytes>(size_t)LONG_MAX))return OP_EFAULT;
   _of->end=-1;
+  _of->od_decim=1;
   _of->stream=_stream;
   *&_of->callbacks=*_cb;
   /*At a minimum, we need to be able to read data.*/
@@ -2623,7 +2630,8 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
     if(OP_LIKELY(gp!=-1)){
       ogg_int64_t discard_count;
       int         nbuffered;
-      nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
+      nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0)
+       *_of->od_decim;
       OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
       /*We do _not_ add cur_discard_count to gp.
         Otherwise the total amount to discard could grow without bound, and it
@@ -2726,7 +2734,7 @@ ogg_int64_t op_pcm_tell(const OggOpusFile *_of){
   if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
   gp=_of->prev_packet_gp;
   if(gp==-1)return 0;
-  nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0);
+  nbuffered=OP_MAX(_of->od_buffer_size-_of->od_buffer_pos,0)*_of->od_decim;
   OP_ALWAYS_TRUE(!op_granpos_add(&gp,gp,-nbuffered));
   li=_of->seekable?_of->cur_link:0;
   if(op_granpos_add(&gp,gp,_of->cur_discard_count)<0){
@@ -2741,6 +2749,32 @@ void op_set_decode_callback(OggOpusFile *_of,
   _of->decode_cb_ctx=_ctx;
 }
 
+int op_set_decode_format(OggOpusFile *_of,opus_int32 _rate,int _mono){
+  int decim;
+  if(OP_UNLIKELY(_of->ready_state<OP_OPENED))return OP_EINVAL;
+  switch(_rate){
+    case 48000:decim=1;break;
+    case 24000:decim=2;break;
+    case 16000:decim=3;break;
+    case 12000:decim=4;break;
+    case 8000:decim=6;break;
+    default:return OP_EINVAL;
+  }
+  _mono=!!_mono;
+  if(decim==_of->od_decim&&_mono==_of->od_mono)return 0;
+  _of->od_decim=decim;
+  _of->od_mono=_mono;
+  /*Anything decoded in the old format is dropped.*/
+  _of->od_buffer_pos=_of->od_buffer_size=0;
+  opus_multistream_decoder_destroy(_of->od);
+  _of->od=NULL;
+  if(_of->ready_state>=OP_INITSET){
+    _of->ready_state=OP_STREAMSET;
+    return op_make_decode_ready(_of);
+  }
+  return 0;
+}
+
 int op_set_gain_offset(OggOpusFile *_of,
  int _gain_type,opus_int32 _gain_offset_q8){
   if(_gain_type!=OP_HEADER_GAIN&&_gain_type!=OP_ALBUM_GAIN
@@ -2834,7 +2868,7 @@ static int op_read_native(OggOpusFile *_of,
       int od_buffer_pos;
       int nsamples;
       int op_pos;
-      nchannels=_of->links[_of->seekable?_of->cur_link:0].head.channel_count;
+      nchannels=_of->od_channel_count;
       od_buffer_pos=_of->od_buffer_pos;
       nsamples=_of->od_buffer_size-od_buffer_pos;
       /*If we have buffered samples, return them.*/
@@ -2862,6 +2896,8 @@ static int op_read_native(OggOpusFile *_of,
         opus_int32        cur_discard_count;
         int               duration;
         int               trimmed_duration;
+        int               discard;
+        int               decim;
         pop=_of->op+op_pos++;
         _of->op_pos=op_pos;
         cur_discard_count=_of->cur_discard_count;
@@ -2881,7 +2917,10 @@ static int op_read_native(OggOpusFile *_of,
           }
         }
         _of->prev_packet_gp=pop->granulepos;
-        if(OP_UNLIKELY(duration*nchannels>_buf_size)){
+        /*Every packet duration is a multiple of 2.5 ms, so this is exact.*/
+        decim=_of->od_decim;
+        nsamples=duration/decim;
+        if(OP_UNLIKELY(nsamples*nchannels>_buf_size)){
           op_sample *buf;
           /*If the user's buffer is too small, decode into a scratch buffer.*/
           buf=_of->od_buffer;
@@ -2890,42 +2929,43 @@ static int op_read_native(OggOpusFile *_of,
             if(OP_UNLIKELY(ret<0))return ret;
             buf=_of->od_buffer;
           }
-          ret=op_decode(_of,buf,pop,duration,nchannels);
+          ret=op_decode(_of,buf,pop,nsamples,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
           /*Perform pre-skip/pre-roll.*/
-          od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
-          cur_discard_count-=od_buffer_pos;
+          discard=(int)OP_MIN(trimmed_duration,cur_discard_count);
+          cur_discard_count-=discard;
           _of->cur_discard_count=cur_discard_count;
-          _of->od_buffer_pos=od_buffer_pos;
-          _of->od_buffer_size=trimmed_duration;
+          _of->od_buffer_pos=discard/decim;
+          _of->od_buffer_size=trimmed_duration/decim;
           /*Update bitrate tracking based on the actual samples we used from
              what was decoded.*/
           _of->bytes_tracked+=pop->bytes;
-          _of->samples_tracked+=trimmed_duration-od_buffer_pos;
+          _of->samples_tracked+=trimmed_duration-discard;
         }
         else{
           OP_ASSERT(_pcm!=NULL);
           /*Otherwise decode directly into the user's buffer.*/
-          ret=op_decode(_of,_pcm,pop,duration,nchannels);
+          ret=op_decode(_of,_pcm,pop,nsamples,nchannels);
           if(OP_UNLIKELY(ret<0))return ret;
           if(OP_LIKELY(trimmed_duration>0)){
             /*Perform pre-skip/pre-roll.*/
-            od_buffer_pos=(int)OP_MIN(trimmed_duration,cur_discard_count);
-            cur_discard_count-=od_buffer_pos;
+            discard=(int)OP_MIN(trimmed_duration,cur_discard_count);
+            cur_discard_count-=discard;
             _of->cur_discard_count=cur_discard_count;
-            trimmed_duration-=od_buffer_pos;
-            if(OP_LIKELY(trimmed_duration>0)
-             &&OP_UNLIKELY(od_buffer_pos>0)){
-              memmove(_pcm,_pcm+od_buffer_pos*nchannels,
-               sizeof(*_pcm)*trimmed_duration*nchannels);
-            }
             /*Update bitrate tracking based on the actual samples we used from
                what was decoded.*/
             _of->bytes_tracked+=pop->bytes;
-            _of->samples_tracked+=trimmed_duration;
-            if(OP_LIKELY(trimmed_duration>0)){
+            _of->samples_tracked+=trimmed_duration-discard;
+            od_buffer_pos=discard/decim;
+            nsamples=trimmed_duration/decim-od_buffer_pos;
+            if(OP_LIKELY(nsamples>0)
+             &&OP_UNLIKELY(od_buffer_pos>0)){
+              memmove(_pcm,_pcm+od_buffer_pos*nchannels,
+               sizeof(*_pcm)*nsamples*nchannels);
+            }
+            if(OP_LIKELY(nsamples>0)){
               if(_li!=NULL)*_li=_of->cur_link;
-              return trimmed_duration;
+              return nsamples;
             }
           }
         }
@@ -2964,7 +3004,7 @@ static int op_filter_read_native(OggOpusFile *_of,void *_dst,int _dst_sz,
     ret=_of->od_buffer_size-od_buffer_pos;
     if(OP_LIKELY(ret>0)){
       int nchannels;
-      nchannels=_of->links[_of->seekable?_of->cur_link:0].head.channel_count;
+      nchannels=_of->od_channel_count;
       ret=(*_filter)(_of,_dst,_dst_sz,
        _of->od_buffer+nchannels*od_buffer_pos,ret,nchannels);
       OP_ASSERT(ret>=0);
@@ -1815,6 +1815,27 @@ typedef int (*op_decode_cb_func)(void *_ctx,OpusMSDecoder *_decoder,void *_pcm,
 void op_set_decode_callback(OggOpusFile *_of,
  op_decode_cb_func _decode_cb,void *_ctx) OP_ARG_NONNULL(1);
 
+/**Sets the sample rate and channel count the decoder runs at.
+   libopus can decode straight to 8, 12, 16 or 24 kHz, skipping the resampling
+    of SILK content and the synthesis of CELT bands that would be thrown away,
+    and can decode a stereo stream to mono without unmixing it first.
+   The read functions then return samples at \a _rate, and the decode callback
+    is asked for that many samples per second.
+   Mono applies to links with a single coupled stream (every ordinary stereo
+    file); op_read() returns one channel for those, while op_channel_count()
+    still reports the channel count of the stream.
+   All positions, durations and seek targets stay in 48 kHz samples.
+   This should be set right after opening the stream: the decoder state and
+    any audio decoded but not yet read are discarded.
+   \param _of   The \c OggOpusFile on which to set the decode format.
+   \param _rate One of 8000, 12000, 16000, 24000 or 48000 (the default).
+   \param _mono Non-zero to decode stereo links as mono.
+   \return 0 on success or a negative value on error.
+   \retval #OP_EINVAL The rate is not supported or the stream is not open.
+   \retval #OP_EFAULT The decoder could not be created.*/
+OP_WARN_UNUSED_RESULT int op_set_decode_format(OggOpusFile *_of,
+ opus_int32 _rate,int _mono) OP_ARG_NONNULL(1);
+
 /**Gain offset type that indicates that the provided offset is relative to the
     header gain.
    This is the default.*/
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <time.h>
 
 #define PROGMEM
 #define PSTR
@@ -21,6 +22,10 @@
 #define snprintf_P snprintf
 #define strncpy_P strncpy
 
+static inline unsigned long micros() { struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000; }
+static inline unsigned long millis() { return micros() / 1000; }
+static inline void delay(unsigned long ms) { struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L }; nanosleep(&ts, NULL); }
+
 #ifdef __cplusplus
 class SerialEmulator {
   public:
@@ -0,0 +1,134 @@
+// Host stand-in for the ESP32 HTTPClient and WiFiClient, just enough for AudioFileSourceHTTPStream
+// and AudioFileSourceICYStream.  Tests put the responses in mockServer().pages, keyed by URL, and
+// can let only a few bytes arrive at a time so the socket runs dry at awkward places.
+
+#ifndef _HOST_HTTPCLIENT_H
+#define _HOST_HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <ctype.h>
+#include <strings.h>
+#include <algorithm>
+#include <map>
+#include <string>
+
+class String
+{
+  public:
+    String() {};
+    String(const char *s) : str(s) {};
+    const char *c_str() const { return str.c_str(); };
+    int toInt() const { return atoi(str.c_str()); };
+    bool equalsIgnoreCase(const char *s) const { return !strcasecmp(str.c_str(), s); };
+
+  private:
+    std::string str;
+};
+
+struct MockResponse
+{
+  int code;
+  std::map<std::string, std::string> headers;
+  std::string body;
+  bool sized;          // Sends a Content-Length
+  size_t dropAfter;    // Server closes the connection after this many body bytes, 0 for never
+};
+
+struct MockServer
+{
+  std::map<std::string, MockResponse> pages;
+  long arriving = -1;  // Bytes that arrive before the socket runs dry, -1 for no limit
+  int connects = 0;    // TCP connections opened
+  int garbled = 0;     // Requests sent on a socket which still had an old response in it
+  int misrouted = 0;   // Requests sent on a socket open to another host
+};
+
+// Not static, so every file shares the one server
+inline MockServer &mockServer()
+{
+  static MockServer server;
+  return server;
+}
+
+class WiFiClient
+{
+  public:
+    bool connected() { return isOpen && ((at < data.size()) || !dropped); };
+    int available() {
+      long n = connected() ? data.size() - at : 0;
+      return (mockServer().arriving < 0) ? n : std::min(n, mockServer().arriving);
+    };
+    int read() {
+      uint8_t c;
+      return (read(&c, 1) == 1) ? c : -1;
+    };
+    int read(uint8_t *buf, size_t len) {
+      int n = std::min((int)len, available());
+      memcpy(buf, data.data() + at, n);
+      at += n;
+      if (mockServer().arriving > 0) mockServer().arriving -= n;
+      return n;
+    };
+    void stop() { isOpen = false; data.clear(); at = 0; };
+
+    // Server side
+    void connect(const std::string &h) { mockServer().connects++; isOpen = true; dropped = false; host = h; data.clear(); at = 0; };
+    void respond(const std::string &body, size_t dropAfter) {
+      if (at < data.size()) mockServer().garbled++;
+      data = dropAfter ? body.substr(0, dropAfter) : body;
+      at = 0;
+      dropped = dropAfter != 0;
+    };
+    std::string host;
+
+  private:
+    bool isOpen = false;
+    bool dropped = false;
+    std::string data;
+    size_t at = 0;
+};
+
+enum { HTTP_CODE_OK = 200, HTTPC_FORCE_FOLLOW_REDIRECTS = 1 };
+
+class HTTPClient
+{
+  public:
+    bool begin(WiFiClient &c, const char *u) {
+      client = &c;
+      url = u;
+      const char *h = strstr(u, "://");
+      h = h ? h + 3 : u;
+      host = std::string(u, strcspn(h, "/") + (h - u));
+      return true;
+    };
+    void setReuse(bool r) { reuse = r; };
+    void useHTTP10(bool v) { (void)v; };
+    void setFollowRedirects(int f) { (void)f; };
+    void addHeader(const char *name, const char *value) { (void)name; (void)value; };
+    void collectHeaders(const char *names[], size_t count) { (void)names; (void)count; };
+    // Like the real one, a connected socket gets the request whichever host it goes to
+    int GET() {
+      if (!client->connected()) client->connect(host);
+      else if (client->host != host) mockServer().misrouted++;
+      std::map<std::string, MockResponse>::iterator p = mockServer().pages.find(url);
+      if (p == mockServer().pages.end()) { client->respond("", 0); resp = NULL; return 404; }
+      resp = &p->second;
+      client->respond(resp->body, resp->dropAfter);
+      return resp->code;
+    };
+    bool hasHeader(const char *name) { return resp && resp->headers.count(name); };
+    String header(const char *name) { return hasHeader(name) ? String(resp->headers[name].c_str()) : String(""); };
+    int getSize() { return (resp && resp->sized) ? (int)resp->body.size() : -1; };
+    bool connected() { return client && client->connected(); };
+    WiFiClient *getStreamPtr() { return client; };
+    void end() { if (client && !reuse) client->stop(); };
+
+  private:
+    WiFiClient *client = NULL;
+    std::string url;
+    std::string host;
+    MockResponse *resp = NULL;
+    bool reuse = false;
+};
+
+#endif
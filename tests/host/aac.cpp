@@ -1,10 +1,168 @@
 #include <Arduino.h>
 #include "AudioFileSourceSTDIO.h"
+#include "AudioFileSourcePROGMEM.h"
 #include "AudioOutputSTDIO.h"
 #include "AudioGeneratorAAC.h"
 
 #define AAC "../../examples/PlayAACFromPROGMEM/homer.aac"
 
+// Like an HTTP stream, which can only be read front to back
+class AudioFileSourceNoSeek : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceNoSeek(const void *data, uint32_t len) : AudioFileSourcePROGMEM(data, len) {};
+    virtual bool seek(int32_t pos, int dir) override { (void)pos; (void)dir; return false; };
+};
+
+static void be32w(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint8_t *Box(uint8_t *p, const char *type, uint8_t **box, int version = -1)
+{
+    *box = p;
+    memcpy(p + 4, type, 4);
+    p += 8;
+    if (version >= 0) { be32w(p, version << 24); p += 4; }
+    return p;
+}
+
+static uint8_t *Close(uint8_t *box, uint8_t *p)
+{
+    be32w(box, p - box);
+    return p;
+}
+
+// The ADTS frames of homer.aac, repeat times over, as an M4A file with 10 access units a chunk
+#define M4A_SPC 10
+static uint8_t *MakeM4A(int repeat, bool moovLast, uint32_t *len)
+{
+    FILE *f = fopen(AAC, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    uint32_t adtsLen = ftell(f);
+    uint8_t *adts = (uint8_t *)malloc(adtsLen);
+    fseek(f, 0, SEEK_SET);
+    if (fread(adts, 1, adtsLen, f) != adtsLen) adtsLen = 0;
+    fclose(f);
+
+    // Frame sizes without their headers, and where the payloads are
+    uint32_t frames = 0;
+    for (uint32_t i = 0; i + 7 <= adtsLen; frames++) i += ((adts[i + 3] & 3) << 11) | (adts[i + 4] << 3) | (adts[i + 5] >> 5);
+    uint32_t *fsize = (uint32_t *)malloc(frames * sizeof(uint32_t));
+    uint32_t *foff = (uint32_t *)malloc(frames * sizeof(uint32_t));
+    for (uint32_t i = 0, n = 0; n < frames; n++) {
+        uint32_t hdr = (adts[i + 1] & 1) ? 7 : 9;
+        uint32_t flen = ((adts[i + 3] & 3) << 11) | (adts[i + 4] << 3) | (adts[i + 5] >> 5);
+        foff[n] = i + hdr;
+        fsize[n] = flen - hdr;
+        i += flen;
+    }
+    uint32_t samples = frames * repeat;
+    uint32_t chunks = (samples + M4A_SPC - 1) / M4A_SPC;
+    int profile = adts[2] >> 6;
+    int rateIdx = (adts[2] >> 2) & 0x0f;
+    int ch = ((adts[2] & 1) << 2) | (adts[3] >> 6);
+    static const uint32_t rates[13] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+    uint8_t *m = (uint8_t *)calloc(1, 1024 + adtsLen * repeat + samples * 4 + chunks * 4);
+    uint8_t *p = m;
+    uint8_t *b[8];
+    p = Box(p, "ftyp", &b[0]);
+    memcpy(p, "M4A \0\0\0\0M4A mp42isom", 20); p += 20;
+    p = Close(b[0], p);
+
+    uint8_t *mdat = NULL;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == (moovLast ? 0 : 1)) {
+            p = Box(p, "mdat", &mdat);
+            for (uint32_t s = 0; s < samples; s++) { memcpy(p, adts + foff[s % frames], fsize[s % frames]); p += fsize[s % frames]; }
+            p = Close(mdat, p);
+            continue;
+        }
+        p = Box(p, "moov", &b[0]);
+        p = Box(p, "trak", &b[1]);
+        p = Box(p, "mdia", &b[2]);
+        p = Box(p, "mdhd", &b[3], 0);
+        p += 8; be32w(p, rates[rateIdx]); be32w(p + 4, samples * 1024); p += 12;
+        p = Close(b[3], p);
+        p = Box(p, "hdlr", &b[3], 0);
+        p += 4; memcpy(p, "soun", 4); p += 16;
+        p = Close(b[3], p);
+        p = Box(p, "minf", &b[3]);
+        p = Box(p, "stbl", &b[4]);
+        p = Box(p, "stsd", &b[5], 0);
+        be32w(p, 1); p += 4;
+        p = Box(p, "mp4a", &b[6]);
+        p[7] = 1; p[17] = ch; p[19] = 16; be32w(p + 24, rates[rateIdx] << 16); p += 28;
+        p = Box(p, "esds", &b[7], 0);
+        static const uint8_t esd[] = { 0x03, 25, 0, 1, 0, 0x04, 17, 0x40, 0x15, 0, 0, 0, 0, 1, 0xf4, 0, 0, 1, 0xf4, 0, 0x05, 2, 0, 0, 0x06, 1, 2 };
+        memcpy(p, esd, sizeof(esd));
+        p[22] = ((profile + 1) << 3) | (rateIdx >> 1);
+        p[23] = ((rateIdx & 1) << 7) | (ch << 3);
+        p += sizeof(esd);
+        p = Close(b[7], p);
+        p = Close(b[6], p);
+        p = Close(b[5], p);
+        p = Box(p, "stts", &b[5], 0);
+        be32w(p, 1); be32w(p + 4, samples); be32w(p + 8, 1024); p += 12;
+        p = Close(b[5], p);
+        p = Box(p, "stsc", &b[5], 0);
+        bool partial = samples % M4A_SPC;
+        be32w(p, partial ? 2 : 1); be32w(p + 4, 1); be32w(p + 8, M4A_SPC); be32w(p + 12, 1); p += 16;
+        if (partial) { be32w(p, chunks); be32w(p + 4, samples % M4A_SPC); be32w(p + 8, 1); p += 12; }
+        p = Close(b[5], p);
+        p = Box(p, "stsz", &b[5], 0);
+        be32w(p, 0); be32w(p + 4, samples); p += 8;
+        for (uint32_t s = 0; s < samples; s++) { be32w(p, fsize[s % frames]); p += 4; }
+        p = Close(b[5], p);
+        p = Box(p, "stco", &b[5], 0);
+        be32w(p, chunks); p += 4;
+        // The data starts right after mdat's header, wherever mdat ends up
+        uint32_t off = moovLast ? (mdat - m) + 8 : (p - m) + chunks * 4 + 8;
+        for (uint32_t s = 0; s < samples; s++) {
+            if (!(s % M4A_SPC)) { be32w(p, off); p += 4; }
+            off += fsize[s % frames];
+        }
+        for (int i = 5; i >= 0; i--) p = Close(b[i], p);
+    }
+    free(fsize);
+    free(foff);
+    free(adts);
+    *len = p - m;
+    return m;
+}
+
+// Plays in through a default AudioGeneratorAAC into name, false if it wouldn't start
+static bool Play(AudioFileSource *in, const char *name)
+{
+    AudioOutputSTDIO *out = new AudioOutputSTDIO();
+    out->SetFilename(name);
+    AudioGeneratorAAC *aac = new AudioGeneratorAAC();
+    bool ok = aac->begin(in, out);
+    while (aac->loop()) { /*noop*/ }
+    aac->stop();
+    delete aac;
+    delete out;
+    return ok;
+}
+
+static bool SameFile(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa);
+        same = (ca == fgetc(fb));
+        if (ca == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
 int main(int argc, char **argv)
 {
     (void) argc;
@@ -24,4 +182,38 @@ int main(int argc, char **argv)
     delete in;
 
     free(space);
+
+    // The same frames in an M4A decode bit-exactly like the ADTS file, from a stream that can't seek
+    // when moov comes first, and from one that can when it comes last
+    bool ok = true;
+    uint32_t len;
+    uint8_t *m4a = MakeM4A(1, false, &len);
+    AudioFileSourceNoSeek *stream = new AudioFileSourceNoSeek(m4a, len);
+    if (!Play(stream, "out.m4a.wav") || !SameFile("out.aac.wav", "out.m4a.wav")) {
+        printf("M4A with moov first didn't play like the ADTS file\n");
+        ok = false;
+    }
+    delete stream;
+    free(m4a);
+
+    m4a = MakeM4A(1, true, &len);
+    AudioFileSourcePROGMEM *file = new AudioFileSourcePROGMEM(m4a, len);
+    if (!Play(file, "out.m4a.wav") || !SameFile("out.aac.wav", "out.m4a.wav")) {
+        printf("M4A with moov last didn't play like the ADTS file\n");
+        ok = false;
+    }
+    delete file;
+    free(m4a);
+
+    // Tables too big to keep in RAM need seeking, so a stream that can't is turned away up front
+    m4a = MakeM4A(120, false, &len);
+    stream = new AudioFileSourceNoSeek(m4a, len);
+    if (Play(stream, "out.m4abig.wav")) {
+        printf("M4A with big tables started from a stream that can't seek\n");
+        ok = false;
+    }
+    delete stream;
+    free(m4a);
+
+    return ok ? 0 : 1;
 }
@@ -1,10 +1,259 @@
 #include <Arduino.h>
+#include <math.h>
 #include "AudioFileSourceSTDIO.h"
+#include "AudioFileSourcePROGMEM.h"
 #include "AudioOutputSTDIO.h"
 #include "AudioGeneratorFLAC.h"
 
 #define AAC "gs-16b-2c-44100hz.flac"
 
+// Remembers the lowest offset read from and counts the seeks since Watch(), to tell how a seek went
+class AudioFileSourceWatch : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceWatch(const void *data, uint32_t len) : AudioFileSourcePROGMEM(data, len) { Watch(); };
+    virtual uint32_t read(void *data, uint32_t len) override {
+        if (getPos() < lowest) lowest = getPos();
+        return AudioFileSourcePROGMEM::read(data, len);
+    };
+    virtual bool seek(int32_t pos, int dir) override {
+        seeks++;
+        return AudioFileSourcePROGMEM::seek(pos, dir);
+    };
+    void Watch() { lowest = 0xffffffff; seeks = 0; };
+    uint32_t lowest;
+    int seeks;
+};
+
+// Like an HTTP stream, which can only be read front to back
+class AudioFileSourceNoSeek : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceNoSeek(const void *data, uint32_t len) : AudioFileSourcePROGMEM(data, len) {};
+    virtual bool seek(int32_t pos, int dir) override { (void)pos; (void)dir; return false; };
+};
+
+static uint8_t crc8(const uint8_t *p, int len)
+{
+    uint8_t c = 0;
+    while (len--) {
+        c ^= *p++;
+        for (int i = 0; i < 8; i++) c = (c & 0x80) ? (c << 1) ^ 0x07 : (c << 1);
+    }
+    return c;
+}
+
+static uint16_t crc16(const uint8_t *p, int len)
+{
+    uint16_t c = 0;
+    while (len--) {
+        c ^= *p++ << 8;
+        for (int i = 0; i < 8; i++) c = (c & 0x8000) ? (c << 1) ^ 0x8005 : (c << 1);
+    }
+    return c;
+}
+
+// FLAC24_FRAMES frames of 24-bit stereo at 48kHz as verbatim subframes, a 440Hz tone on the left and
+// 1kHz on the right
+#define FLAC24_BLOCK 1152
+#define FLAC24_FRAMES 4
+static uint8_t *MakeFLAC24(uint32_t *len)
+{
+    const uint32_t samples = FLAC24_BLOCK * FLAC24_FRAMES;
+    uint8_t *f = (uint8_t *)malloc(42 + FLAC24_FRAMES * (8 + 2 * (1 + 3 * FLAC24_BLOCK) + 2));
+    uint8_t *p = f;
+    static const uint8_t head[] = { 'f', 'L', 'a', 'C', 0x80, 0, 0, 34,
+        FLAC24_BLOCK >> 8, FLAC24_BLOCK & 0xff, FLAC24_BLOCK >> 8, FLAC24_BLOCK & 0xff, 0, 0, 0, 0, 0, 0,
+        0x0b, 0xb8, 0x03, 0x70, 0, 0, samples >> 8, samples & 0xff };
+    memcpy(p, head, sizeof(head));
+    memset(p + sizeof(head), 0, 16); // No MD5
+    p += sizeof(head) + 16;
+    for (int fr = 0; fr < FLAC24_FRAMES; fr++) {
+        uint8_t *start = p;
+        *p++ = 0xff; *p++ = 0xf8; // Sync, fixed blocksize
+        *p++ = 0x7a; // Blocksize-1 in 16 bits after the header, 48kHz
+        *p++ = 0x1c; // Independent stereo, 24 bits
+        *p++ = fr;
+        *p++ = (FLAC24_BLOCK - 1) >> 8; *p++ = (FLAC24_BLOCK - 1) & 0xff;
+        *p = crc8(start, p - start); p++;
+        for (int c = 0; c < 2; c++) {
+            *p++ = 0x02; // Verbatim
+            for (int i = 0; i < FLAC24_BLOCK; i++) {
+                int n = fr * FLAC24_BLOCK + i;
+                int32_t s = c ? (int32_t)(-3000000 * sin(2 * M_PI * 1000 * n / 48000)) : (int32_t)(8000000 * sin(2 * M_PI * 440 * n / 48000));
+                *p++ = s >> 16; *p++ = s >> 8; *p++ = s;
+            }
+        }
+        uint16_t crc = crc16(start, p - start);
+        *p++ = crc >> 8; *p++ = crc;
+    }
+    *len = p - f;
+    return f;
+}
+
+static uint8_t *Load(const char *name, uint32_t *len)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *d = (uint8_t *)malloc(*len);
+    if (fread(d, 1, *len, f) != *len) *len = 0;
+    fclose(f);
+    return d;
+}
+
+// The test file with a SEEKTABLE after the STREAMINFO, a point every two seconds and a placeholder.
+// Frames are found by their headers: a good CRC-8 and the next frame number.  *point is the offset
+// of the point at or before 10s.
+static uint8_t *AddSeekTable(uint32_t *len, uint32_t *point)
+{
+    uint32_t inLen;
+    uint8_t *in = Load(AAC, &inLen);
+    if (!in) return NULL;
+    uint32_t first = 4;
+    for (bool last = false; !last; first += 4 + ((in[first + 1] << 16) | (in[first + 2] << 8) | in[first + 3])) last = in[first] & 0x80;
+    uint32_t block = (in[10] << 8) | in[11]; // STREAMINFO's largest, the same as its smallest here
+
+    static uint8_t table[64 * 18];
+    int points = 0;
+    uint32_t frame = 0;
+    for (uint32_t p = first; (p + 16 < inLen) && (points < 63); p++) {
+        if ((in[p] != 0xff) || (in[p + 1] != 0xf8)) continue;
+        int n = (in[p + 4] < 0x80) ? 1 : (in[p + 4] < 0xe0) ? 2 : 3;
+        uint32_t num = (n == 1) ? in[p + 4] : (n == 2) ? ((in[p + 4] & 0x1f) << 6) | (in[p + 5] & 0x3f) : 0xffffffff;
+        int bs = in[p + 2] >> 4, sr = in[p + 2] & 15;
+        int hdr = 4 + n + ((bs == 6) ? 1 : (bs == 7) ? 2 : 0) + ((sr == 12) ? 1 : ((sr == 13) || (sr == 14)) ? 2 : 0);
+        if ((num != frame) || (crc8(in + p, hdr) != in[p + hdr])) continue;
+        uint64_t sample = (uint64_t)frame * block;
+        if ((sample + block - 1) / 88200 != (frame ? (sample - 1) / 88200 : (uint64_t)-1)) {
+            uint8_t *t = table + 18 * points++;
+            uint64_t off = p - first;
+            for (int i = 0; i < 8; i++) { t[i] = sample >> (56 - 8 * i); t[8 + i] = off >> (56 - 8 * i); }
+            t[16] = block >> 8; t[17] = block;
+            if (sample <= 441000) *point = p;
+        }
+        frame++;
+    }
+    memset(table + 18 * points, 0xff, 8); // Placeholder
+    memset(table + 18 * points + 8, 0, 10);
+    points++;
+
+    uint32_t tableLen = 18 * points;
+    *len = inLen + 4 + tableLen;
+    uint8_t *out = (uint8_t *)malloc(*len);
+    memcpy(out, in, 42);
+    out[4] &= 0x7f;
+    out[42] = (in[4] & 0x80) | 3;
+    out[43] = tableLen >> 16; out[44] = tableLen >> 8; out[45] = tableLen;
+    memcpy(out + 46, table, tableLen);
+    memcpy(out + 46 + tableLen, in + 42, inLen - 42);
+    *point += 4 + tableLen;
+    free(in);
+    return out;
+}
+
+// Whether the samples in b are the ones in a from sample from on, to the end
+static bool SameTail(const char *a, const char *b, uint32_t from)
+{
+    uint32_t la, lb;
+    uint8_t *da = Load(a, &la);
+    uint8_t *db = Load(b, &lb);
+    bool same = da && db && (la > 44 + from * 4) && (la - from * 4 == lb) && !memcmp(da + 44 + from * 4, db + 44, lb - 44);
+    free(da);
+    free(db);
+    return same;
+}
+
+// Seeks bisected by libflac land on the right sample, and where they landed is remembered, so going
+// just past there again is a single jump
+static bool TestSeek()
+{
+    bool ok = true;
+    uint32_t len = 0;
+    uint8_t *data = Load(AAC, &len);
+    if (!data) return false;
+    AudioFileSourceWatch *in = new AudioFileSourceWatch(data, len);
+    AudioOutputSTDIO *out = new AudioOutputSTDIO();
+    out->SetFilename("out.flacbisect.wav");
+    AudioGeneratorFLAC *flac = new AudioGeneratorFLAC();
+    if (!flac->begin(in, out) || !flac->SeekMs(11300) || !flac->SeekMs(5000)) {
+        printf("FLAC didn't seek\n");
+        ok = false;
+    }
+    in->Watch();
+    if (!flac->SeekMs(5500) || (in->seeks != 1)) {
+        printf("FLAC seek close after where the last one landed took %d seeks, not 1\n", in->seeks);
+        ok = false;
+    }
+    while (flac->loop()) { /*noop*/ }
+    flac->stop();
+    if (!SameTail("out.flac.wav", "out.flacbisect.wav", 5500 * 44100 / 1000)) {
+        printf("FLAC played something else after the seek\n");
+        ok = false;
+    }
+    delete flac;
+    delete out;
+    delete in;
+    free(data);
+    return ok;
+}
+
+// Decoding on two cores, a seek before playing anything starts scanning at the SEEKTABLE's point
+// and plays what a plain decode does from there on.  A source that can't seek is decoded on one core.
+static bool TestParallelSeek()
+{
+    bool ok = true;
+    uint32_t len = 0, point = 0;
+    uint8_t *data = AddSeekTable(&len, &point);
+    if (!data) return false;
+    AudioFileSourceWatch *in = new AudioFileSourceWatch(data, len);
+    AudioOutputSTDIO *out = new AudioOutputSTDIO();
+    out->SetFilename("out.flacseek.wav");
+    AudioGeneratorFLAC *flac = new AudioGeneratorFLAC();
+    flac->SetDecodeThreads(2);
+    if (!flac->begin(in, out) || !flac->SeekMs(11300)) {
+        printf("FLAC on two cores didn't seek\n");
+        ok = false;
+    }
+    in->Watch();
+    while (flac->loop()) { /*noop*/ }
+    flac->stop();
+    if (in->lowest < point) {
+        printf("FLAC on two cores scanned from %u, not from the SEEKTABLE's %u\n", in->lowest, point);
+        ok = false;
+    }
+    if (!SameTail("out.flac.wav", "out.flacseek.wav", 11300 * 44100 / 1000)) {
+        printf("FLAC on two cores played something else after the seek\n");
+        ok = false;
+    }
+    delete flac;
+    delete out;
+    delete in;
+
+    AudioFileSourceNoSeek *stream = new AudioFileSourceNoSeek(data, len);
+    out = new AudioOutputSTDIO();
+    out->SetFilename("out.flacseek.wav");
+    flac = new AudioGeneratorFLAC();
+    flac->SetDecodeThreads(2);
+    if (!flac->begin(stream, out)) {
+        printf("FLAC on two cores wouldn't play a stream that can't seek\n");
+        ok = false;
+    }
+    while (flac->loop()) { /*noop*/ }
+    flac->stop();
+    if (!SameTail("out.flac.wav", "out.flacseek.wav", 0)) {
+        printf("FLAC stream that can't seek didn't play like the file\n");
+        ok = false;
+    }
+    delete flac;
+    delete out;
+    delete stream;
+    free(data);
+    return ok;
+}
+
 int main(int argc, char **argv)
 {
     (void) argc;
@@ -21,4 +270,34 @@ int main(int argc, char **argv)
     delete flac;
     delete out;
     delete in;
+
+    // 24-bit FLAC into an output that only takes 16 bits is dithered down, and the file says 16 bits
+    bool ok = true;
+    uint32_t len;
+    uint8_t *flac24 = MakeFLAC24(&len);
+    AudioFileSourcePROGMEM *in24 = new AudioFileSourcePROGMEM(flac24, len);
+    out = new AudioOutputSTDIO();
+    out->SetFilename("out24.flac.wav");
+    flac = new AudioGeneratorFLAC();
+
+    flac->begin(in24, out);
+    while (flac->loop()) { /*noop*/ }
+    flac->stop();
+
+    delete flac;
+    delete out;
+    delete in24;
+    free(flac24);
+
+    uint8_t hdr[44];
+    FILE *f = fopen("out24.flac.wav", "rb");
+    if (!f || (fread(hdr, 1, 44, f) != 44) || (hdr[34] != 16) || (*(uint32_t *)(hdr + 40) != FLAC24_BLOCK * FLAC24_FRAMES * 4)) {
+        printf("24-bit FLAC into a 16-bit output wrote the wrong header\n");
+        ok = false;
+    }
+    if (f) fclose(f);
+
+    ok = TestSeek() && ok;
+    ok = TestParallelSeek() && ok;
+    return ok ? 0 : 1;
 }
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+#include <time.h>
+#include "FLAC/stream_decoder.h"
+
+// Times libflac decoding the test file from memory, without MD5 checking or any output, so only
+// the decoder itself is measured.  The hash is there to show two builds decoded the same samples.
+
+#define FLAC "gs-16b-2c-44100hz.flac"
+#define RUNS 60
+
+static uint8_t *buff;
+static size_t buffLen;
+static size_t buffPos;
+static uint64_t hash;
+
+static FLAC__StreamDecoderReadStatus Read(const FLAC__StreamDecoder *d, FLAC__byte out[], size_t *bytes, void *data)
+{
+    (void) d;
+    (void) data;
+    if (buffPos >= buffLen) { *bytes = 0; return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM; }
+    if (*bytes > buffLen - buffPos) *bytes = buffLen - buffPos;
+    memcpy(out, buff + buffPos, *bytes);
+    buffPos += *bytes;
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderWriteStatus Write(const FLAC__StreamDecoder *d, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *data)
+{
+    (void) d;
+    (void) data;
+    for (unsigned ch = 0; ch < frame->header.channels; ch++)
+        for (unsigned i = 0; i < frame->header.blocksize; i++) hash = hash * 31 + (uint32_t)buffer[ch][i];
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void Error(const FLAC__StreamDecoder *d, FLAC__StreamDecoderErrorStatus status, void *data)
+{
+    (void) d;
+    (void) data;
+    printf("Decode error %d\n", status);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = fopen((argc > 1) ? argv[1] : FLAC, "rb");
+    if (!f) return 1;
+    fseek(f, 0, SEEK_END);
+    buffLen = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buff = (uint8_t *)malloc(buffLen);
+    if (fread(buff, 1, buffLen, f) != buffLen) return 1;
+    fclose(f);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < RUNS; i++) {
+        FLAC__StreamDecoder *d = FLAC__stream_decoder_new();
+        FLAC__stream_decoder_set_md5_checking(d, false);
+        buffPos = 0;
+        FLAC__stream_decoder_init_stream(d, Read, NULL, NULL, NULL, NULL, Write, NULL, Error, NULL);
+        FLAC__stream_decoder_process_until_end_of_stream(d);
+        FLAC__stream_decoder_delete(d);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%d decodes in %.3f s, hash %016llx\n", RUNS, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, (unsigned long long)hash);
+
+    free(buff);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <Arduino.h>
+#include "AudioFileSourceICYStream.h"
+#include "AudioFileSourceHTTPStream.h"
+
+// The HTTP sources run against the HTTPClient.h stand-in here, with responses made up on the spot
+
+static void LogMetadata(void *cbData, const char *type, bool isUnicode, const char *str)
+{
+    (void) isUnicode;
+    std::string *log = reinterpret_cast<std::string *>(cbData);
+    *log += std::string(type) + "=" + str + "\n";
+}
+
+// An ICY stream of audio with a metadata block after every metaInt bytes of it
+static std::string MakeICY(const std::string &audio, int metaInt, const char *const *meta, int metaCount)
+{
+    std::string body;
+    for (int i = 0; i * metaInt < (int)audio.size(); i++) {
+        body += audio.substr(i * metaInt, metaInt);
+        if ((i + 1) * metaInt > (int)audio.size()) break; // Too short a tail to be followed by any
+        std::string m = meta[i % metaCount];
+        int blocks = (m.size() + 15) / 16;
+        m.resize(blocks * 16, '\0');
+        body += (char)blocks;
+        body += m;
+    }
+    return body;
+}
+
+// Every metadata block gets split across reads, at a different place each time, yet the audio
+// comes out untouched and each title is reported whole
+static bool TestICY()
+{
+    static const char *const meta[] = {
+        "StreamTitle='It's a Test - Foo';StreamUrl='http://x/y';",
+        "",
+        "StreamTitle=plain;",
+        "StreamTitle=\"dq\";",
+        "XKeyIsVeryLongIndeed='zzz';StreamTitle='';",
+        "StreamTitle='no end",
+    };
+    static const char expect[] =
+        "StreamTitle=It's a Test - Foo\nStreamUrl=http://x/y\n"
+        "StreamTitle=plain\n"
+        "StreamTitle=dq\n"
+        "StreamTitle=\n"
+        "StreamTitle=no end\n";
+    static std::string audio, log, out;
+    for (int i = 0; i < 6100; i++) audio += (char)(i * 7 + (i >> 8));
+    MockResponse &r = mockServer().pages["http://radio/live"];
+    r.code = HTTP_CODE_OK;
+    r.headers["icy-metaint"] = "500";
+    r.body = MakeICY(audio, 500, meta, 6);
+    r.sized = false;
+    r.dropAfter = 0;
+
+    AudioFileSourceICYStream *src = new AudioFileSourceICYStream("http://radio/live");
+    src->RegisterMetadataCB(LogMetadata, &log);
+    static uint8_t buff[400];
+    for (int i = 0; (i < 10000) && (out.size() < audio.size()); i++) {
+        mockServer().arriving = 1 + (i * 13) % 37;
+        int got = src->readNonBlock(buff, 1 + (i * 31) % sizeof(buff));
+        out.append((char *)buff, got);
+    }
+    delete src;
+    mockServer().arriving = -1;
+
+    bool ok = true;
+    if (out != audio) {
+        printf("ICY audio came out %d bytes long, or changed\n", (int)out.size());
+        ok = false;
+    }
+    if (log != (std::string(expect) + expect)) {
+        printf("ICY metadata came out as:\n%s", log.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+static void LogStatus(void *cbData, int code, const char *str)
+{
+    (void) str;
+    std::string *log = reinterpret_cast<std::string *>(cbData);
+    *log += std::to_string(code) + " ";
+}
+
+static MockResponse &Page(const char *url, const std::string &body, size_t dropAfter)
+{
+    MockResponse &r = mockServer().pages[url];
+    r.code = HTTP_CODE_OK;
+    r.headers.clear();
+    r.body = body;
+    r.sized = true;
+    r.dropAfter = dropAfter;
+    return r;
+}
+
+// Up to len bytes, fewer if the stream ends or gives up first.  Only good until the next call.
+static const std::string &ReadSome(AudioFileSourceHTTPStream *src, uint32_t len)
+{
+    static char buff[512];
+    static std::string got;
+    got.clear();
+    while (got.size() < len) {
+        uint32_t n = src->read(buff, std::min((uint32_t)sizeof(buff), len - (uint32_t)got.size()));
+        if (!n) break;
+        got.append(buff, n);
+    }
+    return got;
+}
+
+// openNext() only sends its request down the old socket when that one is on the same host and has
+// nothing left in it, and a stream the server hangs up on comes back by itself
+static bool TestKeepAlive()
+{
+    static std::string a, b, c;
+    for (int i = 0; i < 1000; i++) { a += (char)i; b += (char)(i * 3); c += (char)(i * 5); }
+    Page("http://one/a", a, 0);
+    Page("http://one/b", b, 0);
+    Page("http://two/c", c, 0);
+    mockServer().connects = 0;
+    mockServer().garbled = 0;
+    mockServer().misrouted = 0;
+
+    bool ok = true;
+    AudioFileSourceHTTPStream *src = new AudioFileSourceHTTPStream("http://one/a");
+    if (ReadSome(src, 2000) != a) { printf("First page didn't read back\n"); ok = false; }
+    src->openNext("http://one/b");
+    if (ReadSome(src, 2000) != b) { printf("Second page didn't read back\n"); ok = false; }
+    if (mockServer().connects != 1) { printf("Same host, body read: %d connections instead of 1\n", mockServer().connects); ok = false; }
+
+    // Half a body still in the socket, so the next request needs a fresh one
+    src->openNext("http://one/a");
+    ReadSome(src, 100);
+    src->openNext("http://one/b");
+    if (ReadSome(src, 2000) != b) { printf("Page after a half-read one didn't read back\n"); ok = false; }
+    if (mockServer().connects != 2) { printf("Same host, body unread: %d connections instead of 2\n", mockServer().connects); ok = false; }
+
+    src->openNext("http://two/c");
+    if (ReadSome(src, 2000) != c) { printf("Other host's page didn't read back\n"); ok = false; }
+    if (mockServer().connects != 3) { printf("Other host: %d connections instead of 3\n", mockServer().connects); ok = false; }
+    if (mockServer().garbled) { printf("%d requests went out on a socket with a response still in it\n", mockServer().garbled); ok = false; }
+    if (mockServer().misrouted) { printf("%d requests went out to the wrong host\n", mockServer().misrouted); ok = false; }
+    delete src;
+
+    // The server closes after 300 bytes.  Reconnecting starts the resource over.
+    static std::string status;
+    MockResponse &d = Page("http://one/d", a, 300);
+    src = new AudioFileSourceHTTPStream("http://one/d");
+    src->RegisterStatusCB(LogStatus, &status);
+    src->SetReconnect(2, 0);
+    if (ReadSome(src, 300).compare(0, std::string::npos, a, 0, 300)) { printf("Start of the dropped page didn't read back\n"); ok = false; }
+    d.dropAfter = 0;
+    int before = mockServer().connects;
+    if (ReadSome(src, 2000) != a) { printf("Dropped page didn't read back after reconnecting\n"); ok = false; }
+    if ((mockServer().connects != before + 1) || (status != "3 4 5 ")) {
+        printf("Reconnect took %d connections, status %s\n", mockServer().connects - before, status.c_str());
+        ok = false;
+    }
+    delete src;
+
+    // Gone for good, so both tries fail and the read gives up
+    status.clear();
+    d.dropAfter = 300;
+    src = new AudioFileSourceHTTPStream("http://one/d");
+    src->RegisterStatusCB(LogStatus, &status);
+    src->SetReconnect(2, 0);
+    ReadSome(src, 300);
+    mockServer().pages.erase("http://one/d");
+    if (ReadSome(src, 2000).size() || (status != "3 4 2 4 2 3 ")) {
+        printf("Lost server gave status %s\n", status.c_str());
+        ok = false;
+    }
+    delete src;
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    bool ok = TestICY();
+    ok = TestKeepAlive() && ok;
+    return ok ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <math.h>
 #include "AudioFileSourceSTDIO.h"
 #include "AudioOutputSTDIO.h"
 #include "AudioGeneratorMIDI.h"
@@ -28,4 +29,59 @@ int main(int argc, char **argv)
     delete midi;
     delete midifile;
     delete sf2file;
+
+    midifile = new AudioFileSourceSTDIO(MIDI);
+    sf2file = new AudioFileSourceSTDIO(SF2);
+    out = new AudioOutputSTDIO();
+    out->SetFilename("midi.fixed.wav");
+    midi = new AudioGeneratorMIDI();
+
+    midi->SetSoundfont(sf2file);
+    midi->SetSampleRate(22050);
+    midi->SetFixedPoint(true);
+
+    midi->begin(midifile, out);
+    while (midi->loop()) { /*noop*/ }
+    midi->stop();
+
+    delete out;
+    delete midi;
+    delete midifile;
+    delete sf2file;
+
+    // The fixed point effects also run the low-pass filter the float ones skip, so the waveforms
+    // differ, but the loudness of each ~46ms block has to stay within 1.5dB wherever there is sound
+    bool ok = true;
+    FILE *a = fopen("midi.wav", "rb");
+    FILE *b = fopen("midi.fixed.wav", "rb");
+    if (!a || !b || fseek(a, 44, SEEK_SET) || fseek(b, 44, SEEK_SET)) return 1;
+    static int16_t blockA[2048], blockB[2048];
+    size_t lenA, lenB;
+    double worst = 0;
+    while ((lenA = fread(blockA, 2, 2048, a)) && (lenB = fread(blockB, 2, 2048, b))) {
+        if (lenA != lenB) {
+            printf("Fixed point MIDI rendered a different length\n");
+            ok = false;
+            break;
+        }
+        double ea = 0, eb = 0;
+        for (size_t i = 0; i < lenA; i++) {
+            ea += (double)blockA[i] * blockA[i];
+            eb += (double)blockB[i] * blockB[i];
+        }
+        if (ea < 100.0 * 100.0 * lenA) continue; // Too quiet to judge
+        double db = 10 * log10(eb / ea);
+        if (fabs(db) > fabs(worst)) worst = db;
+    }
+    if (ok && (fgetc(a) != fgetc(b))) { // Both have to be at their end
+        printf("Fixed point MIDI rendered a different length\n");
+        ok = false;
+    }
+    fclose(a);
+    fclose(b);
+    if (fabs(worst) > 1.5) {
+        printf("Fixed point MIDI is %.2fdB off the float rendering in places\n", worst);
+        ok = false;
+    }
+    return ok ? 0 : 1;
 }
@@ -5,6 +5,8 @@
 #include "AudioFileSourceID3.h"
 #include "AudioFileSourceBuffer.h"
 #include "AudioOutputMixer.h"
+#include "AudioFileSourcePROGMEM.h"
+#include <vector>
 
 #define MP3 "../../examples/PlayMP3FromSPIFFS/data/pno-cs.mp3"
 
@@ -43,6 +45,202 @@ void StatusCallback(void *cbData, int code, const char *string)
 }
 
 
+// Keeps every sample in memory, to compare one decode against another
+class AudioOutputMem : public AudioOutput
+{
+  public:
+    virtual bool begin() override { return true; };
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+        samples.push_back(sample[LEFTCHANNEL]);
+        samples.push_back(sample[RIGHTCHANNEL]);
+        return true;
+    };
+    virtual bool stop() override { return true; };
+    std::vector<int16_t> samples;
+};
+
+// Streams are SILENT_FRAMES of 320kbps silence and then the frames of MP3, all 48kHz, so that the
+// byte offset of a time isn't in proportion to it and only a real TOC finds it
+#define SILENT_FRAMES 300
+#define SILENT_BYTES 960
+#define TAG_BYTES 384
+#define GAPLESS_DELAY 576
+#define GAPLESS_PADDING 1000
+static std::vector<uint8_t> audio;
+static std::vector<uint32_t> frameAt; // Offset of each frame in audio
+
+static bool LoadFrames()
+{
+    static uint8_t file[400000];
+    FILE *f = fopen(MP3, "rb");
+    if (!f) return false;
+    size_t len = fread(file, 1, sizeof(file), f);
+    fclose(f);
+    if ((len < 10) || (file[0] != 'I')) return false;
+    size_t p = 10 + ((file[6] << 21) | (file[7] << 14) | (file[8] << 7) | file[9]);
+
+    static const uint8_t silent[] = { 0xff, 0xfb, 0xe4, 0x64 };
+    for (int i = 0; i < SILENT_FRAMES; i++) {
+        frameAt.push_back(audio.size());
+        audio.insert(audio.end(), silent, silent + sizeof(silent));
+        audio.resize(audio.size() + SILENT_BYTES - sizeof(silent), 0);
+    }
+    int n;
+    while ((p + 4 <= len) && ((n = MP3StreamInfo::FrameBytes(file + p)) > 0) && (p + n <= len)) {
+        frameAt.push_back(audio.size());
+        audio.insert(audio.end(), file + p, file + p + n);
+        p += n;
+    }
+    return frameAt.size() > SILENT_FRAMES;
+}
+
+static void put32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static void put16(uint8_t *p, uint32_t v) { p[0] = v >> 8; p[1] = v; }
+
+// The audio behind a tag frame: 'X' for Xing with a LAME gapless extension, 'V' for VBRI, 0 for none
+static void MakeStream(char kind, std::vector<uint8_t> *s)
+{
+    s->clear();
+    if (kind) {
+        static uint8_t tag[TAG_BYTES];
+        static const uint8_t head[] = { 0xff, 0xfb, 0x94, 0x64 };
+        memset(tag, 0, sizeof(tag));
+        memcpy(tag, head, sizeof(head));
+        uint8_t *t = tag + 4 + 32;
+        uint32_t frames = frameAt.size();
+        if (kind == 'X') {
+            // TOC and byte count are relative to the tag frame
+            uint32_t bytes = TAG_BYTES + audio.size();
+            memcpy(t, "Xing", 4);
+            put32(t + 4, 0x0f);
+            put32(t + 8, frames);
+            put32(t + 12, bytes);
+            for (int i = 0; i < 100; i++) t[16 + i] = ((uint64_t)(TAG_BYTES + frameAt[(uint64_t)frames * i / 100]) * 256) / bytes;
+            uint8_t *lame = t + 16 + 100 + 4;
+            memcpy(lame, "LAME3.100", 9);
+            lame[21] = GAPLESS_DELAY >> 4;
+            lame[22] = ((GAPLESS_DELAY & 15) << 4) | (GAPLESS_PADDING >> 8);
+            lame[23] = GAPLESS_PADDING & 0xff;
+        } else {
+            // Bytes of each 10 frames, counted from after the tag frame
+            uint32_t entries = (frames + 9) / 10;
+            memcpy(t, "VBRI", 4);
+            put16(t + 4, 1);
+            put32(t + 10, audio.size());
+            put32(t + 14, frames);
+            put16(t + 18, entries);
+            put16(t + 20, 1);
+            put16(t + 22, 2);
+            put16(t + 24, 10);
+            for (uint32_t i = 0; i < entries; i++) {
+                uint32_t end = (i * 10 + 10 < frames) ? frameAt[i * 10 + 10] : audio.size();
+                put16(t + 26 + i * 2, end - frameAt[i * 10]);
+            }
+        }
+        s->insert(s->end(), tag, tag + sizeof(tag));
+    }
+    s->insert(s->end(), audio.begin(), audio.end());
+}
+
+// Plays a stream to the end into out, from seekMs into it when that's not 0
+static bool Decode(const std::vector<uint8_t> &stream, uint32_t seekMs, std::vector<int16_t> *out)
+{
+    AudioFileSourcePROGMEM *in = new AudioFileSourcePROGMEM(stream.data(), stream.size());
+    AudioOutputMem *mem = new AudioOutputMem();
+    AudioGeneratorMP3 *mp3 = new AudioGeneratorMP3();
+    bool ok = mp3->begin(in, mem);
+    if (ok && seekMs) {
+        // The stream is only known once a frame has been decoded
+        while (mem->samples.empty() && mp3->loop()) { /*noop*/ }
+        mem->samples.clear();
+        ok = mp3->SeekMs(seekMs);
+    }
+    while (ok && mp3->loop()) { /*noop*/ }
+    mp3->stop();
+    out->swap(mem->samples);
+    delete mp3;
+    delete mem;
+    delete in;
+    return ok;
+}
+
+// Gapless playback drops exactly the LAME delay and padding, plus the decoder's own delay, from the
+// untagged decode
+static bool TestGapless(const std::vector<int16_t> &plain, const std::vector<int16_t> &tagged)
+{
+    size_t start = (GAPLESS_DELAY + 529) * 2;
+    size_t end = plain.size() - (GAPLESS_PADDING - 529) * 2;
+    if ((tagged.size() != end - start) || memcmp(tagged.data(), plain.data() + start, tagged.size() * 2)) {
+        printf("Gapless decode is %u samples, not %u, or differs\n", (unsigned)tagged.size() / 2, (unsigned)(end - start) / 2);
+        return false;
+    }
+    return true;
+}
+
+// A seek lands on a frame within the TOC's 1/256 of the stream of the time asked for, and a couple of
+// frames later, once the decoder has warmed up again, plays the same samples as decoding from the start
+static bool TestSeek(const char *name, const std::vector<uint8_t> &stream, const std::vector<int16_t> &serial, uint32_t ms, bool gapless)
+{
+    static std::vector<int16_t> seeked;
+    if (!Decode(stream, ms, &seeked)) {
+        printf("%s: SeekMs(%u) failed\n", name, ms);
+        return false;
+    }
+    const size_t frame = 1152 * 2;
+    const size_t skip = 3 * frame;
+    const long slack = 8 * frame;
+    long expect = (long)ms * 48 * 2;
+    if (seeked.size() < skip + frame) {
+        printf("%s: only %u samples after the seek\n", name, (unsigned)seeked.size() / 2);
+        return false;
+    }
+    for (long at = expect - slack; at <= expect + slack; at += 2) {
+        if ((at < 0) || (at + skip + frame > serial.size())) continue;
+        if (memcmp(seeked.data() + skip, serial.data() + at + skip, frame * 2)) continue;
+        // Up to the end of the shorter, the sample count after the seek being only as good as the TOC
+        size_t len = std::min(seeked.size() - skip, serial.size() - at - skip);
+        if ((len + slack < serial.size() - at - skip) || memcmp(seeked.data() + skip, serial.data() + at + skip, len * 2)) {
+            printf("%s: decode after the seek differs from the serial one\n", name);
+            return false;
+        }
+        // Wherever it landed, a gapless trim still counts from the time asked for and ends the audio
+        // where it should, otherwise it all plays out
+        size_t want = serial.size() - (gapless ? expect : at);
+        if (seeked.size() != want) {
+            printf("%s: %u samples after the seek, not %u\n", name, (unsigned)seeked.size() / 2, (unsigned)want / 2);
+            return false;
+        }
+        return true;
+    }
+    printf("%s: seek to %u ms didn't land within %d frames\n", name, ms, (int)(slack / frame));
+    return false;
+}
+
+// Xing and VBRI tagged streams, played whole and from a seek
+static bool TestTags()
+{
+    if (!LoadFrames()) {
+        printf("Can't read the frames of %s\n", MP3);
+        return false;
+    }
+    static std::vector<uint8_t> plainMP3, xingMP3, vbriMP3;
+    static std::vector<int16_t> plain, xing, vbri;
+    MakeStream(0, &plainMP3);
+    MakeStream('X', &xingMP3);
+    MakeStream('V', &vbriMP3);
+    Decode(plainMP3, 0, &plain);
+    Decode(xingMP3, 0, &xing);
+    Decode(vbriMP3, 0, &vbri);
+    bool ok = TestGapless(plain, xing);
+    if (vbri != plain) {
+        printf("VBRI stream decodes differently from the plain one\n");
+        ok = false;
+    }
+    ok = TestSeek("Xing", xingMP3, xing, 15000, true) && ok;
+    ok = TestSeek("VBRI", vbriMP3, vbri, 15000, false) && ok;
+    return ok;
+}
+
 int main(int argc, char **argv)
 {
     (void) argc;
@@ -72,4 +270,34 @@ int main(int argc, char **argv)
     delete id3;
     delete buff;
     delete in;
+
+    // Past the tag, the buffer's getPos() is how far it has read ahead, as it always was, and
+    // getReadPos() is how far the caller has read
+    bool ok = true;
+    uint8_t hdr[10];
+    FILE *f = fopen(MP3, "rb");
+    if (!f || (fread(hdr, 1, 10, f) != 10)) hdr[0] = 0;
+    if (f) fclose(f);
+    uint32_t tagEnd = 10 + ((hdr[6] << 21) | (hdr[7] << 14) | (hdr[8] << 7) | hdr[9]);
+    in = new AudioFileSourceSTDIO(MP3);
+    buff = new AudioFileSourceBuffer(in, 2048);
+    id3 = new AudioFileSourceID3(buff);
+    uint8_t audio[100];
+    if ((hdr[0] != 'I') || (id3->read(audio, sizeof(audio)) != sizeof(audio)) || (id3->getPos() != tagEnd + sizeof(audio))) {
+        printf("ID3 getPos() after the tag is %u, not %u\n", id3->getPos(), (unsigned)(tagEnd + sizeof(audio)));
+        ok = false;
+    }
+    if ((buff->getReadPos() != tagEnd + sizeof(audio)) || (id3->getReadPos() != tagEnd + sizeof(audio))) {
+        printf("getReadPos() after the tag is %u/%u, not %u\n", buff->getReadPos(), id3->getReadPos(), (unsigned)(tagEnd + sizeof(audio)));
+        ok = false;
+    }
+    if ((buff->getPos() != in->getPos()) || (buff->getPos() <= buff->getReadPos())) {
+        printf("Buffer getPos() is %u, not its input's %u\n", buff->getPos(), in->getPos());
+        ok = false;
+    }
+    delete id3;
+    delete buff;
+    delete in;
+    ok = TestTags() && ok;
+    return ok ? 0 : 1;
 }
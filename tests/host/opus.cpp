@@ -1,10 +1,184 @@
 #include <Arduino.h>
 #include "AudioFileSourceSTDIO.h"
+#include "AudioFileSourcePROGMEM.h"
 #include "AudioOutputSTDIO.h"
 #include "AudioGeneratorOpus.h"
+#include <vector>
 
 #define OPUS "../../examples/PlayOpusFromSPIFFS/data/gs-16b-2c-44100hz.opus"
 
+// Keeps every sample in memory, to compare one decode against another
+class AudioOutputMem : public AudioOutput
+{
+  public:
+    virtual bool begin() override { return true; };
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+        samples.push_back(sample[LEFTCHANNEL]);
+        samples.push_back(sample[RIGHTCHANNEL]);
+        return true;
+    };
+    virtual bool stop() override { return true; };
+    std::vector<int16_t> samples;
+};
+
+// Like an HTTP stream, which can only be read front to back
+class AudioFileSourceNoSeek : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceNoSeek(const void *data, uint32_t len) : AudioFileSourcePROGMEM(data, len) {};
+    virtual bool seek(int32_t pos, int dir) override { (void)pos; (void)dir; return false; };
+};
+
+// The packets of the file, each with the granule position it ends at (0 for the headers)
+static std::vector<std::vector<uint8_t> > packets;
+static std::vector<uint64_t> granules;
+
+static bool LoadPackets()
+{
+    static uint8_t file[300000];
+    FILE *f = fopen(OPUS, "rb");
+    if (!f) return false;
+    size_t len = fread(file, 1, sizeof(file), f);
+    fclose(f);
+
+    std::vector<uint8_t> cur;
+    uint64_t last = 0; // Granule position of the last page with audio on it
+    size_t p = 0;
+    while ((p + 27 <= len) && !memcmp(file + p, "OggS", 4)) {
+        uint64_t granule = 0;
+        for (int i = 7; i >= 0; i--) granule = (granule << 8) | file[p + 6 + i];
+        int segs = file[p + 26];
+        const uint8_t *lacing = file + p + 27;
+        size_t q = p + 27 + segs;
+        size_t first = packets.size();
+        for (int i = 0; i < segs; i++) {
+            cur.insert(cur.end(), file + q, file + q + lacing[i]);
+            q += lacing[i];
+            if (lacing[i] < 255) {
+                packets.push_back(cur);
+                cur.clear();
+            }
+        }
+        // Every audio packet is 20ms, counted on from the last page, but the final one ends where its
+        // page says so the end trim stays as it was
+        for (size_t i = first; i < packets.size(); i++) {
+            if (i < 2) granules.push_back(0);
+            else if (i == packets.size() - 1) granules.push_back(granule);
+            else if (last) granules.push_back(last + 960 * (i - first + 1));
+            else granules.push_back(granule - 960 * (packets.size() - 1 - i));
+        }
+        if (packets.size() > 2) last = granule;
+        p = q;
+    }
+    return packets.size() > 2;
+}
+
+static uint32_t OggCRC(const uint8_t *p, size_t len)
+{
+    uint32_t c = 0;
+    while (len--) {
+        c ^= (uint32_t)*p++ << 24;
+        for (int i = 0; i < 8; i++) c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : (c << 1);
+    }
+    return c;
+}
+
+// One link of the file, a page per packet.  Split, it's two mono streams, the second two seconds
+// ahead of the first, which libopus can't decode to mono on its own.
+static void AddLink(std::vector<uint8_t> *out, uint32_t serial, bool split)
+{
+    for (size_t i = 0; i < packets.size(); i++) {
+        std::vector<uint8_t> pkt = packets[i];
+        if (split && (i == 0)) {
+            static const uint8_t mapping[] = { 2, 0, 0, 1 }; // 2 streams, none coupled, L and R
+            pkt[9] = 2;
+            pkt[18] = 1;
+            pkt.insert(pkt.end(), mapping, mapping + sizeof(mapping));
+        } else if (split && (i >= 2)) {
+            // The first stream's packet is self-delimited, its frame length after the TOC byte
+            std::vector<uint8_t> first(1, pkt[0]);
+            size_t n = pkt.size() - 1;
+            if (n < 252) {
+                first.push_back(n);
+            } else {
+                first.push_back(252 + (n & 3));
+                first.push_back((n - 252 - (n & 3)) >> 2);
+            }
+            first.insert(first.end(), pkt.begin() + 1, pkt.end());
+            pkt = packets[2 + (i - 2 + 100) % (packets.size() - 2)];
+            pkt.insert(pkt.begin(), first.begin(), first.end());
+        }
+
+        static uint8_t head[27 + 8] = { 'O', 'g', 'g', 'S', 0 };
+        head[5] = (i == 0) ? 0x02 : (i == packets.size() - 1) ? 0x04 : 0;
+        for (int b = 0; b < 8; b++) head[6 + b] = granules[i] >> (8 * b);
+        for (int b = 0; b < 4; b++) head[14 + b] = serial >> (8 * b);
+        for (int b = 0; b < 4; b++) head[18 + b] = i >> (8 * b);
+        int segs = pkt.size() / 255 + 1;
+        head[26] = segs;
+        for (int s = 0; s < segs; s++) head[27 + s] = (s < segs - 1) ? 255 : pkt.size() % 255;
+        size_t at = out->size();
+        out->insert(out->end(), head, head + 27 + segs);
+        out->insert(out->end(), pkt.begin(), pkt.end());
+        uint32_t crc = OggCRC(out->data() + at, out->size() - at);
+        for (int b = 0; b < 4; b++) (*out)[at + 22 + b] = crc >> (8 * b);
+    }
+}
+
+static void Decode(AudioFileSource *in, int channels, std::vector<int16_t> *out)
+{
+    AudioOutputMem *mem = new AudioOutputMem();
+    AudioGeneratorOpus *opus = new AudioGeneratorOpus();
+    opus->SetDecodeFormat(48000, channels);
+    opus->begin(in, mem);
+    while (opus->loop()) { /*noop*/ }
+    opus->stop();
+    out->swap(mem->samples);
+    delete opus;
+    delete mem;
+    delete in;
+}
+
+// A stereo link chained after one libopus decodes to mono comes out in mono too, whether the link
+// is known from the start or only turns up on a stream that can't seek
+static bool TestChainedMono()
+{
+    if (!LoadPackets()) {
+        printf("Can't read the packets of %s\n", OPUS);
+        return false;
+    }
+    static std::vector<uint8_t> chain, second;
+    AddLink(&chain, 1, false);
+    AddLink(&chain, 2, true);
+    AddLink(&second, 2, true);
+
+    static std::vector<int16_t> stereo, secondStereo, mono, monoNoSeek;
+    Decode(new AudioFileSourcePROGMEM(chain.data(), chain.size()), 2, &stereo);
+    Decode(new AudioFileSourcePROGMEM(second.data(), second.size()), 2, &secondStereo);
+    Decode(new AudioFileSourcePROGMEM(chain.data(), chain.size()), 1, &mono);
+    Decode(new AudioFileSourceNoSeek(chain.data(), chain.size()), 1, &monoNoSeek);
+    if ((mono.size() != stereo.size()) || (mono.size() < secondStereo.size()) || secondStereo.empty()) {
+        printf("Chain decoded to %u mono samples, not %u\n", (unsigned)mono.size() / 2, (unsigned)stereo.size() / 2);
+        return false;
+    }
+    // The second link ends the chain, and is its stereo decode mixed down.  That one starts with the
+    // silent sample every decode is primed with.
+    bool ok = true;
+    const int16_t *tail = mono.data() + mono.size() - secondStereo.size();
+    for (size_t i = 2; ok && (i < secondStereo.size()); i += 2) {
+        int16_t mix = (secondStereo[i] + secondStereo[i + 1]) >> 1;
+        if ((tail[i] != mix) || (tail[i + 1] != mix)) {
+            printf("Mono sample %u of the second link is %d/%d, not %d\n", (unsigned)i / 2 - 1, tail[i], tail[i + 1], mix);
+            ok = false;
+        }
+    }
+    if (monoNoSeek != mono) {
+        printf("Chain decoded differently from a stream that can't seek\n");
+        ok = false;
+    }
+    return ok;
+}
+
 int main(int argc, char **argv)
 {
     (void) argc;
@@ -22,4 +196,6 @@ int main(int argc, char **argv)
     delete out;
     delete opus;
     delete file;
+
+    return TestChainedMono() ? 0 : 1;
 }
@@ -1,8 +1,190 @@
 #include <Arduino.h>
+#include <math.h>
 #include "AudioFileSourceSTDIO.h"
+#include "AudioFileSourcePROGMEM.h"
 #include "AudioOutputSTDIO.h"
 #include "AudioGeneratorWAV.h"
 
+// A second of 24-bit stereo, a 441Hz tone on the left and 882Hz on the right
+static uint8_t *MakeWAV24(uint32_t *len)
+{
+    const uint32_t rate = 44100, frames = rate, data = frames * 6;
+    uint8_t *w = (uint8_t *)malloc(44 + data);
+    memcpy(w, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0\0\0\0\0\0\0\0\0\x06\0\x18\0data\0\0\0\0", 44);
+    uint32_t riff = 36 + data, byteRate = rate * 6;
+    memcpy(w + 4, &riff, 4);
+    memcpy(w + 24, &rate, 4);
+    memcpy(w + 28, &byteRate, 4);
+    memcpy(w + 40, &data, 4);
+    uint8_t *p = w + 44;
+    for (uint32_t i = 0; i < frames; i++) {
+        for (int c = 1; c <= 2; c++) {
+            int32_t s = (int32_t)(sin(2 * M_PI * 441 * c * i / rate) * 0x7fffff * 0.8);
+            *p++ = s; *p++ = s >> 8; *p++ = s >> 16;
+        }
+    }
+    *len = 44 + data;
+    return w;
+}
+
+// Plays from memory like a file would be, through the read buffer
+class AudioFileSourceNoMap : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceNoMap(const void *data, uint32_t len) : AudioFileSourcePROGMEM(data, len) {};
+    virtual const void *readMapped(uint32_t len) override { (void)len; return NULL; };
+};
+
+// A WAV file of dataLen bytes of data, with a cbSize/samplesPerBlock extension when it's IMA ADPCM
+static uint8_t *MakeWAV(uint16_t tag, uint16_t channels, uint16_t bits, uint16_t blockAlign, const uint8_t *data, uint32_t dataLen, uint32_t *len)
+{
+    const uint32_t rate = 8000, fmtLen = (tag == 0x11) ? 20 : 16;
+    uint8_t *w = (uint8_t *)malloc(28 + fmtLen + dataLen);
+    uint32_t riff = 20 + fmtLen + dataLen, byteRate = rate * blockAlign;
+    uint16_t spb = (tag == 0x11) ? (blockAlign - 4 * channels) / (4 * channels) * 8 + 1 : 0, cb = 2;
+    memcpy(w, "RIFF", 4); memcpy(w + 4, &riff, 4);
+    memcpy(w + 8, "WAVEfmt ", 8); memcpy(w + 16, &fmtLen, 4);
+    memcpy(w + 20, &tag, 2); memcpy(w + 22, &channels, 2); memcpy(w + 24, &rate, 4);
+    memcpy(w + 28, &byteRate, 4); memcpy(w + 32, &blockAlign, 2); memcpy(w + 34, &bits, 2);
+    if (fmtLen > 16) { memcpy(w + 36, &cb, 2); memcpy(w + 38, &spb, 2); }
+    memcpy(w + 20 + fmtLen, "data", 4); memcpy(w + 24 + fmtLen, &dataLen, 4);
+    memcpy(w + 28 + fmtLen, data, dataLen);
+    *len = 28 + fmtLen + dataLen;
+    return w;
+}
+
+// Plays a WAV from memory, mapped or through a small buffer, and checks the samples written match
+static bool PlayAndCheck(const char *what, const uint8_t *w, uint32_t len, bool mapped, const int16_t *expect, uint32_t count)
+{
+    AudioFileSourcePROGMEM *in = mapped ? new AudioFileSourcePROGMEM(w, len) : new AudioFileSourceNoMap(w, len);
+    AudioOutputSTDIO *out = new AudioOutputSTDIO();
+    out->SetFilename("fixture.wav");
+    AudioGeneratorWAV *wav = new AudioGeneratorWAV();
+    wav->SetBufferSize(300);
+    bool ok = wav->begin(in, out);
+    while (wav->loop()) { /*noop*/ }
+    wav->stop();
+    delete wav;
+    delete out;
+    delete in;
+
+    uint32_t n = 0;
+    FILE *f = fopen("fixture.wav", "rb");
+    if (ok && f && !fseek(f, 44, SEEK_SET)) {
+        int16_t s;
+        while ((fread(&s, 2, 1, f) == 1) && (n < count) && (s == expect[n])) n++;
+        ok = (n == count) && (fread(&s, 2, 1, f) != 1);
+    }
+    if (f) fclose(f);
+    if (!ok) printf("%s WAV (%s) didn't decode as expected, first bad sample %u of %u\n", what, mapped ? "mapped" : "buffered", n, count);
+    return ok;
+}
+
+// G.711 by the formulas in the standard, not by table
+static int16_t ULaw(uint8_t u)
+{
+    u = ~u;
+    int t = (((u & 0x0f) << 3) + 0x84) << ((u & 0x70) >> 4);
+    return (u & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+static int16_t ALaw(uint8_t a)
+{
+    a ^= 0x55;
+    int seg = (a & 0x70) >> 4;
+    int t = ((a & 0x0f) << 4) + (seg ? 0x108 : 8);
+    if (seg > 1) t <<= seg - 1;
+    return (a & 0x80) ? t : -t;
+}
+
+// Every code on the left and the same backwards on the right
+static bool TestG711()
+{
+    static uint8_t data[512];
+    static int16_t expect[512];
+    bool ok = true;
+    for (int law = 0; law < 2; law++) {
+        for (int i = 0; i < 256; i++) {
+            data[2 * i] = i;
+            data[2 * i + 1] = 255 - i;
+            expect[2 * i] = law ? ALaw(i) : ULaw(i);
+            expect[2 * i + 1] = law ? ALaw(255 - i) : ULaw(255 - i);
+        }
+        uint32_t len;
+        uint8_t *w = MakeWAV(law ? 6 : 7, 2, 8, 2, data, sizeof(data), &len);
+        for (int mapped = 0; mapped < 2; mapped++) ok = PlayAndCheck(law ? "A-law" : "u-law", w, len, mapped, expect, 512) && ok;
+        free(w);
+    }
+    return ok;
+}
+
+// An IMA ADPCM encoder as in the IMA recommendation.  What it predicts is exactly what a decoder
+// has to come up with.
+static const int16_t imaStep[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80,
+    88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544,
+    598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+    3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635,
+    13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static uint8_t EncodeIMA(int s, int *pred, int *idx)
+{
+    static const int8_t adjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+    int step = imaStep[*idx], diff = s - *pred, vpdiff = step >> 3;
+    uint8_t nib = 0;
+    if (diff < 0) { nib = 8; diff = -diff; }
+    if (diff >= step) { nib |= 4; diff -= step; vpdiff += step; }
+    step >>= 1;
+    if (diff >= step) { nib |= 2; diff -= step; vpdiff += step; }
+    step >>= 1;
+    if (diff >= step) { nib |= 1; vpdiff += step; }
+    *pred += (nib & 8) ? -vpdiff : vpdiff;
+    *pred = (*pred > 32767) ? 32767 : (*pred < -32768) ? -32768 : *pred;
+    *idx += adjust[nib & 7];
+    *idx = (*idx < 0) ? 0 : (*idx > 88) ? 88 : *idx;
+    return nib;
+}
+
+// Three whole blocks and a short one of a loud chirp, clipping now and then so the predictor does too
+static bool TestIMA()
+{
+    bool ok = true;
+    for (int channels = 1; channels <= 2; channels++) {
+        const uint32_t blockAlign = 256 * channels, spb = 505, frames = 3 * spb + 193;
+        static uint8_t data[4 * 512];
+        static int16_t expect[2 * frames];
+        uint8_t *p = data;
+        int pred[2], idx[2] = { 0, 0 };
+        for (uint32_t f = 0; f < frames; f += spb) {
+            uint32_t n = (frames - f < spb) ? frames - f : spb;
+            for (int c = 0; c < channels; c++) {
+                int s = (int)(sin(0.0001 * f * f * (c + 1)) * 40000);
+                pred[c] = (s > 32767) ? 32767 : (s < -32768) ? -32768 : s;
+                expect[f * channels + c] = pred[c];
+                *p++ = pred[c]; *p++ = pred[c] >> 8; *p++ = idx[c]; *p++ = 0;
+            }
+            for (uint32_t g = 1; g < n; g += 8) {
+                for (int c = 0; c < channels; c++) {
+                    for (int k = 0; k < 8; k += 2) {
+                        uint8_t b = 0;
+                        for (int h = 0; h < 2; h++) {
+                            uint32_t at = f + g + k + h;
+                            b |= EncodeIMA((int)(sin(0.0001 * at * at * (c + 1)) * 40000), &pred[c], &idx[c]) << (4 * h);
+                            expect[at * channels + c] = pred[c];
+                        }
+                        *p++ = b;
+                    }
+                }
+            }
+        }
+        uint32_t len;
+        uint8_t *w = MakeWAV(0x11, channels, 4, blockAlign, data, p - data, &len);
+        for (int mapped = 0; mapped < 2; mapped++) ok = PlayAndCheck(channels == 1 ? "Mono IMA ADPCM" : "Stereo IMA ADPCM", w, len, mapped, expect, frames * channels) && ok;
+        free(w);
+    }
+    return ok;
+}
 
 int main(int argc, char **argv)
 {
@@ -20,4 +202,35 @@ int main(int argc, char **argv)
     delete wav;
     delete out;
     delete in;
+
+    // 24-bit samples into an output that only takes 16 bits get dithered down, not refused, and the
+    // file written says 16 bits
+    uint32_t len;
+    uint8_t *wav24 = MakeWAV24(&len);
+    AudioFileSourcePROGMEM *in24 = new AudioFileSourcePROGMEM(wav24, len);
+    out = new AudioOutputSTDIO();
+    out->SetFilename("pcm24.wav");
+    wav = new AudioGeneratorWAV();
+
+    bool ok = wav->begin(in24, out);
+    if (!ok) printf("24-bit WAV into a 16-bit output failed to start\n");
+    while (wav->loop()) { /*noop*/ }
+    wav->stop();
+
+    delete wav;
+    delete out;
+    delete in24;
+    free(wav24);
+
+    uint8_t hdr[44];
+    FILE *f = fopen("pcm24.wav", "rb");
+    if (!f || (fread(hdr, 1, 44, f) != 44) || (hdr[34] != 16) || (*(uint32_t *)(hdr + 40) != 44100 * 4)) {
+        printf("24-bit WAV into a 16-bit output wrote the wrong header\n");
+        ok = false;
+    }
+    if (f) fclose(f);
+
+    ok = TestG711() && ok;
+    ok = TestIMA() && ok;
+    return ok ? 0 : 1;
 }